@@ -0,0 +1,338 @@
+/*
+    Song analyzer
+
+    Every song is played by its own instance of the sound driver. Only the
+    driver tick is run, the sound chips are never rendered, so a song takes
+    a fraction of the time of a headless render. Intro and loop lengths come
+    from the loop detection of the driver.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "SDL2/SDL.h"
+
+#include "qp.h"
+#include "analyze.h"
+#include "lib/worker.h"
+
+// give up if the song has not started after this many seconds
+#define ANALYZE_START_TIMEOUT 10
+#define ANALYZE_MAX_WORKERS 32
+
+// Shared by all workers. Each worker takes the next song ID from NextSong.
+typedef struct {
+    QP_Game* Game;
+    int DriverType;
+    SDL_atomic_t NextSong;
+    SDL_atomic_t Error;
+    SDL_atomic_t* Cancel;
+    int SongCnt;
+    uint32_t Timeout;
+    uint32_t MaxTicks;
+    QP_AnalyzeResult* Result;
+} QP_AnalyzeJob;
+
+// Create and initialize a driver instance. Returns nonzero on failure.
+static int QP_AnalyzeCreate(QP_AnalyzeJob* j,QP_Game* g,struct QP_DriverInterface* di)
+{
+    int val;
+
+    // Each worker has its own copy of the game, as driver init writes to it.
+    // AutoPlay is set so that the Quattro boot song is skipped. DriverOnly
+    // keeps chip writes from being queued for a renderer that never runs.
+    memcpy(g,j->Game,sizeof(*g));
+    g->AutoPlay = 0;
+    g->SampleCache = 0;
+    g->FMThread = 0;
+    g->DriverOnly = 1;
+
+    val = DriverCreate(di,j->DriverType);
+    if(!val)
+        val = di->IInit(di->Driver,g);
+    if(!val)
+        di->IReset(di->Driver,g,1);
+
+    if(val)
+    {
+        DriverDestroy(di);
+        return -1;
+    }
+    return 0;
+}
+
+static void QP_AnalyzeDestroy(struct QP_DriverInterface* di)
+{
+    di->IDeinit(di->Driver);
+    DriverDestroy(di);
+}
+
+static void QP_AnalyzeSong(QP_AnalyzeJob* j,struct QP_DriverInterface* di,int id,QP_AnalyzeResult* r)
+{
+    void* d = di->Driver;
+    struct QP_DriverVoiceInfo vi;
+    int voices = di->IGetVoiceCount(d);
+    int started = 0;
+    int status, loops, i;
+    uint32_t tick;
+    uint32_t loop1 = 0;
+    int loop1cnt = 0;
+
+    memset(r,0,sizeof(*r));
+    r->Silent = 1;
+
+    // wait for the boot song to finish
+    for(tick=0;tick<j->Timeout;tick++)
+    {
+        if(!(di->ISongStatus(d,0) & (SONG_STATUS_PLAYING|SONG_STATUS_STARTING|SONG_STATUS_STOPPING)))
+            break;
+        di->IUpdateTick(d);
+    }
+
+    di->ISongRequest(d,0,id);
+
+    for(tick=1;tick<=j->MaxTicks;tick++)
+    {
+        di->IUpdateTick(d);
+
+        for(i=0;i<voices;i++)
+        {
+            if(!(di->IGetVoiceStatus(d,i) & 0x80))
+                continue;
+            r->Silent = 0;
+            if(!di->IGetVoiceInfo(d,i,&vi) && vi.VolumeMod > r->Peak)
+                r->Peak = vi.VolumeMod > 255 ? 255 : vi.VolumeMod;
+        }
+
+        status = di->ISongStatus(d,0);
+        if(status & SONG_STATUS_PLAYING)
+            started = 1;
+        else if(!started && tick > j->Timeout)
+            return;
+
+        // song has ended
+        if(started && !(status & (SONG_STATUS_PLAYING|SONG_STATUS_STOPPING)))
+        {
+            r->Type = ANALYZE_ONESHOT;
+            r->Length = tick;
+            return;
+        }
+
+        // The loop count increases when the song has been played through.
+        // It is the lowest count of all tracks started by the song, so it
+        // can jump when a track that does not loop stops. The loop is
+        // measured from there to the next increase, the intro is the rest.
+        loops = di->IGetLoopCnt(d,0);
+        if(loops >= 1 && !loop1)
+        {
+            loop1 = tick;
+            loop1cnt = loops;
+        }
+        else if(loop1 && loops > loop1cnt)
+        {
+            r->Type = ANALYZE_LOOP;
+            r->Loop = tick-loop1;
+            r->Length = loop1 > r->Loop ? loop1-r->Loop : 0;
+            return;
+        }
+    }
+
+    r->Type = started ? ANALYZE_TIMEOUT : ANALYZE_INVALID;
+}
+
+static void QP_AnalyzeWorker(void* data)
+{
+    QP_AnalyzeJob* j = data;
+    struct QP_DriverInterface di;
+    QP_Game* g = malloc(sizeof(QP_Game));
+    int id;
+
+    if(!g)
+    {
+        SDL_AtomicSet(&j->Error,1);
+        return;
+    }
+
+    while((id = SDL_AtomicAdd(&j->NextSong,1)) < j->SongCnt)
+    {
+        if(j->Cancel && SDL_AtomicGet(j->Cancel))
+        {
+            SDL_AtomicSet(&j->Error,1);
+            break;
+        }
+        if(QP_AnalyzeCreate(j,g,&di))
+        {
+            SDL_AtomicSet(&j->Error,1);
+            break;
+        }
+        QP_AnalyzeSong(j,&di,id,&j->Result[id]);
+        QP_AnalyzeDestroy(&di);
+    }
+
+    free(g);
+}
+
+static void QP_AnalyzePrintString(FILE* f,const char* s)
+{
+    fputc('"',f);
+    for(;*s;s++)
+    {
+        if(*s == '"' || *s == '\\')
+            fprintf(f,"\\%c",*s);
+        else if((unsigned char)*s < 0x20)
+            fprintf(f,"\\u%04x",*s);
+        else
+            fputc(*s,f);
+    }
+    fputc('"',f);
+}
+
+static void QP_AnalyzePrint(FILE* f,QP_Context *ctx,QP_AnalyzeInfo* info,double rate)
+{
+    static const char* type[] = {"invalid","oneshot","loop","timeout"};
+    double scale = rate/info->TickRate;
+    QP_AnalyzeResult* r;
+    int id;
+
+    fprintf(f,"{\n  \"game\": ");
+    QP_AnalyzePrintString(f,ctx->Game->Name);
+    fprintf(f,",\n  \"driver\": ");
+    QP_AnalyzePrintString(f,ctx->DriverInterface->Name);
+    fprintf(f,",\n  \"tick_rate\": %.3f,\n  \"sample_rate\": %.0f,\n  \"songs\": [",info->TickRate,rate);
+
+    for(id=0;id<info->SongCnt;id++)
+    {
+        r = &info->Result[id];
+        fprintf(f,"%s\n    {\"id\": %d, \"valid\": %s, \"type\": \"%s\", \"oneshot\": %s, \"silent\": %s, \"peak\": %d",
+                id ? "," : "", id,
+                r->Type != ANALYZE_INVALID ? "true" : "false",
+                type[r->Type],
+                r->Type == ANALYZE_ONESHOT ? "true" : "false",
+                r->Silent ? "true" : "false",
+                r->Peak);
+
+        if(r->Type == ANALYZE_ONESHOT)
+        {
+            fprintf(f,", \"length_ticks\": %u, \"length_samples\": %.0f",
+                    r->Length, r->Length*scale);
+        }
+        else if(r->Type == ANALYZE_LOOP)
+        {
+            fprintf(f,", \"intro_ticks\": %u, \"loop_ticks\": %u, \"intro_samples\": %.0f, \"loop_samples\": %.0f",
+                    r->Length, r->Loop, r->Length*scale, r->Loop*scale);
+        }
+        fprintf(f,"}");
+    }
+    fprintf(f,"\n  ]\n}\n");
+}
+
+int QP_AnalyzeSongs(QP_Game *G,int DriverType,double MaxTime,QP_AnalyzeInfo* info,SDL_atomic_t* cancel)
+{
+    QP_AnalyzeJob j;
+    QP_Worker worker[ANALYZE_MAX_WORKERS];
+    struct QP_DriverInterface di;
+    QP_Game* g;
+    int i, workers;
+
+    memset(info,0,sizeof(*info));
+    memset(&j,0,sizeof(j));
+    j.Game = G;
+    j.DriverType = DriverType;
+    j.Cancel = cancel;
+    g = malloc(sizeof(QP_Game));
+    if(!g)
+        goto fail;
+
+    // the song count and rates are taken from a first instance
+    if(QP_AnalyzeCreate(&j,g,&di))
+        goto fail;
+    j.SongCnt = di.ISongCnt(di.Driver,0);
+    info->TickRate = di.ITickRate(di.Driver);
+    info->ChipRate = di.IChipRate(di.Driver);
+    QP_AnalyzeDestroy(&di);
+
+    j.Timeout = ANALYZE_START_TIMEOUT * info->TickRate;
+    j.MaxTicks = MaxTime * info->TickRate;
+    j.Result = calloc(j.SongCnt ? j.SongCnt : 1,sizeof(*j.Result));
+    if(!j.Result)
+        goto fail;
+
+    workers = SDL_GetCPUCount();
+    if(workers > ANALYZE_MAX_WORKERS)
+        workers = ANALYZE_MAX_WORKERS;
+    if(workers > j.SongCnt)
+        workers = j.SongCnt;
+
+    for(i=0;i<workers;i++)
+    {
+        if(QP_WorkerInit(&worker[i],"QP_AnalyzeWorker"))
+            break;
+        QP_WorkerRun(&worker[i],QP_AnalyzeWorker,&j);
+    }
+    workers = i;
+    // if no threads could be started, do the work here
+    if(!workers)
+        QP_AnalyzeWorker(&j);
+    for(i=0;i<workers;i++)
+    {
+        QP_WorkerWait(&worker[i]);
+        QP_WorkerFree(&worker[i]);
+    }
+
+    if(SDL_AtomicGet(&j.Error))
+        goto fail;
+
+    info->SongCnt = j.SongCnt;
+    info->Result = j.Result;
+    free(g);
+    return 0;
+
+fail:
+    free(j.Result);
+    free(g);
+    return -1;
+}
+
+void QP_AnalyzeFree(QP_AnalyzeInfo* info)
+{
+    free(info->Result);
+    memset(info,0,sizeof(*info));
+}
+
+int QP_Analyze(QP_Context *ctx)
+{
+    QP_Game *G = ctx->Game;
+    QP_AnalyzeInfo info;
+    FILE* f = stdout;
+    double rate;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    if(QP_AnalyzeSongs(G,ctx->DriverInterface->Type,G->RenderTime > 0 ? G->RenderTime : ANALYZE_MAX_TIME,&info,NULL))
+    {
+        fprintf(stderr,"Failed to initialize driver\n");
+        return -1;
+    }
+    rate = G->RenderRate ? G->RenderRate : info.ChipRate;
+
+    if(strlen(G->OutputFile))
+    {
+        f = fopen(G->OutputFile,"w");
+        if(!f)
+        {
+            fprintf(stderr,"Could not open '%s' for writing\n",G->OutputFile);
+            QP_AnalyzeFree(&info);
+            return -1;
+        }
+    }
+    QP_AnalyzePrint(f,ctx,&info,rate);
+    if(f != stdout)
+        fclose(f);
+
+    fprintf(stderr,"Analyzed %d songs in %.2f seconds\n",info.SongCnt,
+            (double)(SDL_GetPerformanceCounter()-start)/SDL_GetPerformanceFrequency());
+
+    QP_AnalyzeFree(&info);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef ANALYZE_H_INCLUDED
+#define ANALYZE_H_INCLUDED
+
+#include <stdint.h>
+#include "SDL2/SDL_atomic.h"
+
+#include "context.h"
+
+// default time limit for each song, in seconds
+#define ANALYZE_MAX_TIME 900
+
+enum {
+    ANALYZE_INVALID = 0, // song did not start
+    ANALYZE_ONESHOT,     // song stopped by itself
+    ANALYZE_LOOP,        // song looped twice
+    ANALYZE_TIMEOUT      // song neither stopped nor looped in time
+};
+
+typedef struct {
+    int Type;
+    int Silent;      // no voice was ever keyed on
+    int Peak;        // highest voice volume reported by the driver (0-255)
+    uint32_t Length; // ticks until the song stopped, or intro length
+    uint32_t Loop;   // loop length in ticks
+} QP_AnalyzeResult;
+
+typedef struct {
+    int SongCnt;
+    double TickRate;
+    double ChipRate;
+    QP_AnalyzeResult* Result; // SongCnt entries
+} QP_AnalyzeInfo;
+
+// Run every song through its own instance of the sound driver, without
+// rendering audio. G must contain the game data (see LoadGameData) and is
+// not modified. MaxTime is the time limit for each song in seconds.
+// If cancel is set to nonzero while running, the remaining songs are skipped
+// and the call fails. Returns nonzero on failure.
+int  QP_AnalyzeSongs(QP_Game *G,int DriverType,double MaxTime,QP_AnalyzeInfo* info,SDL_atomic_t* cancel);
+void QP_AnalyzeFree(QP_AnalyzeInfo* info);
+
+// Analyze every song in the loaded game and write the song lengths as JSON
+// to OutputFile, or stdout if it is not set. Messages go to stderr.
+// The game must be loaded, but not initialized.
+int QP_Analyze(QP_Context *ctx);
+
+#endif // ANALYZE_H_INCLUDED
@@ -3,110 +3,205 @@
 */
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "SDL2/SDL.h"
 
-#include "qp.h"
 #include "audio.h"
-#include "lib/vgm.h"
+#include "driver.h"
 
-void QP_AudioCallback(void* data,Uint8* astream,int len)
+static int QP_AudioRingInit(QP_AudioRing* r,int frames,int channels)
 {
-    QP_AudioCallbackData* S = (QP_AudioCallbackData*)data;
+    r->size = 1;
+    while(r->size < frames)
+        r->size <<= 1;
+    r->channels = channels;
+    r->data = (float*)calloc(r->size*channels,sizeof(float));
+    SDL_AtomicSet(&r->read,0);
+    SDL_AtomicSet(&r->write,0);
+    SDL_AtomicSet(&r->Underruns,0);
+    SDL_AtomicSet(&r->Overruns,0);
+    return r->data ? 0 : -1;
+}
+
+static void QP_AudioRingFree(QP_AudioRing* r)
+{
+    free(r->data);
+    r->data = NULL;
+}
+
+// frames available for reading
+static uint32_t QP_AudioRingFill(QP_AudioRing* r)
+{
+    return (uint32_t)SDL_AtomicGet(&r->write) - (uint32_t)SDL_AtomicGet(&r->read);
+}
+
+// copy frames between the ring and a linear buffer, wrapping as needed
+static void QP_AudioRingCopy(QP_AudioRing* r,uint32_t pos,float* buf,int frames,int to_ring)
+{
+    uint32_t offset = pos & (r->size-1);
+    uint32_t len = r->size - offset;
+    if(len > frames)
+        len = frames;
+
+    float* ring = r->data+offset*r->channels;
+    if(to_ring)
+    {
+        memcpy(ring,buf,len*r->channels*sizeof(float));
+        memcpy(r->data,buf+len*r->channels,(frames-len)*r->channels*sizeof(float));
+    }
+    else
+    {
+        memcpy(buf,ring,len*r->channels*sizeof(float));
+        memcpy(buf+len*r->channels,r->data,(frames-len)*r->channels*sizeof(float));
+    }
+}
+
+// Producer side. Returns the number of frames written
+static int QP_AudioRingWrite(QP_AudioRing* r,float* buf,int frames)
+{
+    uint32_t pos = SDL_AtomicGet(&r->write);
+    uint32_t space = r->size - (pos - (uint32_t)SDL_AtomicGet(&r->read));
+
+    if(frames > space)
+    {
+        SDL_AtomicAdd(&r->Overruns,frames-space);
+        frames = space;
+    }
+    QP_AudioRingCopy(r,pos,buf,frames,1);
+    SDL_AtomicSet(&r->write,pos+frames);
+    return frames;
+}
+
+// Consumer side. Returns the number of frames read
+static int QP_AudioRingRead(QP_AudioRing* r,float* buf,int frames)
+{
+    uint32_t pos = SDL_AtomicGet(&r->read);
+    uint32_t fill = (uint32_t)SDL_AtomicGet(&r->write) - pos;
+
+    if(frames > fill)
+    {
+        SDL_AtomicAdd(&r->Underruns,frames-fill);
+        frames = fill;
+    }
+    QP_AudioRingCopy(r,pos,buf,frames,0);
+    SDL_AtomicSet(&r->read,pos+frames);
+    return frames;
+}
+
+// The audio callback only copies from the ring buffer
+static void QP_AudioCallback(void* data,Uint8* astream,int len)
+{
+    QP_Audio* audio = (QP_Audio*)data;
     float* stream = (float*)astream;
 
-    int i,j;
-    float ChipOut[4] = {0,0,0,0};
+    int channels = audio->state.OutChannels;
+    int frames = len/(channels*sizeof(float));
+    int got = QP_AudioRingRead(&audio->ring,stream,frames);
 
-    int updatemode = S->UpdateRequest;
+    if(got < frames)
+        memset(stream+got*channels,0,(frames-got)*channels*sizeof(float));
 
-    double ChipDelta = (double)DriverGetChipRate()/S->SampleRate;
-    double DriverDelta = (double)DriverGetTickRate()/S->SampleRate;
+    SDL_SemPost(audio->wake);
+}
 
-    if(S->FastForward)
-        DriverDelta *= 32;
+// Keeps the ring buffer filled up to the render-ahead depth
+static int QP_AudioThread(void* data)
+{
+    QP_Audio* audio = (QP_Audio*)data;
 
-    for(i=0;i<S->SampleCount;i++)
+    while(SDL_AtomicGet(&audio->Running))
     {
-        if(updatemode & QPAUDIO_DRV_PLAY)
-        {
-            S->DriverUpdate += DriverDelta;
-            while(S->DriverUpdate > 1)
-            {
-                DriverUpdateTick();
-                //Q_UpdateTick(S->QDrv);
-
-                if(Game->VgmLog)
-                {
-                    vgm_delay(441000/DriverGetTickRate());
-                }
-                S->DriverUpdate-=1;
-
-                GameDoUpdate(Game);
-            }
-        }
-        if(updatemode & QPAUDIO_CHIP_PLAY)
-        {
-            S->ChipUpdate += ChipDelta;
-            while(S->ChipUpdate > 1)
-            {
-                DriverUpdateChip();
-                S->ChipUpdate-=1;
-            }
-
-            DriverSampleChip(ChipOut,S->MuteRear ? 2 : 4);
-        }
-        if(~updatemode & QPAUDIO_MUTE)
-        {
-            if(S->OutChannels==1)
-                *stream = S->Gain*(ChipOut[0]+ChipOut[1]+ChipOut[2]+ChipOut[3]);
-            else if(S->OutChannels==2)
-            {
-                stream[0] = S->Gain*(ChipOut[0]+ChipOut[2]);
-                stream[1] = S->Gain*(ChipOut[1]+ChipOut[3]);
-            }
-            else if(S->OutChannels==4)
-            {
-                stream[0] = S->Gain*ChipOut[0];
-                stream[1] = S->Gain*ChipOut[1];
-                stream[2] = S->Gain*ChipOut[2];
-                stream[3] = S->Gain*ChipOut[3];
-            }
-            else
-            {
-                // unlikely...
-                for(j=0;j<S->OutChannels;j++)
-                    stream[j] = ChipOut[0]+ChipOut[1]+ChipOut[2]+ChipOut[3];
-            }
-        }
-        else
+        if(QP_AudioRingFill(&audio->ring)+QPAUDIO_BLOCK_SIZE > audio->RenderAhead)
         {
-            for(j=0;j<S->OutChannels;j++)
-                stream[j] = 0;
+            SDL_SemWaitTimeout(audio->wake,10);
+            continue;
         }
 
-        stream += S->OutChannels;
+        SDL_LockMutex(audio->lock);
+        QP_AudioRender(&audio->state,audio->RenderBuffer,QPAUDIO_BLOCK_SIZE);
+        SDL_UnlockMutex(audio->lock);
+
+        QP_AudioRingWrite(&audio->ring,audio->RenderBuffer,QPAUDIO_BLOCK_SIZE);
+    }
+    return 0;
+}
+
+static void QP_AudioResetState(QP_Audio* audio)
+{
+    audio->Enabled = 0;
+    QP_AudioStateReset(&audio->state);
+
+    audio->thread=NULL;
+    audio->lock=NULL;
+    audio->wake=NULL;
+    audio->RenderBuffer=NULL;
+    audio->ring.data=NULL;
+}
+
+static void QP_AudioStopThread(QP_Audio* audio)
+{
+    if(audio->thread)
+    {
+        SDL_AtomicSet(&audio->Running,0);
+        SDL_SemPost(audio->wake);
+        SDL_WaitThread(audio->thread,NULL);
+        audio->thread = NULL;
+    }
+    if(audio->lock)
+        SDL_DestroyMutex(audio->lock);
+    if(audio->wake)
+        SDL_DestroySemaphore(audio->wake);
+    free(audio->RenderBuffer);
+    QP_AudioRingFree(&audio->ring);
+    audio->lock = NULL;
+    audio->wake = NULL;
+    audio->RenderBuffer = NULL;
+}
+
+static int QP_AudioStartThread(QP_Audio* audio,int RenderAhead)
+{
+    // must hold at least one device buffer plus one rendered block
+    int minimum = audio->state.SampleCount+QPAUDIO_BLOCK_SIZE;
+    if(!RenderAhead)
+        RenderAhead = audio->state.SampleCount*2;
+    if(RenderAhead < minimum)
+        RenderAhead = minimum;
+    audio->RenderAhead = RenderAhead;
+
+    audio->lock = SDL_CreateMutex();
+    audio->wake = SDL_CreateSemaphore(0);
+    audio->RenderBuffer = (float*)malloc(QPAUDIO_BLOCK_SIZE*audio->state.OutChannels*sizeof(float));
+    if(!audio->lock || !audio->wake || !audio->RenderBuffer ||
+       QP_AudioRingInit(&audio->ring,RenderAhead+QPAUDIO_BLOCK_SIZE,audio->state.OutChannels))
+    {
+        QP_AudioStopThread(audio);
+        return -1;
     }
 
-    if(S->FileLogging)
+    SDL_AtomicSet(&audio->Running,1);
+    audio->thread = SDL_CreateThread(QP_AudioThread,"QP_AudioThread",audio);
+    if(!audio->thread)
     {
-        fwrite(astream,S->OutChannels*4,S->SampleCount,S->logfile);
-        S->LogSamples += S->SampleCount;
+        QP_AudioStopThread(audio);
+        return -1;
     }
+    return 0;
+}
 
+// Report the resampling set up by QP_AudioStateInit
+static void QP_AudioPrintResampler(QP_AudioCallbackData* S,int ChipRate)
+{
+    if(S->Resample)
+        printf("resampling %d Hz to %d Hz\n",ChipRate,(int)S->SampleRate);
+    else if(ChipRate != S->SampleRate)
+        printf("Could not initialize resampler, using sample and hold\n");
 }
 
-int QP_AudioInit(QP_Audio* audio,int SampleRate,int SampleCount,int ChannelCount,char *AudioDevice)
+int QP_AudioInit(QP_Audio* audio,int SampleRate,int SampleCount,int ChannelCount,int RenderAhead,int Quality,char *AudioDevice)
 {
-    audio->Enabled = 0;
-    //audio->state.SampleRate = SampleRate;
-    audio->state.ChipUpdate = 0;
-    audio->state.DriverUpdate=0;
-    audio->state.MuteRear=0;
-    audio->state.Gain=2.0;
-    audio->state.FastForward=0;
-    audio->state.FileLogging=0;
-    audio->state.LogSamples=0;
+    QP_AudioResetState(audio);
 
     SDL_AudioSpec req;
     SDL_zero(req);
@@ -115,15 +210,23 @@ int QP_AudioInit(QP_Audio* audio,int SampleRate,int SampleCount,int ChannelCount
     req.freq = SampleRate;
     req.format = AUDIO_F32;
     req.samples = SampleCount; // risky.
-    req.userdata = &audio->state;
+    req.userdata = audio;
     audio->dev = SDL_OpenAudioDevice(AudioDevice,0,&req,&audio->as,SDL_AUDIO_ALLOW_CHANNELS_CHANGE|SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
 
     if(audio->dev)
     {
         printf("got channels=%d, rate=%d\n", audio->as.channels, audio->as.freq );
-        audio->state.OutChannels = audio->as.channels;
-        audio->state.SampleRate = audio->as.freq;
-        audio->state.SampleCount = audio->as.samples;
+        QP_AudioStateInit(&audio->state,SampleRate,audio->as.freq,audio->as.samples,audio->as.channels,Quality);
+        QP_AudioPrintResampler(&audio->state,SampleRate);
+
+        if(QP_AudioStartThread(audio,RenderAhead))
+        {
+            printf("Could not start render thread\n");
+            SDL_CloseAudioDevice(audio->dev);
+            audio->Initialized=0;
+            QP_AudioClose(audio);
+            return -1;
+        }
         audio->Initialized=1;
         return 0;
     }
@@ -135,12 +238,91 @@ int QP_AudioInit(QP_Audio* audio,int SampleRate,int SampleCount,int ChannelCount
     }
 }
 
-void QP_AudioClose(QP_Audio* audio)
+// Set up the callback state without opening an audio device. Used for
+// offline rendering, QP_AudioRender is then called directly.
+// SampleRate can be 0 to render at the chip rate.
+int QP_AudioInitHeadless(QP_Audio* audio,int ChipRate,int SampleRate,int SampleCount,int ChannelCount,int Quality)
 {
-    if(!audio->Initialized)
-        return;
+    QP_AudioResetState(audio);
+
+    audio->dev = 0;
     audio->Initialized=0;
-    SDL_CloseAudioDevice(audio->dev);
+
+    if(QP_AudioStateInit(&audio->state,ChipRate,SampleRate,SampleCount,ChannelCount,Quality))
+        return -1;
+    QP_AudioPrintResampler(&audio->state,ChipRate);
+    return 0;
+}
+
+// Open the audio output for an initialized game. If the game is rendered to
+// a file (Headless), only the render state is set up.
+int QP_AudioOpen(QP_Audio* audio,QP_Context* ctx)
+{
+    QP_Game *Game = ctx->Game;
+    char filename[FILENAME_MAX];
+    char* audiodev = NULL;
+
+    if(strlen(Game->AudioDevice))
+        audiodev = Game->AudioDevice;
+
+    if(Game->Headless)
+    {
+        // render to file only, mix down to stereo
+        Game->Gain/=2;
+        QP_AudioInitHeadless(audio,DriverGetChipRate(ctx),Game->RenderRate,Game->AudioBuffer,2,Game->ResampleQuality);
+    }
+    else if(QP_AudioInit(audio,DriverGetChipRate(ctx),Game->AudioBuffer,4,Game->RenderAhead,Game->ResampleQuality,audiodev))
+    {
+        // we couldn't initialize audio with 4 channels, let's try 2 instead...
+        Game->Gain/=2; // you'll thank me for this
+        if(QP_AudioInit(audio,DriverGetChipRate(ctx),Game->AudioBuffer,2,Game->RenderAhead,Game->ResampleQuality,audiodev))
+        {
+            snprintf(ctx->Error,sizeof(ctx->Error),"Could not open audio device: %s",SDL_GetError());
+            return -1;
+        }
+    }
+
+    audio->state.AutoPlaySong = Game->AutoPlay;
+    audio->state.MuteRear = Game->MuteRear;
+    audio->state.Gain = Game->BaseGain*Game->Gain;
+
+    if(Game->WavLog)
+    {
+        strcpy(filename,"qp_log.wav");
+        if(strlen(Game->OutputFile))
+            strcpy(filename,Game->OutputFile);
+        else if(Game->AutoPlay >= 0)
+        {
+            sprintf(filename,"%s_%03x.wav",Game->Name,Game->AutoPlay&0x7ff);
+        }
+        if(QP_AudioWavOpen(audio,filename) && Game->Headless)
+        {
+            snprintf(ctx->Error,sizeof(ctx->Error),"Could not open '%s' for writing",filename);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void QP_AudioClose(QP_Audio* audio)
+{
+    if(audio->Initialized)
+    {
+        audio->Initialized=0;
+        SDL_CloseAudioDevice(audio->dev);
+        QP_AudioStopThread(audio);
+
+        if(SDL_AtomicGet(&audio->ring.Underruns) || SDL_AtomicGet(&audio->ring.Overruns))
+        {
+            printf("Audio underruns: %d frames, overruns: %d frames\n",
+                   SDL_AtomicGet(&audio->ring.Underruns),
+                   SDL_AtomicGet(&audio->ring.Overruns));
+        }
+    }
+    if(audio->state.FileLogging)
+        QP_AudioWavClose(audio);
+    QP_AudioStateFree(&audio->state);
 }
 
 void QP_AudioSetPause(QP_Audio* audio,int pause)
@@ -159,6 +341,19 @@ void QP_AudioTogglePause(QP_Audio* audio)
     SDL_PauseAudioDevice(audio->dev,audio->Enabled);
 }
 
+// Locks out the render thread, used when changing the sound driver state
+void QP_AudioLock(QP_Audio* audio)
+{
+    if(audio->Initialized)
+        SDL_LockMutex(audio->lock);
+}
+
+void QP_AudioUnlock(QP_Audio* audio)
+{
+    if(audio->Initialized)
+        SDL_UnlockMutex(audio->lock);
+}
+
 int QP_AudioWavOpen(QP_Audio* audio, char* filename)
 {
     audio->state.logfile = NULL;
@@ -4,41 +4,29 @@
 #include <stdio.h>
 
 #include "SDL2/SDL_audio.h"
+#include "SDL2/SDL_atomic.h"
+#include "SDL2/SDL_mutex.h"
+#include "SDL2/SDL_thread.h"
 
-enum {
-    QPAUDIO_DRV_PLAY = 1,
-    QPAUDIO_CHIP_PLAY = 2,
-    QPAUDIO_MUTE = 4,
-};
-typedef struct {
-
-    //Q_State *QDrv;
-
-    // temporary home for this variable until i find a better place.
-    int AutoPlaySong;
-
-    int UpdateRequest;
-
-    uint32_t SampleRate;
+#include "mixer.h"
 
-    int FastForward;
-
-    double ChipUpdate;
-    double DriverUpdate;
+// Single producer/single consumer ring buffer. The render thread writes and
+// the audio callback reads, positions are free running frame counters.
+typedef struct {
 
-    float Gain;
+    float* data;
+    uint32_t size; // frames, power of two
+    int channels;
 
-    int MuteRear; // set to mute rear channels (for systems that don't have them)
-    int OutChannels; // words per sample
-    int SampleCount;
+    SDL_atomic_t read;
+    SDL_atomic_t write;
 
-    int FileLogging;
-    FILE* logfile;
-    uint32_t LogSamples;
+    SDL_atomic_t Underruns; // frames missing when the callback read
+    SDL_atomic_t Overruns; // frames dropped because the ring was full
 
-} QP_AudioCallbackData;
+} QP_AudioRing;
 
-typedef struct {
+typedef struct QP_Audio {
 
     SDL_AudioSpec as;
     SDL_AudioDeviceID dev;
@@ -47,12 +35,25 @@ typedef struct {
     int Initialized;
     int Enabled;
 
+    // render thread
+    QP_AudioRing ring;
+    int RenderAhead; // frames to keep buffered
+    float* RenderBuffer;
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_sem* wake;
+    SDL_atomic_t Running;
+
 } QP_Audio;
 
-int  QP_AudioInit(QP_Audio* audio,int SampleRate,int SampleCount,int ChannelCount,char *AudioDevice);
+int  QP_AudioInit(QP_Audio* audio,int SampleRate,int SampleCount,int ChannelCount,int RenderAhead,int Quality,char *AudioDevice);
+int  QP_AudioInitHeadless(QP_Audio* audio,int ChipRate,int SampleRate,int SampleCount,int ChannelCount,int Quality);
+int  QP_AudioOpen(QP_Audio* audio,struct QP_Context* ctx);
 void QP_AudioClose(QP_Audio* audio);
 void QP_AudioSetPause(QP_Audio* audio,int pause);
 void QP_AudioTogglePause(QP_Audio* audio);
+void QP_AudioLock(QP_Audio* audio);
+void QP_AudioUnlock(QP_Audio* audio);
 
 int  QP_AudioWavOpen(QP_Audio* audio, char* filename);
 void QP_AudioWavClose(QP_Audio* audio);
@@ -0,0 +1,418 @@
+/*
+    Batch rendering
+
+    Renders the jobs listed in a manifest file. Each game is loaded once,
+    every job copies the game and shares its ROM data, with its own driver
+    instance. Workers take the next job from a shared counter, so a long
+    song does not hold up the rest of the list.
+
+    One job per line, ';' or '#' starts a comment:
+
+        <game> <song> [<length> [<format> [<output>]]]
+
+    song:   song ID, "p<n>" for playlist entry n, or "playlist" for every
+            playlist entry
+    length: loop count, "<n>s" for seconds, or "-" for the default
+    format: "wav", "vgm" or "wav+vgm" (default wav)
+    output: filename without extension (default <game>_<song ID>, or
+            <game>_<entry>_<song ID> for playlist entries)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL2/SDL.h"
+
+#include "qp.h"
+#include "batch.h"
+#include "render.h"
+#include "lib/worker.h"
+
+#define BATCH_MAX_WORKERS 32
+#define BATCH_MAX_GAMES 256
+
+typedef struct {
+    char Name[256];
+    QP_Game* Game; // loaded game data, NULL if loading failed
+    int DriverType;
+} QP_BatchGame;
+
+typedef struct {
+    int Game;     // index in the game list
+    int SongID;
+    int Position; // playlist entry, -1 if the song ID was given
+    int Loops;
+    double Time;
+    int Wav;
+    int Vgm;
+    char Output[256-4]; // filename without extension, room for ".wav"
+} QP_BatchJob;
+
+// Shared by all workers. Each worker takes the next job from NextJob.
+typedef struct {
+    int GameCnt;
+    QP_BatchGame Game[BATCH_MAX_GAMES];
+    int JobCnt;
+    int JobAlloc;
+    QP_BatchJob* Job;
+    SDL_atomic_t NextJob;
+    SDL_mutex* Lock; // held when printing progress
+    int Done;
+    int Failed;
+} QP_BatchQueue;
+
+// Find or load a game, returns -1 if it could not be loaded.
+static int QP_BatchGetGame(QP_BatchQueue* q,QP_Game* Config,const char* name)
+{
+    char msgstring[1024];
+    QP_BatchGame* g;
+    int i;
+
+    for(i=0;i<q->GameCnt;i++)
+    {
+        if(!strcmp(q->Game[i].Name,name))
+            return q->Game[i].Game ? i : -1;
+    }
+    if(q->GameCnt == BATCH_MAX_GAMES)
+    {
+        printf("Too many games in manifest\n");
+        return -1;
+    }
+
+    g = &q->Game[q->GameCnt++];
+    snprintf(g->Name,sizeof(g->Name),"%s",name);
+    g->Game = malloc(sizeof(QP_Game));
+    if(!g->Game)
+        return -1;
+    memcpy(g->Game,Config,sizeof(QP_Game));
+    strcpy(g->Game->Name,g->Name);
+    g->Game->Data = NULL;
+    g->Game->WaveData = NULL;
+
+    snprintf(msgstring,sizeof(msgstring),"Failed to load '%s':",name);
+    if(LoadGameData(g->Game,&g->DriverType,msgstring))
+    {
+        printf("%s\n",msgstring);
+        FreeGameData(g->Game);
+        free(g->Game);
+        g->Game = NULL;
+        return -1;
+    }
+    return q->GameCnt-1;
+}
+
+static QP_BatchJob* QP_BatchAddJob(QP_BatchQueue* q)
+{
+    QP_BatchJob* job;
+    if(q->JobCnt == q->JobAlloc)
+    {
+        job = realloc(q->Job,(q->JobAlloc ? q->JobAlloc*2 : 64)*sizeof(QP_BatchJob));
+        if(!job)
+            return NULL;
+        q->Job = job;
+        q->JobAlloc = q->JobAlloc ? q->JobAlloc*2 : 64;
+    }
+    job = &q->Job[q->JobCnt++];
+    memset(job,0,sizeof(*job));
+    return job;
+}
+
+// Add a job for a song ID or playlist entry. The length and format are
+// already set in tmpl.
+static int QP_BatchAddSong(QP_BatchQueue* q,QP_Game* Config,QP_BatchJob* tmpl,int deflength,int id,int pos,const char* output,int lineno)
+{
+    char filename[sizeof(tmpl->Output)];
+    QP_Game* G = q->Game[tmpl->Game].Game;
+    QP_PlaylistScript* S;
+    QP_BatchJob* job;
+    int len;
+
+    if(output)
+        len = snprintf(filename,sizeof(filename),"%s",output);
+    else if(pos >= 0)
+        len = snprintf(filename,sizeof(filename),"%s%s%s_%02d_%03x",Config->OutputFile,
+                       strlen(Config->OutputFile) ? "/" : "",G->Name,pos,id&0x7ff);
+    else
+        len = snprintf(filename,sizeof(filename),"%s%s%s_%03x",Config->OutputFile,
+                       strlen(Config->OutputFile) ? "/" : "",G->Name,id&0x7ff);
+    if(len < 0 || len >= (int)sizeof(filename))
+    {
+        printf("line %d: output filename too long\n",lineno);
+        return -1;
+    }
+
+    job = QP_BatchAddJob(q);
+    if(!job)
+        return -1;
+
+    *job = *tmpl;
+    job->SongID = id;
+    job->Position = pos;
+
+    // playlist entries default to the wait set by their first script entry
+    if(deflength && pos >= 0)
+    {
+        S = &G->Playlist[pos].script[0];
+        if(S->wait_type == 0 && S->wait_count > 0)
+            job->Loops = S->wait_count;
+        else if(S->wait_type == 1 && S->wait_count > 0)
+        {
+            job->Loops = 0;
+            job->Time = S->wait_count;
+        }
+    }
+
+    strcpy(job->Output,filename);
+    return 0;
+}
+
+// Parse a manifest line. Returns nonzero if it is invalid.
+static int QP_BatchParseLine(QP_BatchQueue* q,QP_Game* Config,char* line,int lineno)
+{
+    char game[256], song[64], length[64], format[64], output[256];
+    QP_BatchJob tmpl;
+    QP_Game* G;
+    char* end;
+    double val;
+    int n, i, deflength = 1;
+
+    line[strcspn(line,";#\r\n")] = 0;
+    n = sscanf(line,"%255s %63s %63s %63s %255s",game,song,length,format,output);
+    if(n <= 0)
+        return 0;
+    if(n < 2)
+    {
+        printf("line %d: song missing\n",lineno);
+        return -1;
+    }
+
+    memset(&tmpl,0,sizeof(tmpl));
+    tmpl.Loops = Config->RenderLoops;
+    tmpl.Time = Config->RenderTime;
+    if(n >= 3 && strcmp(length,"-"))
+    {
+        deflength = 0;
+        val = strtod(length,&end);
+        if(end == length || val < 0 || (*end && strcmp(end,"s")))
+        {
+            printf("line %d: invalid length '%s'\n",lineno,length);
+            return -1;
+        }
+        if(*end)
+        {
+            tmpl.Loops = 0;
+            tmpl.Time = val;
+        }
+        else
+            tmpl.Loops = val;
+    }
+
+    if(n < 4 || !strcmp(format,"wav"))
+        tmpl.Wav = 1;
+    else if(!strcmp(format,"vgm"))
+        tmpl.Vgm = 1;
+    else if(!strcmp(format,"wav+vgm"))
+        tmpl.Wav = tmpl.Vgm = 1;
+    else
+    {
+        printf("line %d: invalid format '%s'\n",lineno,format);
+        return -1;
+    }
+
+    tmpl.Game = QP_BatchGetGame(q,Config,game);
+    if(tmpl.Game < 0)
+    {
+        printf("line %d: skipped\n",lineno);
+        return -1;
+    }
+    G = q->Game[tmpl.Game].Game;
+
+    if(!strcmp(song,"playlist"))
+    {
+        for(i=0;i<G->SongCount;i++)
+        {
+            if(QP_BatchAddSong(q,Config,&tmpl,deflength,G->Playlist[i].SongID,i,NULL,lineno))
+                return -1;
+        }
+        return 0;
+    }
+    if(song[0] == 'p')
+    {
+        i = strtol(song+1,&end,0);
+        if(end == song+1 || *end || i < 0 || i >= G->SongCount)
+        {
+            printf("line %d: invalid playlist entry '%s'\n",lineno,song);
+            return -1;
+        }
+        return QP_BatchAddSong(q,Config,&tmpl,deflength,G->Playlist[i].SongID,i,n >= 5 ? output : NULL,lineno);
+    }
+    i = strtol(song,&end,0);
+    if(end == song || *end || i < 0 || i > 0xfff)
+    {
+        printf("line %d: invalid song ID '%s'\n",lineno,song);
+        return -1;
+    }
+    return QP_BatchAddSong(q,Config,&tmpl,deflength,i,-1,n >= 5 ? output : NULL,lineno);
+}
+
+// Render a job. g and audio are scratch space owned by the worker.
+static void QP_BatchRender(QP_BatchQueue* q,QP_BatchJob* j,QP_Game* g,QP_Audio* audio)
+{
+    QP_BatchGame* bg = &q->Game[j->Game];
+    struct QP_DriverInterface di;
+    QP_Context ctx;
+    QP_RenderResult r;
+    int val;
+
+    // Each job has its own copy of the game, as driver init writes to it.
+    memcpy(g,bg->Game,sizeof(QP_Game));
+    g->Headless = 1;
+    g->WavLog = j->Wav;
+    g->VgmLog = j->Vgm;
+    g->AutoPlay = j->SongID;
+    g->RenderLoops = j->Loops;
+    g->RenderTime = j->Time;
+    g->FMThread = 0;
+
+    memset(&ctx,0,sizeof(ctx));
+    memset(audio,0,sizeof(QP_Audio));
+    memset(&di,0,sizeof(di));
+    memset(&r,0,sizeof(r));
+    ctx.Game = g;
+    ctx.Audio = audio;
+    ctx.State = &audio->state;
+    ctx.DriverInterface = &di;
+
+    // Output is sized for this when parsing, check anyway
+    val = snprintf(g->OutputFile,sizeof(g->OutputFile),"%s.wav",j->Output) >= (int)sizeof(g->OutputFile)
+       || snprintf(g->VgmFile,sizeof(g->VgmFile),"%s.vgm",j->Output) >= (int)sizeof(g->VgmFile);
+    if(val)
+        strcpy(ctx.Error,"Output filename too long");
+    else if((val = DriverCreate(&di,bg->DriverType)))
+        strcpy(ctx.Error,"Failed to create driver");
+    else if(!(val = InitGame(&ctx)))
+    {
+        if(j->Position >= 0 && g->Playlist[j->Position].Bank >= 0)
+            GameDoAction(&ctx,g->Playlist[j->Position].Bank);
+
+        val = QP_AudioOpen(audio,&ctx);
+        if(!val && (val = QP_RenderSong(&ctx,&r)))
+            strcpy(ctx.Error,"Song did not start");
+        QP_AudioClose(audio);
+        DeInitGame(&ctx);
+    }
+    DriverDestroy(&di);
+
+    SDL_LockMutex(q->Lock);
+    q->Done++;
+    if(val)
+    {
+        q->Failed++;
+        printf("[%d/%d] %s: failed: %s\n",q->Done,q->JobCnt,j->Output,ctx.Error);
+    }
+    else
+    {
+        printf("[%d/%d] %s: %.2f seconds in %.2f seconds (%.1fx realtime)\n",q->Done,q->JobCnt,j->Output,
+               r.Length, r.Elapsed, r.Elapsed > 0 ? r.Length/r.Elapsed : 0);
+    }
+    fflush(stdout);
+    SDL_UnlockMutex(q->Lock);
+}
+
+static void QP_BatchWorker(void* data)
+{
+    QP_BatchQueue* q = data;
+    QP_Game* g = malloc(sizeof(QP_Game));
+    QP_Audio* audio = malloc(sizeof(QP_Audio));
+    int id;
+
+    while((id = SDL_AtomicAdd(&q->NextJob,1)) < q->JobCnt)
+    {
+        if(!g || !audio)
+        {
+            SDL_LockMutex(q->Lock);
+            q->Done++;
+            q->Failed++;
+            printf("[%d/%d] %s: failed: out of memory\n",q->Done,q->JobCnt,q->Job[id].Output);
+            SDL_UnlockMutex(q->Lock);
+            continue;
+        }
+        QP_BatchRender(q,&q->Job[id],g,audio);
+    }
+
+    free(audio);
+    free(g);
+}
+
+int QP_Batch(QP_Game* Config,const char* manifest)
+{
+    QP_BatchQueue* q;
+    QP_Worker worker[BATCH_MAX_WORKERS];
+    char line[1024];
+    FILE* f;
+    int i, workers, lineno = 0, invalid = 0, val;
+
+    f = fopen(manifest,"r");
+    if(!f)
+    {
+        printf("Could not open '%s'\n",manifest);
+        return -1;
+    }
+    q = calloc(1,sizeof(QP_BatchQueue));
+    if(!q || !(q->Lock = SDL_CreateMutex()))
+    {
+        free(q);
+        fclose(f);
+        return -1;
+    }
+
+    while(fgets(line,sizeof(line),f))
+    {
+        if(QP_BatchParseLine(q,Config,line,++lineno))
+            invalid++;
+    }
+    fclose(f);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    workers = SDL_GetCPUCount();
+    if(workers > BATCH_MAX_WORKERS)
+        workers = BATCH_MAX_WORKERS;
+    if(workers > q->JobCnt)
+        workers = q->JobCnt;
+
+    for(i=0;i<workers;i++)
+    {
+        if(QP_WorkerInit(&worker[i],"QP_BatchWorker"))
+            break;
+        QP_WorkerRun(&worker[i],QP_BatchWorker,q);
+    }
+    workers = i;
+    // if no threads could be started, do the work here
+    if(!workers)
+        QP_BatchWorker(q);
+    for(i=0;i<workers;i++)
+    {
+        QP_WorkerWait(&worker[i]);
+        QP_WorkerFree(&worker[i]);
+    }
+
+    double elapsed = (double)(SDL_GetPerformanceCounter()-start)/SDL_GetPerformanceFrequency();
+    printf("Rendered %d of %d jobs in %.2f seconds",q->JobCnt-q->Failed,q->JobCnt,elapsed);
+    if(invalid)
+        printf(", %d manifest lines skipped",invalid);
+    printf("\n");
+
+    val = (q->Failed || invalid) ? -1 : 0;
+    for(i=0;i<q->GameCnt;i++)
+    {
+        if(!q->Game[i].Game)
+            continue;
+        FreeGameData(q->Game[i].Game);
+        free(q->Game[i].Game);
+    }
+    free(q->Job);
+    SDL_DestroyMutex(q->Lock);
+    free(q);
+    return val;
+}
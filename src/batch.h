@@ -0,0 +1,11 @@
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+#include "loader.h"
+
+// Render every job in a manifest file on one thread per CPU. Config holds
+// the global configuration, OutputFile is used as the output directory.
+// Returns nonzero if any job failed.
+int QP_Batch(QP_Game* Config,const char* manifest);
+
+#endif // BATCH_H_INCLUDED
@@ -0,0 +1,180 @@
+/*
+    FM benchmark
+
+    The song is played by the System 2 driver with chip writes sent straight
+    to the YM2151, and after each tick the chip is rendered up to the time of
+    the next tick. Only the time spent in YM2151_render is counted. The driver
+    is run again for each pass, so every pass renders the same writes, and a
+    checksum of the output shows that they also render the same samples.
+
+    Idle channel skipping is turned off by marking every channel as active
+    and none as pending the idle check before each block.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "SDL2/SDL.h"
+
+#include "qp.h"
+#include "bench.h"
+#include "s2x/s2x.h"
+
+#define BENCH_BLOCK 1024
+
+typedef struct {
+    double Elapsed;  // seconds spent in YM2151_render
+    uint64_t Frames;
+    uint32_t Checksum;
+} QP_BenchResult;
+
+// Returns 1 if the core is not supported, or -1 on failure.
+static int QP_BenchPass(QP_Game *G,int core,int skip,double length,QP_BenchResult* r)
+{
+    struct QP_DriverInterface di;
+    S2X_State* S;
+    int32_t* buf;
+    QP_Game* g;
+    uint64_t tick, ticks;
+    double pos, step;
+    int frames, i, val;
+    Uint64 start;
+
+    memset(r,0,sizeof(*r));
+    r->Checksum = 2166136261u;
+
+    buf = malloc(BENCH_BLOCK*2*sizeof(int32_t));
+    g = malloc(sizeof(QP_Game));
+    if(!buf || !g)
+    {
+        free(buf);
+        free(g);
+        return -1;
+    }
+
+    memcpy(g,G,sizeof(*g));
+    g->SampleCache = 0;
+    g->FMThread = 0;
+    g->DriverOnly = 1;
+    g->YM2151Core = core;
+
+    val = DriverCreate(&di,DRIVER_SYSTEM2);
+    if(!val)
+        val = di.IInit(di.Driver,g);
+    if(val)
+    {
+        DriverDestroy(&di);
+        free(buf);
+        free(g);
+        return -1;
+    }
+    di.IReset(di.Driver,g,1);
+
+    S = di.Driver;
+    if(S->FMChip.core != core)
+    {
+        di.IDeinit(di.Driver);
+        DriverDestroy(&di);
+        free(buf);
+        free(g);
+        return 1;
+    }
+
+    di.ISongRequest(di.Driver,0,G->AutoPlay&0x7ff);
+
+    step = S->FMRate / di.ITickRate(di.Driver);
+    ticks = length * di.ITickRate(di.Driver);
+    pos = 0;
+
+    for(tick=0;tick<ticks;tick++)
+    {
+        di.IUpdateTick(di.Driver);
+
+        pos += step;
+        while(r->Frames < (uint64_t)pos)
+        {
+            frames = BENCH_BLOCK;
+            if(r->Frames + frames > (uint64_t)pos)
+                frames = (uint64_t)pos - r->Frames;
+
+            if(!skip)
+            {
+                S->FMChip.chan_active = 0xff;
+                S->FMChip.chan_check = 0;
+            }
+
+            start = SDL_GetPerformanceCounter();
+            YM2151_render(&S->FMChip,buf,frames);
+            r->Elapsed += SDL_GetPerformanceCounter()-start;
+            r->Frames += frames;
+
+            // FNV-1a
+            for(i=0;i<frames*2;i++)
+                r->Checksum = (r->Checksum ^ (uint32_t)buf[i]) * 16777619u;
+        }
+    }
+    r->Elapsed /= SDL_GetPerformanceFrequency();
+
+    di.IDeinit(di.Driver);
+    DriverDestroy(&di);
+    free(buf);
+    free(g);
+    return 0;
+}
+
+int QP_Bench(QP_Context *ctx)
+{
+    static const struct {int Core; const char* Name;} cores[] = {
+        {YM2151_CORE_SCALAR,"scalar"},
+        {YM2151_CORE_AVX2,"avx2"},
+    };
+    QP_Game *G = ctx->Game;
+    QP_BenchResult r;
+    double length = G->RenderTime > 0 ? G->RenderTime : BENCH_TIME;
+    uint32_t checksum = 0;
+    int first = 1;
+    int i, skip, val;
+
+    if(ctx->DriverInterface->Type != DRIVER_SYSTEM2)
+    {
+        printf("The benchmark requires a System 2 game\n");
+        return -1;
+    }
+
+    printf("song %03x, %.0f seconds\n",G->AutoPlay&0x7ff,length);
+
+    for(i=0;i<(int)(sizeof(cores)/sizeof(*cores));i++)
+    {
+        for(skip=0;skip<2;skip++)
+        {
+            val = QP_BenchPass(G,cores[i].Core,skip,length,&r);
+            if(val > 0)
+            {
+                printf("%-8s not supported\n",cores[i].Name);
+                break;
+            }
+            else if(val < 0)
+            {
+                printf("Failed to initialize driver\n");
+                return -1;
+            }
+
+            printf("%-8s %-10s %8.1f ns/sample %8.1fx realtime  checksum %08x\n",
+                   cores[i].Name, skip ? "idle skip" : "no skip",
+                   r.Frames ? r.Elapsed*1e9/r.Frames : 0,
+                   r.Elapsed > 0 ? length/r.Elapsed : 0,
+                   r.Checksum);
+
+            if(first)
+                checksum = r.Checksum;
+            else if(r.Checksum != checksum)
+            {
+                printf("Output differs from the first pass\n");
+                return -1;
+            }
+            first = 0;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,19 @@
+/*
+    FM benchmark
+*/
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+#include "context.h"
+
+// default song length, in seconds
+#define BENCH_TIME 60
+
+// Play the song set in AutoPlay through the System 2 driver and time
+// YM2151_render with every supported core, with and without idle channel
+// skipping. Results are printed to stdout.
+// The game must be loaded, but not initialized. Returns nonzero on failure,
+// or if the passes do not all render the same output.
+int QP_Bench(QP_Context *ctx);
+
+#endif // BENCH_H_INCLUDED
@@ -0,0 +1,23 @@
+/*
+    Player context
+*/
+#ifndef CONTEXT_H_INCLUDED
+#define CONTEXT_H_INCLUDED
+
+#include "loader.h"
+#include "mixer.h"
+#include "lib/vgm.h"
+
+// Everything needed to play one game: the game data and configuration, the
+// sound driver, render state and VGM log. Contexts do not share any state,
+// so several can be used at once from different threads.
+typedef struct QP_Context {
+    QP_Game* Game;
+    QP_AudioCallbackData* State; // render state
+    struct QP_Audio* Audio; // audio device (see audio.h), NULL if not used
+    struct QP_DriverInterface* DriverInterface; // set by LoadGame
+    QP_Vgm Vgm;
+    char Error[1024]; // message from the last call that failed
+} QP_Context;
+
+#endif // CONTEXT_H_INCLUDED
@@ -1,7 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "qp.h"
+#include "driver.h"
 #include "lib/vgm.h"
 
 #include "drv/quattro.h"
@@ -49,176 +49,190 @@ void DriverDestroy(struct QP_DriverInterface *di)
 }
 
 // Driver initialization
-int DriverInit()
+int DriverInit(QP_Context* ctx)
 {
-    return DriverInterface->IInit(DriverInterface->Driver,Game);
+    return ctx->DriverInterface->IInit(ctx->DriverInterface->Driver,ctx->Game);
 }
-void DriverDeinit()
+void DriverDeinit(QP_Context* ctx)
 {
-    return DriverInterface->IDeinit(DriverInterface->Driver);
+    return ctx->DriverInterface->IDeinit(ctx->DriverInterface->Driver);
 }
 
 // VGM open/close
-void DriverInitVgm() // datablocks
+void DriverInitVgm(QP_Context* ctx) // datablocks
 {
-    return DriverInterface->IVgmOpen(DriverInterface->Driver);
+    return ctx->DriverInterface->IVgmOpen(ctx->DriverInterface->Driver,&ctx->Vgm);
 }
-void DriverCloseVgm() // header/clocks
+void DriverCloseVgm(QP_Context* ctx) // header/clocks
 {
-    return DriverInterface->IVgmClose(DriverInterface->Driver);
+    return ctx->DriverInterface->IVgmClose(ctx->DriverInterface->Driver,ctx->State->MuteRear);
 }
 
 // Driver reset
-void DriverReset(int initial)
+void DriverReset(QP_Context* ctx,int initial)
 {
-    return DriverInterface->IReset(DriverInterface->Driver,Game,initial);
+    return ctx->DriverInterface->IReset(ctx->DriverInterface->Driver,ctx->Game,initial);
 }
 
 // Driver Parameters
-int DriverGetParameterCount()
+int DriverGetParameterCount(QP_Context* ctx)
 {
-    return DriverInterface->IGetParamCnt(DriverInterface->Driver);
+    return ctx->DriverInterface->IGetParamCnt(ctx->DriverInterface->Driver);
 }
-void DriverSetParameter(int id, int value)
+void DriverSetParameter(QP_Context* ctx,int id, int value)
 {
-    return DriverInterface->ISetParam(DriverInterface->Driver,id,value);
+    return ctx->DriverInterface->ISetParam(ctx->DriverInterface->Driver,id,value);
 }
-int DriverGetParameter(int id)
+int DriverGetParameter(QP_Context* ctx,int id)
 {
-    return DriverInterface->IGetParam(DriverInterface->Driver,id);
+    return ctx->DriverInterface->IGetParam(ctx->DriverInterface->Driver,id);
 }
-int DriverGetParameterName(int id,char* buffer,int len)
+int DriverGetParameterName(QP_Context* ctx,int id,char* buffer,int len)
 {
-    return DriverInterface->IGetParamName(DriverInterface->Driver,id,buffer,len);
+    return ctx->DriverInterface->IGetParamName(ctx->DriverInterface->Driver,id,buffer,len);
 }
-char* DriverGetSongMessage()
+char* DriverGetSongMessage(QP_Context* ctx)
 {
-    return DriverInterface->IGetSongMessage(DriverInterface->Driver);
+    return ctx->DriverInterface->IGetSongMessage(ctx->DriverInterface->Driver);
 }
-char* DriverGetDriverInfo()
+char* DriverGetDriverInfo(QP_Context* ctx)
 {
-    return DriverInterface->IGetDriverInfo(DriverInterface->Driver);
+    return ctx->DriverInterface->IGetDriverInfo(ctx->DriverInterface->Driver);
 }
 
 
 // Song requests
-int DriverGetSlotCount()
+int DriverGetSlotCount(QP_Context* ctx)
 {
-    return DriverInterface->IRequestSlotCnt(DriverInterface->Driver);
+    return ctx->DriverInterface->IRequestSlotCnt(ctx->DriverInterface->Driver);
 }
-int DriverGetSongCount(int slot)
+int DriverGetSongCount(QP_Context* ctx,int slot)
 {
-    return DriverInterface->ISongCnt(DriverInterface->Driver,slot);
+    return ctx->DriverInterface->ISongCnt(ctx->DriverInterface->Driver,slot);
 }
-void DriverRequestSong(int slot, int id)
+void DriverRequestSong(QP_Context* ctx,int slot, int id)
 {
-    return DriverInterface->ISongRequest(DriverInterface->Driver,slot,id);
+    return ctx->DriverInterface->ISongRequest(ctx->DriverInterface->Driver,slot,id);
 }
-void DriverStopSong(int slot)
+void DriverStopSong(QP_Context* ctx,int slot)
 {
-    return DriverInterface->ISongStop(DriverInterface->Driver,slot);
+    return ctx->DriverInterface->ISongStop(ctx->DriverInterface->Driver,slot);
 }
-void DriverFadeOutSong(int slot)
+void DriverFadeOutSong(QP_Context* ctx,int slot)
 {
-    return DriverInterface->ISongFade(DriverInterface->Driver,slot);
+    return ctx->DriverInterface->ISongFade(ctx->DriverInterface->Driver,slot);
 }
-int DriverGetSongStatus(int slot)
+int DriverGetSongStatus(QP_Context* ctx,int slot)
 {
-    return DriverInterface->ISongStatus(DriverInterface->Driver,slot);
+    return ctx->DriverInterface->ISongStatus(ctx->DriverInterface->Driver,slot);
 }
-int DriverGetSongId(int slot)
+int DriverGetSongId(QP_Context* ctx,int slot)
 {
-    return DriverInterface->ISongId(DriverInterface->Driver,slot);
+    return ctx->DriverInterface->ISongId(ctx->DriverInterface->Driver,slot);
 }
-double DriverGetPlayingTime(int slot)
+double DriverGetPlayingTime(QP_Context* ctx,int slot)
 {
-    return DriverInterface->ISongTime(DriverInterface->Driver,slot);
+    return ctx->DriverInterface->ISongTime(ctx->DriverInterface->Driver,slot);
 }
 
 // Loop detection
-int DriverGetLoopCount(int slot)
+int DriverGetLoopCount(QP_Context* ctx,int slot)
 {
-    return DriverInterface->IGetLoopCnt(DriverInterface->Driver,slot);
+    return ctx->DriverInterface->IGetLoopCnt(ctx->DriverInterface->Driver,slot);
 }
-void DriverResetLoopCount()
+void DriverResetLoopCount(QP_Context* ctx)
 {
-    return DriverInterface->IResetLoopCnt(DriverInterface->Driver);
+    return ctx->DriverInterface->IResetLoopCnt(ctx->DriverInterface->Driver);
 }
 
 // silence detection - return 1 if all voices are off
 // doesn't actually detect silence, just inactivity
-int DriverDetectSilence()
+int DriverDetectSilence(QP_Context* ctx)
 {
-    return DriverInterface->IDetectSilence(DriverInterface->Driver);
+    return ctx->DriverInterface->IDetectSilence(ctx->DriverInterface->Driver);
 }
 
-double DriverGetTickRate()
+double DriverGetTickRate(QP_Context* ctx)
 {
-    return DriverInterface->ITickRate(DriverInterface->Driver);
+    return ctx->DriverInterface->ITickRate(ctx->DriverInterface->Driver);
 }
-void DriverUpdateTick()
+void DriverUpdateTick(QP_Context* ctx)
 {
-    return DriverInterface->IUpdateTick(DriverInterface->Driver);
+    return ctx->DriverInterface->IUpdateTick(ctx->DriverInterface->Driver);
 }
-double DriverGetChipRate()
+double DriverGetChipRate(QP_Context* ctx)
 {
-    return DriverInterface->IChipRate(DriverInterface->Driver);
+    return ctx->DriverInterface->IChipRate(ctx->DriverInterface->Driver);
 }
-void DriverUpdateChip()
+void DriverUpdateChip(QP_Context* ctx)
 {
-    return DriverInterface->IUpdateChip(DriverInterface->Driver);
+    return ctx->DriverInterface->IUpdateChip(ctx->DriverInterface->Driver);
 }
 // fetch samples
-void DriverSampleChip(float* samples, int samplecnt)
+void DriverSampleChip(QP_Context* ctx,float* samples, int samplecnt)
 {
-    return DriverInterface->ISampleChip(DriverInterface->Driver,samples,samplecnt);
+    return ctx->DriverInterface->ISampleChip(ctx->DriverInterface->Driver,samples,samplecnt);
+}
+// render a block of frames, one audio tick per frame
+void DriverRenderBlock(QP_Context* ctx,float* out, int frames, int channels)
+{
+    if(ctx->DriverInterface->IRenderBlock)
+        return ctx->DriverInterface->IRenderBlock(ctx->DriverInterface->Driver,out,frames,channels);
+
+    int i;
+    for(i=0;i<frames;i++)
+    {
+        DriverUpdateChip(ctx);
+        DriverSampleChip(ctx,out,channels);
+        out += channels;
+    }
 }
 
 // get mute/solo masks
-uint32_t DriverGetMute()
+uint32_t DriverGetMute(QP_Context* ctx)
 {
-    return DriverInterface->IGetMute(DriverInterface->Driver);
+    return ctx->DriverInterface->IGetMute(ctx->DriverInterface->Driver);
 }
-void DriverSetMute(uint32_t data)
+void DriverSetMute(QP_Context* ctx,uint32_t data)
 {
-    return DriverInterface->ISetMute(DriverInterface->Driver,data);
+    return ctx->DriverInterface->ISetMute(ctx->DriverInterface->Driver,data);
 }
-uint32_t DriverGetSolo()
+uint32_t DriverGetSolo(QP_Context* ctx)
 {
-    return DriverInterface->IGetSolo(DriverInterface->Driver);
+    return ctx->DriverInterface->IGetSolo(ctx->DriverInterface->Driver);
 }
-void DriverSetSolo(uint32_t data)
+void DriverSetSolo(QP_Context* ctx,uint32_t data)
 {
-    return DriverInterface->ISetSolo(DriverInterface->Driver,data);
+    return ctx->DriverInterface->ISetSolo(ctx->DriverInterface->Driver,data);
 }
 // reset mute and solo masks - convenience function
-void DriverResetMute()
+void DriverResetMute(QP_Context* ctx)
 {
-    DriverSetMute(0);
-    DriverSetSolo(0);
+    DriverSetMute(ctx,0);
+    DriverSetSolo(ctx,0);
 }
 
-void DriverDebugAction(int id)
+void DriverDebugAction(QP_Context* ctx,int id)
 {
-    if(DriverInterface->IDebugAction)
-        return DriverInterface->IDebugAction(DriverInterface->Driver,id);
+    if(ctx->DriverInterface->IDebugAction)
+        return ctx->DriverInterface->IDebugAction(ctx->DriverInterface->Driver,id);
 }
 
-int DriverGetVoiceCount()
+int DriverGetVoiceCount(QP_Context* ctx)
 {
-    if(DriverInterface->IGetVoiceCount)
-        return DriverInterface->IGetVoiceCount(DriverInterface->Driver);
+    if(ctx->DriverInterface->IGetVoiceCount)
+        return ctx->DriverInterface->IGetVoiceCount(ctx->DriverInterface->Driver);
     return 0;
 }
-int DriverGetVoiceInfo(int voice,struct QP_DriverVoiceInfo *dv)
+int DriverGetVoiceInfo(QP_Context* ctx,int voice,struct QP_DriverVoiceInfo *dv)
 {
-    if(DriverInterface->IGetVoiceInfo)
-        return DriverInterface->IGetVoiceInfo(DriverInterface->Driver,voice,dv);
+    if(ctx->DriverInterface->IGetVoiceInfo)
+        return ctx->DriverInterface->IGetVoiceInfo(ctx->DriverInterface->Driver,voice,dv);
     return -1;
 }
-uint16_t DriverGetVoiceStatus(int voice)
+uint16_t DriverGetVoiceStatus(QP_Context* ctx,int voice)
 {
-    if(DriverInterface->IGetVoiceStatus)
-        return DriverInterface->IGetVoiceStatus(DriverInterface->Driver,voice);
+    if(ctx->DriverInterface->IGetVoiceStatus)
+        return ctx->DriverInterface->IGetVoiceStatus(ctx->DriverInterface->Driver,voice);
     return 0;
 }
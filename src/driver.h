@@ -4,6 +4,8 @@
 #include <stdint.h>
 
 #include "loader.h"
+#include "context.h"
+#include "lib/vgm.h"
 
 enum QP_DriverType {
     DRIVER_NOT_LOADED = 0,
@@ -72,9 +74,10 @@ struct QP_DriverInterface {
     // Deinitializes a sound driver. Any and all allocated memory should be
     // freed by this call
     void (*IDeinit)(void*);
-    // Setup vgm logging for this sound driver
-    void (*IVgmOpen)(void*);
-    void (*IVgmClose)(void*);
+    // Setup vgm logging for this sound driver. IVgmOpen writes the data
+    // blocks, IVgmClose writes the chip clocks to the header.
+    void (*IVgmOpen)(void*,QP_Vgm* vgm);
+    void (*IVgmClose)(void*,int muterear);
     // Reset the sound driver. Initial is set to 1 for the initial setup (right after IInit)
     void (*IReset)(void*,QP_Game *game,int initial);
 
@@ -125,6 +128,9 @@ struct QP_DriverInterface {
     void (*IUpdateChip)(void*);
     // Get samples from the audio
     void (*ISampleChip)(void*,float* samples,int samplecnt);
+    // Render a block of frames at the audio tick rate (optional). Driver
+    // ticks are handled by the caller between blocks.
+    void (*IRenderBlock)(void*,float* out,int frames,int channels);
 
     // Channel mute bitmask
     uint32_t (*IGetMute)(void*);
@@ -145,44 +151,45 @@ struct QP_DriverTable {
     char* name;
 };
 
-const struct QP_DriverTable DriverTable[DRIVER_COUNT];
+extern const struct QP_DriverTable DriverTable[DRIVER_COUNT];
 int DriverCreate(struct QP_DriverInterface *di,enum QP_DriverType dt);
 void DriverDestroy(struct QP_DriverInterface *di);
 
-int DriverInit();
-void DriverDeinit();
-void DriverInitVgm();
-void DriverCloseVgm();
-void DriverReset(int initial);
-int DriverGetParameterCount();
-void DriverSetParameter(int id, int value);
-int DriverGetParameter(int id);
-int DriverGetParameterName(int id,char* buffer,int len);
-char* DriverGetSongMessage();
-char* DriverGetDriverInfo();
-int DriverGetSlotCount();
-int DriverGetSongCount(int slot);
-void DriverRequestSong(int slot, int id);
-void DriverStopSong(int slot);
-void DriverFadeOutSong(int slot);
-int DriverGetSongStatus(int slot);
-int DriverGetSongId(int slot);
-double DriverGetPlayingTime(int slot);
-int DriverGetLoopCount(int slot);
-void DriverResetLoopCount();
-int DriverDetectSilence();
-double DriverGetTickRate();
-void DriverUpdateTick();
-double DriverGetChipRate();
-void DriverUpdateChip();
-void DriverSampleChip(float* samples, int samplecnt);
-uint32_t DriverGetMute();
-void DriverSetMute(uint32_t data);
-uint32_t DriverGetSolo();
-void DriverSetSolo(uint32_t data);
-void DriverResetMute();
-void DriverDebugAction(int id);
-int DriverGetVoiceCount();
-int DriverGetVoiceInfo(int voice,struct QP_DriverVoiceInfo *dv);
-uint16_t DriverGetVoiceStatus(int voice);
+int DriverInit(QP_Context* ctx);
+void DriverDeinit(QP_Context* ctx);
+void DriverInitVgm(QP_Context* ctx);
+void DriverCloseVgm(QP_Context* ctx);
+void DriverReset(QP_Context* ctx,int initial);
+int DriverGetParameterCount(QP_Context* ctx);
+void DriverSetParameter(QP_Context* ctx,int id, int value);
+int DriverGetParameter(QP_Context* ctx,int id);
+int DriverGetParameterName(QP_Context* ctx,int id,char* buffer,int len);
+char* DriverGetSongMessage(QP_Context* ctx);
+char* DriverGetDriverInfo(QP_Context* ctx);
+int DriverGetSlotCount(QP_Context* ctx);
+int DriverGetSongCount(QP_Context* ctx,int slot);
+void DriverRequestSong(QP_Context* ctx,int slot, int id);
+void DriverStopSong(QP_Context* ctx,int slot);
+void DriverFadeOutSong(QP_Context* ctx,int slot);
+int DriverGetSongStatus(QP_Context* ctx,int slot);
+int DriverGetSongId(QP_Context* ctx,int slot);
+double DriverGetPlayingTime(QP_Context* ctx,int slot);
+int DriverGetLoopCount(QP_Context* ctx,int slot);
+void DriverResetLoopCount(QP_Context* ctx);
+int DriverDetectSilence(QP_Context* ctx);
+double DriverGetTickRate(QP_Context* ctx);
+void DriverUpdateTick(QP_Context* ctx);
+double DriverGetChipRate(QP_Context* ctx);
+void DriverUpdateChip(QP_Context* ctx);
+void DriverSampleChip(QP_Context* ctx,float* samples, int samplecnt);
+void DriverRenderBlock(QP_Context* ctx,float* out, int frames, int channels);
+uint32_t DriverGetMute(QP_Context* ctx);
+void DriverSetMute(QP_Context* ctx,uint32_t data);
+uint32_t DriverGetSolo(QP_Context* ctx);
+void DriverSetSolo(QP_Context* ctx,uint32_t data);
+void DriverResetMute(QP_Context* ctx);
+void DriverDebugAction(QP_Context* ctx,int id);
+int DriverGetVoiceCount(QP_Context* ctx);
+int DriverGetVoiceInfo(QP_Context* ctx,int voice,struct QP_DriverVoiceInfo *dv);
+uint16_t DriverGetVoiceStatus(QP_Context* ctx,int voice);
 #endif // DRIVER_H_INCLUDED
@@ -1,6 +1,6 @@
 #include <string.h>
 
-#include "../qp.h"
+#include "../driver.h"
 #include "../lib/vgm.h"
 
 #include "quattro.h"
@@ -14,11 +14,14 @@ int Q_IInit(void* d,QP_Game *g)
     Q->McuType = Q_GetMcuTypeFromString(g->Type);
     Q->ChipClock = g->ChipFreq;
     C352_init(&Q->Chip,g->ChipFreq);
+    C352_set_core(&Q->Chip,g->C352Core);
     Q->Chip.mulaw_type = C352_MULAW_TYPE_C352;
-    Q->Chip.vgm_log = 0;
+    Q->Chip.vgm = NULL;
 
     Q->Chip.wave = g->WaveData;
     Q->Chip.wave_mask = g->WaveMask;
+    if(g->SampleCache > 0)
+        C352_cache_init(&Q->Chip,g->SampleCache<<20);
     Q->McuData = g->Data;
     return 0;
 }
@@ -26,18 +29,19 @@ void Q_IDeinit(void* d)
 {
     Q_Deinit(d);
 }
-void Q_IVgmOpen(void* d)
+void Q_IVgmOpen(void* d,QP_Vgm* v)
 {
     Q_State *Q = d;
-    vgm_datablock(0x92,0x1000000,Q->Chip.wave,0x1000000,Q->Chip.wave_mask,0);
-    Q->Chip.vgm_log = 1;
+    vgm_datablock(v,0x92,0x1000000,Q->Chip.wave,0x1000000,Q->Chip.wave_mask,0);
+    Q->Chip.vgm = v;
 }
-void Q_IVgmClose(void* d)
+void Q_IVgmClose(void* d,int muterear)
 {
     Q_State *Q = d;
-    Q->Chip.vgm_log = 0;
-    vgm_poke32(0xdc,Q->ChipClock | Audio->state.MuteRear<<31);
-    vgm_poke8(0xd6,288/4);
+    QP_Vgm* v = Q->Chip.vgm;
+    Q->Chip.vgm = NULL;
+    vgm_poke32(v,0xdc,Q->ChipClock | muterear<<31);
+    vgm_poke8(v,0xd6,288/4);
 }
 void Q_IReset(void* d,QP_Game* g,int initial)
 {
@@ -169,11 +173,31 @@ void Q_IUpdateChip(void* d)
 void Q_ISampleChip(void* d,float* samples,int samplecnt)
 {
     Q_State *Q = d;
+    const double scale = 1.0 / (1<<28);
     int i;
     if(samplecnt > 4)
         samplecnt=4;
     for(i=0;i<samplecnt;i++)
-        samples[i] = Q->Chip.out[i] / (1<<28);
+        samples[i] = Q->Chip.out[i] * scale;
+}
+void Q_IRenderBlock(void* d,float* out,int frames,int channels)
+{
+    Q_State *Q = d;
+    const double scale = 1.0 / (1<<28);
+    int32_t buf[C352_BLOCK*4];
+    int i,j,len,n = channels > 4 ? 4 : channels;
+    while(frames > 0)
+    {
+        len = frames > C352_BLOCK ? C352_BLOCK : frames;
+        C352_render(&Q->Chip,buf,len);
+        for(i=0;i<len;i++)
+        {
+            for(j=0;j<n;j++)
+                out[j] = buf[i*4+j] * scale;
+            out += channels;
+        }
+        frames -= len;
+    }
 }
 
 uint32_t Q_IGetMute(void* d)
@@ -306,6 +330,7 @@ struct QP_DriverInterface Q_CreateInterface()
         .IChipRate = &Q_IChipRate,
         .IUpdateChip = &Q_IUpdateChip,
         .ISampleChip = &Q_ISampleChip,
+        .IRenderBlock = &Q_IRenderBlock,
 
         .IGetMute = &Q_IGetMute,
         .ISetMute = &Q_ISetMute,
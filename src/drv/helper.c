@@ -65,26 +65,6 @@ uint8_t Q_PitchTableLE[0x18] = {
 
 // ************************************************************************* //
 
-uint32_t Q_ReadPos(Q_State *Q, uint32_t d)
-{
-    return ((Q->McuData[d+2]<<16) | (Q->McuData[d+1]<<8) | (Q->McuData[d]<<0)) - Q->McuPosBase;
-}
-
-uint8_t Q_ReadByte(Q_State *Q,uint32_t d)
-{
-    return Q->McuData[d];
-}
-
-uint16_t Q_ReadWord(Q_State *Q,uint32_t d)
-{
-    return ((Q->McuData[d+1]<<8) | (Q->McuData[d]<<0));
-}
-
-uint16_t Q_ReadWordBE(Q_State *Q,uint32_t d)
-{
-    return ((Q->McuData[d]<<8) | (Q->McuData[d+1]<<0));
-}
-
 Q_McuType Q_GetMcuTypeFromString(char* s)
 {
     Q_McuType a;
@@ -348,14 +328,13 @@ void Q_UpdateMuteMask(Q_State *Q)
 
 void Q_LoopDetectionInit(Q_State *Q)
 {
-    Q->LoopCounterFlags = (uint32_t*)malloc(0x80000*sizeof(uint32_t));
-    memset(Q->LoopCounterFlags,0,0x80000*sizeof(uint32_t));
+    QP_LoopTableInit(&Q->LoopCounterFlags,0x80000);
     Q_LoopDetectionReset(Q);
     Q->NextLoopId = 1;
 }
 void Q_LoopDetectionFree(Q_State *Q)
 {
-    free(Q->LoopCounterFlags);
+    QP_LoopTableFree(&Q->LoopCounterFlags);
 }
 void Q_LoopDetectionReset(Q_State *Q)
 {
@@ -382,7 +361,9 @@ void Q_LoopDetectionCheck(Q_State *Q,int TrackNo,int stopped)
         Q->TrackLoopId[trackid] = loopid;
     }
 
-    uint32_t* data = &Q->LoopCounterFlags[Q->Track[TrackNo].Position];
+    uint32_t* data = QP_LoopTableEntry(&Q->LoopCounterFlags,Q->Track[TrackNo].Position);
+    if(!data)
+        return;
     if(*data == loopid && Q->TrackLoopCount[trackid] < 100 &&
        Q->Track[TrackNo].SubStackPos == 0 &&
        Q->Track[TrackNo].RepeatStackPos == 0 &&
@@ -411,13 +392,13 @@ void Q_LoopDetectionJumpCheck(Q_State *Q,int TrackNo)
     if(Q->TrackLoopCount[trackid] > 100)
         return;
 
-    uint32_t* data = &Q->LoopCounterFlags[Q->Track[TrackNo].Position];
+    uint32_t data = QP_LoopTableRead(&Q->LoopCounterFlags,Q->Track[TrackNo].Position);
 
     int i;
     for(i=0;i<Q_MAX_TRACKS;i++)
     {
         trackid2 = Q->SongRequest[i]&0x7ff;
-        if(i != TrackNo && Q->ParentSong[i] == Q->ParentSong[TrackNo] && *data == Q->TrackLoopId[trackid2] && *data != 0)
+        if(i != TrackNo && Q->ParentSong[i] == Q->ParentSong[TrackNo] && data == Q->TrackLoopId[trackid2] && data != 0)
         {
             Q->TrackLoopCount[trackid] = 254;
             return;
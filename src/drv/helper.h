@@ -6,10 +6,24 @@
 
 #include "../macro.h"
 
-uint32_t Q_ReadPos(Q_State *Q,uint32_t d);
-uint8_t Q_ReadByte(Q_State *Q,uint32_t d);
-uint16_t Q_ReadWord(Q_State *Q,uint32_t d);
-uint16_t Q_ReadWordBE(Q_State *Q,uint32_t d);
+// MCU data is read for every track command operand and envelope step,
+// so these are inlined.
+static inline uint32_t Q_ReadPos(Q_State *Q,uint32_t d)
+{
+    return ((Q->McuData[d+2]<<16) | (Q->McuData[d+1]<<8) | (Q->McuData[d]<<0)) - Q->McuPosBase;
+}
+static inline uint8_t Q_ReadByte(Q_State *Q,uint32_t d)
+{
+    return Q->McuData[d];
+}
+static inline uint16_t Q_ReadWord(Q_State *Q,uint32_t d)
+{
+    return ((Q->McuData[d+1]<<8) | (Q->McuData[d]<<0));
+}
+static inline uint16_t Q_ReadWordBE(Q_State *Q,uint32_t d)
+{
+    return ((Q->McuData[d]<<8) | (Q->McuData[d+1]<<0));
+}
 
 Q_McuType Q_GetMcuType(Q_State* Q);
 void Q_GetMcuVer(Q_State* Q);
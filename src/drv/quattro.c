@@ -22,6 +22,9 @@ void Q_Init(Q_State *Q)
 void Q_Deinit(Q_State *Q)
 {
     Q_LoopDetectionFree(Q);
+    if(Q->Chip.cache_table)
+        Q_DEBUG("sample cache: %u hits, %u pages decoded\n",Q->Chip.cache_hits,Q->Chip.cache_misses);
+    C352_cache_free(&Q->Chip);
 }
 
 void Q_Reset(Q_State *Q)
@@ -31,6 +34,7 @@ void Q_Reset(Q_State *Q)
 
     memset(Q->Chip.v,0,sizeof(Q->Chip.v));
     memset(Q->Voice,0,sizeof(Q->Voice));
+    Q->VoiceActive=0;
 
     for(i=0;i<Q_MAX_VOICES;i++)
     {
@@ -54,6 +58,8 @@ void Q_Reset(Q_State *Q)
     memset(Q->Track,0,sizeof(Q->Track));
     memset(Q->ActiveChannel,0,sizeof(Q->ActiveChannel));
     memset(Q->ChannelPriority,0,sizeof(Q->ChannelPriority));
+    memset(Q->PriorityMask,0,sizeof(Q->PriorityMask));
+    memset(Q->PriorityTrack,0,sizeof(Q->PriorityTrack));
 
     Q->BasePitch=0;
 
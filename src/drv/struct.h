@@ -244,7 +244,7 @@ struct Q_State {
 
     double SongTimer[Q_MAX_TRACKS];
 #ifndef Q_DISABLE_LOOP_DETECTION
-    uint32_t* LoopCounterFlags;
+    QP_LoopTable LoopCounterFlags; // loop IDs are 16-bit, the table type is shared with S2X
     uint32_t TrackLoopId[0x800];
     uint8_t TrackLoopCount[0x800];
     uint16_t NextLoopId; // set 0 to disable loop detection
@@ -272,6 +272,8 @@ struct Q_State {
     Q_Channel* ActiveChannel[Q_MAX_VOICES];
     // List of allocated voices for each track and the associated priority.
     Q_ChannelPriority ChannelPriority[Q_MAX_VOICES][Q_MAX_TRACKS];
+    uint32_t PriorityMask[Q_MAX_VOICES]; // tracks with a priority set
+    uint8_t PriorityTrack[Q_MAX_VOICES]; // track with the highest priority
 
     uint16_t BasePitch;
     uint8_t BaseFadeout;
@@ -290,6 +292,7 @@ struct Q_State {
     Q_Track Track[Q_MAX_TRACKS];
 
     uint16_t VoiceCount;
+    uint32_t VoiceActive; // voices that are enabled or have queued events
     Q_Voice Voice[Q_MAX_VOICES];
 
     Q_Channel ChannelPreset[256];
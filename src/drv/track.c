@@ -117,6 +117,8 @@ void Q_TrackUpdate(Q_State* Q,int TrackNo)
     else
     {
         // Parse commands...
+        // Commands are decoded straight from the sound data. They are only
+        // read when a rest ends, so this is a small part of the tick.
         // max amount of commands before switching tracks... (Not a feature of the original driver)
         T->TicksLeft = T->SkipTrack ? 50000 : 1000;
 
@@ -233,8 +235,8 @@ void Q_TrackDisable(Q_State *Q,int TrackNo)
     uint16_t cflags;
     for(i=0;i<Q_MAX_VOICES;i++)
     {
-        Q->ChannelPriority[i][TrackNo].channel = 0;
-        Q->ChannelPriority[i][TrackNo].priority = 0;
+        if(Q->PriorityMask[i] & (1u<<TrackNo))
+            Q_VoiceSetPriority(Q,i,TrackNo,0,0);
     }
     for(i=0;i<Q_MAX_TRKCHN;i++)
     {
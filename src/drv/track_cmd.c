@@ -243,6 +243,7 @@ static void WriteKeyOnEvent(Q_State* Q,Q_Track *T,Q_Channel* ch,uint8_t EventMod
         V->LastEvent = V->CurrEvent+1;
 
     V->EventCh = ch;
+    Q->VoiceActive |= 1u<<(V-Q->Voice);
     EventPos = (V->LastEvent-1)&0x07;
 
     E = &V->Event[EventPos];
@@ -8,6 +8,8 @@
 
 // call 0x04 - update tracks and execute song requests
 // source: 0x4a56
+// Busy tracks are visited on every tick even when no update is due, since
+// the song timer, fadeout and track volume are advanced per tick.
 void Q_UpdateTracks(Q_State *Q)
 {
     int TrackNo;
@@ -34,8 +36,16 @@ void Q_UpdateVoices(Q_State* Q)
     Q_VoiceEvent *E;
     int16_t timeleft;
     int VoiceNo;
-    for(VoiceNo=0;VoiceNo<Q->VoiceCount;VoiceNo++)
+    uint32_t active = Q->VoiceActive;
+
+    // only voices that are enabled or have queued events need updating
+    if(Q->VoiceCount < Q_MAX_VOICES)
+        active &= (1u<<Q->VoiceCount)-1;
+
+    while(active)
     {
+        VoiceNo = __builtin_ctz(active);
+        active &= active-1;
         V = &Q->Voice[VoiceNo];
 
         timeleft = (int16_t)(V->Event[(V->CurrEvent)&0x07].Time - Q->FrameCnt);
@@ -58,6 +68,10 @@ void Q_UpdateVoices(Q_State* Q)
         {
             Q_VoiceUpdate(Q,VoiceNo,V);
         }
+
+        // voice stays idle until the next event is queued
+        if(!V->Enabled && V->CurrEvent == V->LastEvent)
+            Q->VoiceActive &= ~(1u<<VoiceNo);
 #if 0
         else if(~Q->SongRequest[V->TrackNo] & Q_TRACK_STATUS_BUSY &&
            Q->Track[V->TrackNo].Channel[V->ChannelNo].VoiceNo != VoiceNo)
@@ -67,5 +81,5 @@ void Q_UpdateVoices(Q_State* Q)
 #endif
 
     }
-    C352_write(&Q->Chip,0x202,VoiceNo); // update key-ons
+    C352_write(&Q->Chip,0x202,Q->VoiceCount); // update key-ons
 }
@@ -31,23 +31,44 @@ void Q_VoiceClearChannel(Q_State *Q,int VoiceNo)
     Q->Voice[VoiceNo].TrackNo = 0;
 }
 
-// Call 0x0e - find highest priority for the voice
-// source: 0x4e44
-uint16_t Q_VoiceGetPriority(Q_State *Q,int VoiceNo,int* TrackNo,int* ChannelNo)
+// find the track with the highest priority among 'mask'. The lowest
+// track number wins ties, same as the linear scan in the original driver.
+static int Q_VoiceFindPriority(Q_State *Q,int VoiceNo,uint32_t mask)
 {
     int i;
-    int track = 0;
-    int channel=0;
+    int track=0;
     int priority=0;
-    for(i=0;i<Q->TrackCount;i++)
+    while(mask)
     {
+        i = __builtin_ctz(mask);
+        mask &= mask-1;
         if(Q->ChannelPriority[VoiceNo][i].priority > priority)
         {
             track=i;
-            channel=Q->ChannelPriority[VoiceNo][i].channel;
             priority=Q->ChannelPriority[VoiceNo][i].priority;
         }
     }
+    return track;
+}
+
+// Call 0x0e - find highest priority for the voice
+// source: 0x4e44
+uint16_t Q_VoiceGetPriority(Q_State *Q,int VoiceNo,int* TrackNo,int* ChannelNo)
+{
+    int track = Q->PriorityTrack[VoiceNo];
+    int channel=0;
+    int priority=0;
+
+    // the driver only scans the first TrackCount tracks
+    if(track >= Q->TrackCount)
+        track = Q_VoiceFindPriority(Q,VoiceNo,Q->PriorityMask[VoiceNo] & ((1ull<<Q->TrackCount)-1));
+
+    if(track < Q->TrackCount)
+        priority = Q->ChannelPriority[VoiceNo][track].priority;
+    if(priority)
+        channel = Q->ChannelPriority[VoiceNo][track].channel;
+    else
+        track = 0;
 
     if(TrackNo != NULL)
         *TrackNo = track;
@@ -61,8 +82,29 @@ uint16_t Q_VoiceGetPriority(Q_State *Q,int VoiceNo,int* TrackNo,int* ChannelNo)
 // source: 0x4d88
 void Q_VoiceSetPriority(Q_State *Q,int VoiceNo,int TrackNo,int ChannelNo,int Priority)
 {
-    Q->ChannelPriority[VoiceNo][TrackNo].channel = ChannelNo;
-    Q->ChannelPriority[VoiceNo][TrackNo].priority = Priority;
+    Q_ChannelPriority *P = &Q->ChannelPriority[VoiceNo][TrackNo];
+    int top = Q->PriorityTrack[VoiceNo];
+    uint16_t old = P->priority;
+
+    P->channel = ChannelNo;
+    P->priority = Priority;
+
+    if(P->priority)
+        Q->PriorityMask[VoiceNo] |= 1u<<TrackNo;
+    else
+        Q->PriorityMask[VoiceNo] &= ~(1u<<TrackNo);
+
+    // keep track of the highest priority track
+    if(TrackNo == top)
+    {
+        if(P->priority < old)
+            Q->PriorityTrack[VoiceNo] = Q_VoiceFindPriority(Q,VoiceNo,Q->PriorityMask[VoiceNo]);
+    }
+    else if(P->priority > Q->ChannelPriority[VoiceNo][top].priority ||
+            (P->priority && P->priority == Q->ChannelPriority[VoiceNo][top].priority && TrackNo < top))
+    {
+        Q->PriorityTrack[VoiceNo] = TrackNo;
+    }
 }
 
 // Call 0x24 - process an event
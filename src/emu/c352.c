@@ -14,23 +14,50 @@
 #include "c352.h"
 #include "../lib/vgm.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define C352_X86 1
+#include <immintrin.h>
+#endif
+
 int C352_init(C352 *c, uint32_t clk)
 {
     c->mute_mask=0;
     c->rate = clk/288;
 
     memset(c->v,0,sizeof(C352_Voice)*C352_VOICES);
-    memset(c->out,0,4*sizeof(int16_t));
+    memset(c->out,0,sizeof(c->out));
+    c->active = 0;
+    c->time = 0;
+    c->cache_table = NULL;
+    c->cache_pool = NULL;
+    c->cache_gen = 0;
 
     c->control1 = 0;
     c->control2 = 0;
     c->random = 0x1234;
 
     C352_set_mulaw_type(c,C352_MULAW_TYPE_C352);
+    C352_set_core(c,C352_CORE_AUTO);
 
     return c->rate;
 }
 
+int C352_set_core(C352 *c,int core)
+{
+    int best = C352_CORE_SCALAR;
+#ifdef C352_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        best = C352_CORE_AVX2;
+    else if(__builtin_cpu_supports("sse4.1"))
+        best = C352_CORE_SSE41;
+#endif
+    if(core == C352_CORE_AUTO || core > best)
+        core = best;
+    c->core = core;
+    return core;
+}
+
 // Generated tables verified with Wii Virtual Console emulators
 // (Starblade, Knuckle Heads)
 void C352_set_mulaw_type(C352 *c,int mulaw_type)
@@ -73,6 +100,74 @@ void C352_set_mulaw_type(C352 *c,int mulaw_type)
         }
         break;
     }
+    C352_cache_flush(c);
+}
+
+int C352_cache_init(C352 *c,uint32_t size)
+{
+    uint32_t pages = (c->wave_mask>>C352_CACHE_PAGE_BITS)+1;
+
+    C352_cache_free(c);
+    c->cache_max = size>>(C352_CACHE_PAGE_BITS+1);
+    if(!c->wave || !c->cache_max)
+        return -1;
+
+    c->cache_table = calloc(pages*2,sizeof(int16_t*));
+    c->cache_pool = malloc((size_t)c->cache_max<<(C352_CACHE_PAGE_BITS+1));
+    if(!c->cache_table || !c->cache_pool)
+    {
+        C352_cache_free(c);
+        return -1;
+    }
+    c->cache_hits = c->cache_misses = 0;
+    C352_cache_flush(c);
+    return 0;
+}
+
+void C352_cache_free(C352 *c)
+{
+    free(c->cache_table);
+    free(c->cache_pool);
+    c->cache_table = NULL;
+    c->cache_pool = NULL;
+}
+
+void C352_cache_flush(C352 *c)
+{
+    if(!c->cache_table)
+        return;
+    memset(c->cache_table,0,((c->wave_mask>>C352_CACHE_PAGE_BITS)+1)*2*sizeof(int16_t*));
+    c->cache_used = 0;
+    c->cache_gen++;
+}
+
+// look up or decode the page for the current voice position
+static const int16_t* C352_cache_page(C352 *c,C352_Voice *v,uint32_t key)
+{
+    int i;
+    int16_t* page = c->cache_table[key];
+    if(page)
+        c->cache_hits++;
+    else
+    {
+        if(c->cache_used == c->cache_max)
+            C352_cache_flush(c);
+        page = c->cache_pool + (c->cache_used++<<C352_CACHE_PAGE_BITS);
+        c->cache_table[key] = page;
+        c->cache_misses++;
+
+        uint32_t pos = (key>>1)<<C352_CACHE_PAGE_BITS;
+        if(key&1)
+            for(i=0;i<1<<C352_CACHE_PAGE_BITS;i++)
+                page[i] = c->mulaw_table[c->wave[(pos+i)&c->wave_mask]];
+        else
+            for(i=0;i<1<<C352_CACHE_PAGE_BITS;i++)
+                page[i] = (int8_t)c->wave[(pos+i)&c->wave_mask]<<8;
+    }
+    v->cache_page = page;
+    v->cache_key = key;
+    v->cache_gen = c->cache_gen;
+    return page;
 }
 
 uint16_t C352RegMap[8] = {
@@ -86,15 +181,62 @@ uint16_t C352RegMap[8] = {
     offsetof(C352_Voice,wave_loop),
 };
 
+// Bring the counter and volume ramp of an idle voice up to date. Idle
+// voices output zero, and the volume ramp steps each time the counter
+// crosses a multiple of 0x8000.
+static void C352_sync_voice(C352 *c,int i)
+{
+    C352_Voice *v = &c->v[i];
+    uint64_t n = c->time - v->sync;
+    uint64_t next, steps, diff;
+    uint8_t target[4];
+    int ch;
+
+    v->sync = c->time;
+    if((c->active & 1<<i) || !n)
+        return;
+
+    next = v->counter + n*v->freq;
+    steps = v->freq >= 0x8000 ? n : (next>>15) - (v->counter>>15);
+    v->counter = next & 0xffff;
+    if(!steps)
+        return;
+
+    target[0] = v->vol_f>>8;
+    target[1] = v->vol_f&0xff;
+    target[2] = v->vol_r>>8;
+    target[3] = v->vol_r&0xff;
+    for(ch=0;ch<4;ch++)
+    {
+        if(v->latch_flags & C352_FLG_FILTER)
+            v->curr_vol[ch] = target[ch];
+        else if(v->curr_vol[ch] < target[ch])
+        {
+            diff = target[ch]-v->curr_vol[ch];
+            v->curr_vol[ch] += diff < steps ? diff : steps;
+        }
+        else
+        {
+            diff = v->curr_vol[ch]-target[ch];
+            v->curr_vol[ch] -= diff < steps ? diff : steps;
+        }
+    }
+}
+
 void C352_write(C352 *c, uint16_t addr, uint16_t data)
 {
-    if(c->vgm_log)
-        vgm_write(0xe1,0,addr,data);
+    if(c->vgm)
+        vgm_write(c->vgm,0xe1,0,addr,data);
 
     int i;
 
     if(addr < 0x100)
+    {
+        C352_sync_voice(c,addr/8);
         *(uint16_t*)((void*)&c->v[addr/8]+C352RegMap[addr%8]) = data;
+        if(addr%8 == C352_FLAGS && data & C352_FLG_BUSY)
+            c->active |= 1<<(addr/8);
+    }
     else if(addr == 0x200)
         c->control1 = data;
     else if(addr == 0x201)
@@ -103,6 +245,8 @@ void C352_write(C352 *c, uint16_t addr, uint16_t data)
     {
         for(i=0;i<C352_VOICES;i++)
         {
+            if(c->v[i].flags & (C352_FLG_KEYON|C352_FLG_KEYOFF))
+                C352_sync_voice(c,i);
             if(c->v[i].flags & C352_FLG_KEYON)
             {
                 c->v[i].pos = (c->v[i].wave_bank<<16) | c->v[i].wave_start;
@@ -116,6 +260,8 @@ void C352_write(C352 *c, uint16_t addr, uint16_t data)
 
                 c->v[i].curr_vol[0] = c->v[i].curr_vol[1] = 0;
                 c->v[i].curr_vol[2] = c->v[i].curr_vol[3] = 0;
+
+                c->active |= 1<<i;
             }
             if(c->v[i].flags & C352_FLG_KEYOFF)
             {
@@ -143,6 +289,13 @@ static inline void C352_fetch_sample(C352 *c, int i)
     if(~v->flags & C352_FLG_BUSY)
     {
         v->sample = 0;
+        // output stays at zero until the next key on. The rest of the
+        // current sample is still processed.
+        if(!v->last_sample)
+        {
+            c->active &= ~(1<<i);
+            v->sync = c->time+1;
+        }
     }
     else if(v->flags & C352_FLG_NOISE)
     {
@@ -153,12 +306,26 @@ static inline void C352_fetch_sample(C352 *c, int i)
 	{
 		int8_t s;
 
-		s = (int8_t)c->wave[v->pos&c->wave_mask];
+        if(c->cache_table)
+        {
+            uint32_t addr = v->pos&c->wave_mask;
+            uint32_t key = (addr>>C352_CACHE_PAGE_BITS)<<1 | ((v->flags & C352_FLG_MULAW) ? 1 : 0);
+            const int16_t* page = v->cache_page;
+            if(key != v->cache_key || v->cache_gen != c->cache_gen)
+                page = C352_cache_page(c,v,key);
+            else
+                c->cache_hits++;
+            v->sample = page[addr&((1<<C352_CACHE_PAGE_BITS)-1)];
+        }
+        else
+        {
+            s = (int8_t)c->wave[v->pos&c->wave_mask];
 
-		if(v->flags & C352_FLG_MULAW)
-            v->sample = c->mulaw_table[s&0xff];
-		else
-			v->sample = s<<8;
+            if(v->flags & C352_FLG_MULAW)
+                v->sample = c->mulaw_table[s&0xff];
+            else
+                v->sample = s<<8;
+        }
 
 		uint16_t pos = v->pos&0xffff;
 
@@ -243,11 +410,15 @@ void C352_update(C352 *c)
     int i;
     int16_t s;
     uint16_t flags;
+    uint32_t mask = c->active;
 
     c->out[0]=c->out[1]=c->out[2]=c->out[3]=0;
 
-    for(i=0;i<C352_VOICES;i++)
+    while(mask)
     {
+        i = __builtin_ctz(mask);
+        mask &= mask-1;
+
         s = C352_update_voice(c,i);
 
         if(!(c->mute_mask & 1<<i))
@@ -267,4 +438,263 @@ void C352_update(C352 *c)
                                                     :  s * (c->v[i].curr_vol[3]);
         }
     }
+    c->time++;
+}
+
+/*
+    Block rendering
+
+    The SIMD cores copy the per-sample voice state into arrays, so that
+    several voices can be processed at once. Sample fetches (including
+    loops and key-offs) are rare compared to the other work, and are
+    done by the scalar code for the voices that need them. Groups with
+    no active voices are skipped, idle voices in the other groups are
+    left unchanged, as in C352_update.
+    Output is identical to calling C352_update for every sample.
+*/
+typedef struct {
+    int32_t counter[C352_VOICES];
+    int32_t freq[C352_VOICES];
+    int32_t sample[C352_VOICES];
+    int32_t last_sample[C352_VOICES];
+    int32_t filter[C352_VOICES]; // -1 if interpolation and volume ramp are disabled
+    int32_t vol[4][C352_VOICES];
+    int32_t target[4][C352_VOICES];
+    int32_t sign[4][C352_VOICES]; // phase invert and mute
+} C352_Block;
+
+static void C352_block_load(C352 *c,C352_Block *b)
+{
+    int i,ch;
+    uint16_t flags;
+    for(i=0;i<C352_VOICES;i++)
+    {
+        C352_Voice *v = &c->v[i];
+        flags = v->latch_flags;
+
+        b->counter[i] = v->counter;
+        b->freq[i] = v->freq;
+        b->sample[i] = v->sample;
+        b->last_sample[i] = v->last_sample;
+        b->filter[i] = (flags & C352_FLG_FILTER) ? -1 : 0;
+
+        for(ch=0;ch<4;ch++)
+            b->vol[ch][i] = v->curr_vol[ch];
+        b->target[0][i] = v->vol_f>>8;
+        b->target[1][i] = v->vol_f&0xff;
+        b->target[2][i] = v->vol_r>>8;
+        b->target[3][i] = v->vol_r&0xff;
+
+        b->sign[0][i] = (flags & C352_FLG_PHASEFL) ? -1 : 1;
+        b->sign[1][i] = (flags & C352_FLG_PHASEFR) ? -1 : 1;
+        b->sign[2][i] = (flags & C352_FLG_PHASERL) ? -1 : 1;
+        b->sign[3][i] = (flags & C352_FLG_PHASEFR) ? -1 : 1;
+        if(c->mute_mask & 1<<i)
+            b->sign[0][i] = b->sign[1][i] = b->sign[2][i] = b->sign[3][i] = 0;
+    }
+}
+
+static void C352_block_store(C352 *c,C352_Block *b)
+{
+    int i,ch;
+    for(i=0;i<C352_VOICES;i++)
+    {
+        C352_Voice *v = &c->v[i];
+        v->counter = b->counter[i];
+        v->sample = b->sample[i];
+        v->last_sample = b->last_sample[i];
+        for(ch=0;ch<4;ch++)
+            v->curr_vol[ch] = b->vol[ch][i];
+    }
+}
+
+static void C352_block_fetch(C352 *c,C352_Block *b,int i)
+{
+    c->v[i].sample = b->sample[i];
+    C352_fetch_sample(c,i);
+    b->sample[i] = c->v[i].sample;
+    b->last_sample[i] = c->v[i].last_sample;
+}
+
+#ifdef C352_X86
+__attribute__((target("sse4.1")))
+static void C352_render_sse41(C352 *c,C352_Block *b,int32_t *buf,int frames)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i m_one = _mm_set1_epi32(-1);
+    const __m128i vol_mask = _mm_set1_epi32(0x18000);
+    const __m128i cnt_mask = _mm_set1_epi32(0xffff);
+    const __m128i lane = _mm_setr_epi32(1,2,4,8);
+    __m128i acc[4], cnt, next, keep, filt, vol[4], tgt, s, smp, last, act;
+    int f,g,ch,fetch,mask;
+
+    for(f=0;f<frames;f++)
+    {
+        for(ch=0;ch<4;ch++)
+            acc[ch] = _mm_setzero_si128();
+
+        for(g=0;g<C352_VOICES;g+=4)
+        {
+            // idle voices in the group are left as they are
+            mask = (c->active>>g) & 0x0f;
+            if(!mask)
+                continue;
+            act = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask),lane),lane);
+
+            cnt = _mm_loadu_si128((__m128i*)(b->counter+g));
+            next = _mm_add_epi32(cnt,_mm_loadu_si128((__m128i*)(b->freq+g)));
+
+            fetch = _mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(next,15))) & mask;
+            while(fetch)
+            {
+                C352_block_fetch(c,b,g+__builtin_ctz(fetch));
+                fetch &= fetch-1;
+            }
+
+            // volume ramp
+            keep = _mm_cmpeq_epi32(_mm_and_si128(_mm_xor_si128(next,cnt),vol_mask),_mm_setzero_si128());
+            keep = _mm_or_si128(keep,_mm_xor_si128(act,m_one));
+            filt = _mm_loadu_si128((__m128i*)(b->filter+g));
+            for(ch=0;ch<4;ch++)
+            {
+                vol[ch] = _mm_loadu_si128((__m128i*)(b->vol[ch]+g));
+                tgt = _mm_loadu_si128((__m128i*)(b->target[ch]+g));
+                s = _mm_min_epi32(_mm_max_epi32(_mm_sub_epi32(tgt,vol[ch]),m_one),one);
+                s = _mm_blendv_epi8(_mm_add_epi32(vol[ch],s),tgt,filt);
+                vol[ch] = _mm_blendv_epi8(s,vol[ch],keep);
+                _mm_storeu_si128((__m128i*)(b->vol[ch]+g),vol[ch]);
+            }
+
+            cnt = _mm_blendv_epi8(cnt,_mm_and_si128(next,cnt_mask),act);
+            _mm_storeu_si128((__m128i*)(b->counter+g),cnt);
+
+            // interpolation
+            smp = _mm_loadu_si128((__m128i*)(b->sample+g));
+            last = _mm_loadu_si128((__m128i*)(b->last_sample+g));
+            s = _mm_add_epi32(last,_mm_srai_epi32(_mm_mullo_epi32(cnt,_mm_sub_epi32(smp,last)),16));
+            s = _mm_blendv_epi8(s,smp,filt);
+            s = _mm_srai_epi32(_mm_slli_epi32(s,16),16);
+
+            for(ch=0;ch<4;ch++)
+            {
+                tgt = _mm_sign_epi32(s,_mm_loadu_si128((__m128i*)(b->sign[ch]+g)));
+                acc[ch] = _mm_add_epi32(acc[ch],_mm_mullo_epi32(tgt,vol[ch]));
+            }
+        }
+
+        acc[0] = _mm_hadd_epi32(acc[0],acc[1]);
+        acc[2] = _mm_hadd_epi32(acc[2],acc[3]);
+        _mm_storeu_si128((__m128i*)(buf+f*4),_mm_hadd_epi32(acc[0],acc[2]));
+        c->time++;
+    }
+}
+
+__attribute__((target("avx2")))
+static void C352_render_avx2(C352 *c,C352_Block *b,int32_t *buf,int frames)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i m_one = _mm256_set1_epi32(-1);
+    const __m256i vol_mask = _mm256_set1_epi32(0x18000);
+    const __m256i cnt_mask = _mm256_set1_epi32(0xffff);
+    const __m256i lane = _mm256_setr_epi32(1,2,4,8,16,32,64,128);
+    __m256i acc[4], cnt, next, keep, filt, vol[4], tgt, s, smp, last, act;
+    int f,g,ch,fetch,mask;
+
+    for(f=0;f<frames;f++)
+    {
+        for(ch=0;ch<4;ch++)
+            acc[ch] = _mm256_setzero_si256();
+
+        for(g=0;g<C352_VOICES;g+=8)
+        {
+            // idle voices in the group are left as they are
+            mask = (c->active>>g) & 0xff;
+            if(!mask)
+                continue;
+            act = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(mask),lane),lane);
+
+            cnt = _mm256_loadu_si256((__m256i*)(b->counter+g));
+            next = _mm256_add_epi32(cnt,_mm256_loadu_si256((__m256i*)(b->freq+g)));
+
+            fetch = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(next,15))) & mask;
+            while(fetch)
+            {
+                C352_block_fetch(c,b,g+__builtin_ctz(fetch));
+                fetch &= fetch-1;
+            }
+
+            // volume ramp
+            keep = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_xor_si256(next,cnt),vol_mask),_mm256_setzero_si256());
+            keep = _mm256_or_si256(keep,_mm256_xor_si256(act,m_one));
+            filt = _mm256_loadu_si256((__m256i*)(b->filter+g));
+            for(ch=0;ch<4;ch++)
+            {
+                vol[ch] = _mm256_loadu_si256((__m256i*)(b->vol[ch]+g));
+                tgt = _mm256_loadu_si256((__m256i*)(b->target[ch]+g));
+                s = _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(tgt,vol[ch]),m_one),one);
+                s = _mm256_blendv_epi8(_mm256_add_epi32(vol[ch],s),tgt,filt);
+                vol[ch] = _mm256_blendv_epi8(s,vol[ch],keep);
+                _mm256_storeu_si256((__m256i*)(b->vol[ch]+g),vol[ch]);
+            }
+
+            cnt = _mm256_blendv_epi8(cnt,_mm256_and_si256(next,cnt_mask),act);
+            _mm256_storeu_si256((__m256i*)(b->counter+g),cnt);
+
+            // interpolation
+            smp = _mm256_loadu_si256((__m256i*)(b->sample+g));
+            last = _mm256_loadu_si256((__m256i*)(b->last_sample+g));
+            s = _mm256_add_epi32(last,_mm256_srai_epi32(_mm256_mullo_epi32(cnt,_mm256_sub_epi32(smp,last)),16));
+            s = _mm256_blendv_epi8(s,smp,filt);
+            s = _mm256_srai_epi32(_mm256_slli_epi32(s,16),16);
+
+            for(ch=0;ch<4;ch++)
+            {
+                tgt = _mm256_sign_epi32(s,_mm256_loadu_si256((__m256i*)(b->sign[ch]+g)));
+                acc[ch] = _mm256_add_epi32(acc[ch],_mm256_mullo_epi32(tgt,vol[ch]));
+            }
+        }
+
+        acc[0] = _mm256_hadd_epi32(acc[0],acc[1]);
+        acc[2] = _mm256_hadd_epi32(acc[2],acc[3]);
+        acc[0] = _mm256_hadd_epi32(acc[0],acc[2]);
+        _mm_storeu_si128((__m128i*)(buf+f*4),
+                         _mm_add_epi32(_mm256_castsi256_si128(acc[0]),_mm256_extracti128_si256(acc[0],1)));
+        c->time++;
+    }
+}
+#endif
+
+void C352_render(C352 *c,int32_t *buf,int frames)
+{
+    int i;
+    C352_Block b;
+
+    if(frames < 1)
+        return;
+
+    if(c->core == C352_CORE_SCALAR)
+    {
+        for(i=0;i<frames;i++)
+        {
+            C352_update(c);
+            buf[i*4+0] = c->out[0];
+            buf[i*4+1] = c->out[1];
+            buf[i*4+2] = c->out[2];
+            buf[i*4+3] = c->out[3];
+        }
+        return;
+    }
+
+    C352_block_load(c,&b);
+#ifdef C352_X86
+    if(c->core == C352_CORE_AVX2)
+        C352_render_avx2(c,&b,buf,frames);
+    else
+        C352_render_sse41(c,&b,buf,frames);
+#endif
+    C352_block_store(c,&b);
+
+    buf += (frames-1)*4;
+    for(i=0;i<4;i++)
+        c->out[i] = buf[i];
 }
@@ -9,7 +9,10 @@
 
 #include <stdint.h>
 
+#include "../lib/vgm.h"
+
 #define C352_VOICES 32
+#define C352_BLOCK 256 // buffer size used by drivers for C352_render
 
 enum {
     C352_VOL_FRONT  = 0,
@@ -47,6 +50,14 @@ enum {
     C352_MULAW_TYPE_C140, // simulate C140 mulaw samples
 };
 
+// voice processing core used by C352_render
+enum {
+    C352_CORE_AUTO = 0, // best supported
+    C352_CORE_SCALAR,
+    C352_CORE_SSE41,
+    C352_CORE_AVX2,
+};
+
 typedef struct {
 
     uint16_t latch_flags;
@@ -70,14 +81,32 @@ typedef struct {
     uint16_t wave_end;
     uint16_t wave_loop;
 
+    uint64_t sync; // while idle, sample the counter and volume are current at
+
+    // last used sample cache page
+    const int16_t* cache_page;
+    uint32_t cache_key;
+    uint32_t cache_gen;
+
 } C352_Voice;
 
+#define C352_CACHE_PAGE_BITS 12 // samples per decoded page (log2)
+
 typedef struct {
 
     uint32_t rate;
 
     C352_Voice v[C352_VOICES];
-    double out[4];
+    int32_t out[4]; // fixed point, 1.0 = 1<<28
+
+    // Voices that may produce output. A voice is added on key on or when
+    // BUSY is written, and removed once it is no longer busy and its
+    // interpolated output has reached zero. The counter and volume ramp of
+    // idle voices are not updated while rendering. They are brought up to
+    // date when the voice is written, so the output is the same as if
+    // every voice was updated.
+    uint32_t active;
+    uint64_t time; // samples rendered
 
     uint16_t control1; // unknown purpose for both
     uint16_t control2;
@@ -92,17 +121,41 @@ typedef struct {
     // special
     uint32_t mute_mask;
     uint8_t mute_rear;
-    int vgm_log;
+    QP_Vgm* vgm; // VGM log, NULL if not logging
     int mulaw_type;
+    int core;
+
+    // Decoded sample cache (optional). Wave ROM pages are decoded to
+    // 16-bit when first played, separately for linear and mu-law.
+    int16_t** cache_table; // decoded page for each ROM page and format
+    int16_t* cache_pool;
+    uint32_t cache_max;  // pages in the pool
+    uint32_t cache_used;
+    uint32_t cache_gen;  // incremented when the cache is flushed
+    uint32_t cache_hits; // samples read from an already decoded page
+    uint32_t cache_misses; // pages decoded (one sample read each)
 
 } C352;
 
 int C352_init(C352 *c,uint32_t clk);
 void C352_set_mulaw_type(C352 *c,int mulaw_type);
 
+// enable the sample cache, set wave and wave_mask before calling this.
+// size is the decoded size limit in bytes, the cache is flushed when full.
+int C352_cache_init(C352 *c,uint32_t size);
+void C352_cache_free(C352 *c);
+void C352_cache_flush(C352 *c);
+
+// select the core used by C352_render, returns the selected core
+int C352_set_core(C352 *c,int core);
+
 // run this at the rate specified in C352_rate (hz)
 void C352_update(C352 *c);
 
+// run for a block of samples. writes 4 channels per sample to buf, these
+// are the same values as out[] would have after each C352_update call.
+void C352_render(C352 *c,int32_t *buf,int frames);
+
 void C352_write(C352 *c, uint16_t addr, uint16_t data);
 uint16_t C352_read(C352 *c, uint16_t addr);
 
@@ -12,6 +12,11 @@
 
 #include "ym2151.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define YM2151_X86 1
+#include <immintrin.h>
+#endif
+
 enum {
     YM2151_RATE_STEPS = 8,
     YM2151_TL_RES_LEN = 256, /* 8 bits addressing (real chip) */
@@ -324,7 +329,7 @@ static int tl_tab[YM2151_TL_TAB_LEN];
 static unsigned int sin_tab[YM2151_SIN_LEN];
 static uint32_t d1l_tab[16];
 
-void init_tables()
+static void init_tables()
 {
     int i,j;
     int x;
@@ -473,6 +478,8 @@ void YM2151_envelope_KONKOFF(YM2151* ym,YM2151Operator * op, int v)
 	// m1, m2, c1, c2
 	static uint8_t masks[4] = { 0x08, 0x20, 0x10, 0x40 };
 	int i;
+	if (v & 0x78)
+		ym->chan_active |= 1<<(v&7);
 	for(i=0; i != 4; i++)
 		if (v & masks[i]) /* M1 */
 			YM2151Operator_key_on(op+i,1, ym->eg_cnt);
@@ -481,6 +488,24 @@ void YM2151_envelope_KONKOFF(YM2151* ym,YM2151Operator * op, int v)
 }
 
 
+/* connection targets, as bits in the SIMD core routing table */
+enum {
+	YM2151_ROUTE_M2  = 1<<0,
+	YM2151_ROUTE_C1  = 1<<1,
+	YM2151_ROUTE_C2  = 1<<2,
+	YM2151_ROUTE_MEM = 1<<3,
+	YM2151_ROUTE_OUT = 1<<4
+};
+
+static int32_t YM2151_route(YM2151* ym,signed int *connect)
+{
+	if (connect == &ym->m2)  return YM2151_ROUTE_M2;
+	if (connect == &ym->c1)  return YM2151_ROUTE_C1;
+	if (connect == &ym->c2)  return YM2151_ROUTE_C2;
+	if (connect == &ym->mem) return YM2151_ROUTE_MEM;
+	return YM2151_ROUTE_OUT;
+}
+
 void YM2151_set_connect(YM2151* ym,YM2151Operator *om1, int cha, int v)
 {
 	YM2151Operator *om2 = om1+1;
@@ -570,6 +595,12 @@ void YM2151_set_connect(YM2151* ym,YM2151Operator *om1, int cha, int v)
 		om1->mem_connect = &ym->mem;   /* store it anywhere where it will not be used */
 		break;
 	}
+
+	ym->route[0][cha] = YM2151_route(ym,om1->mem_connect);
+	ym->route[1][cha] = om1->connect ? YM2151_route(ym,om1->connect)
+	                                 : YM2151_ROUTE_C1|YM2151_ROUTE_C2|YM2151_ROUTE_MEM;
+	ym->route[2][cha] = YM2151_route(ym,om2->connect);
+	ym->route[3][cha] = YM2151_route(ym,oc1->connect);
 }
 
 
@@ -662,6 +693,8 @@ void YM2151_refresh_EG(YM2151* ym,YM2151Operator * op)
 	op->eg_sel_rr = eg_rate_select[op->rr  + v];
 }
 
+static void YM2151_sync(YM2151* ym);
+
 
 /* write a register on YM2151 chip number 'n' */
 void YM2151_write_reg(YM2151* ym,int r, int v)
@@ -672,6 +705,8 @@ void YM2151_write_reg(YM2151* ym,int r, int v)
 	r &= 0xff;
 	v &= 0xff;
 
+	YM2151_sync(ym);
+
 #if 0
 	/* There is no info on what YM2151 really does when busy flag is set */
 	if ( status & 0x80 ) return;
@@ -1105,10 +1140,253 @@ void YM2151_chan7_calc(YM2151 *ym)
 }
 
 
+#ifdef YM2151_X86
+/*
+    SIMD operator core
+
+    The operators of a channel depend on each other, so the channels are
+    processed in parallel instead, one channel per lane. The operator data
+    is gathered into arrays by channel when registers have been written.
+    While the SIMD core runs, the phase, feedback and MEM values are kept
+    in those arrays and written back to the operators before the next
+    register write. Idle channels are calculated too, they only output
+    zero. Output is identical to the scalar code.
+*/
+#define YM2151_LOAD(x) _mm256_loadu_si256((const __m256i*)(x))
+#define YM2151_STORE(x,v) _mm256_storeu_si256((__m256i*)(x),v)
+#define YM2151_GATHER(field) _mm256_i32gather_epi32((const int*)&(field),offset,1)
+
+/* copy the operator data to the SIMD core */
+__attribute__((target("avx2")))
+static void YM2151_load_avx2(YM2151* ym)
+{
+	const int sz = sizeof(YM2151Operator);
+	const __m256i offset = _mm256_setr_epi32(0,4*sz,8*sz,12*sz,16*sz,20*sz,24*sz,28*sz);
+	YM2151Operator *op = ym->oper;
+	int i;
+	for(i=0;i<4;i++)
+	{
+		YM2151_STORE(ym->simd_phase[i],YM2151_GATHER(op[i].phase));
+		YM2151_STORE(ym->simd_freq[i],YM2151_GATHER(op[i].freq));
+		YM2151_STORE(ym->simd_dt1[i],YM2151_GATHER(op[i].dt1));
+		YM2151_STORE(ym->simd_dt2[i],YM2151_GATHER(op[i].dt2));
+		YM2151_STORE(ym->simd_mul[i],YM2151_GATHER(op[i].mul));
+		YM2151_STORE(ym->simd_tl[i],YM2151_GATHER(op[i].tl));
+		YM2151_STORE(ym->simd_am_mask[i],YM2151_GATHER(op[i].AMmask));
+	}
+	YM2151_STORE(ym->simd_ams,YM2151_GATHER(op[0].ams));
+	YM2151_STORE(ym->simd_pms,YM2151_GATHER(op[0].pms));
+	YM2151_STORE(ym->simd_kc_i,YM2151_GATHER(op[0].kc_i));
+	YM2151_STORE(ym->simd_fb_shift,YM2151_GATHER(op[0].fb_shift));
+	YM2151_STORE(ym->simd_fb_prev,YM2151_GATHER(op[0].fb_out_prev));
+	YM2151_STORE(ym->simd_fb_curr,YM2151_GATHER(op[0].fb_out_curr));
+	YM2151_STORE(ym->simd_mem,YM2151_GATHER(op[0].mem_value));
+	for(i=0;i<8;i++)
+	{
+		ym->simd_pan[0][i] = ym->pan[i*2];
+		ym->simd_pan[1][i] = ym->pan[i*2+1];
+	}
+	ym->simd_dirty = 0;
+}
+
+/* write the values updated by the SIMD core back to the operators */
+static void YM2151_store_avx2(YM2151* ym)
+{
+	YM2151Operator *op = ym->oper;
+	int i,ch;
+	for(ch=0;ch<8;ch++)
+	{
+		for(i=0;i<4;i++)
+			op[ch*4+i].phase = ym->simd_phase[i][ch];
+		op[ch*4].fb_out_prev = ym->simd_fb_prev[ch];
+		op[ch*4].fb_out_curr = ym->simd_fb_curr[ch];
+		op[ch*4].mem_value = ym->simd_mem[ch];
+	}
+}
+
+/* same as YM2151_op_calc1, an attenuation over ENV_QUIET always gives 0 */
+__attribute__((target("avx2")))
+static inline __m256i YM2151_op_calc_avx2(__m256i phase,__m256i env,__m256i pm)
+{
+	__m256i i = _mm256_srai_epi32(_mm256_add_epi32(phase,pm),FREQ_SH);
+	i = _mm256_and_si256(i,_mm256_set1_epi32(YM2151_SIN_MASK));
+	__m256i p = _mm256_add_epi32(_mm256_slli_epi32(env,3),_mm256_i32gather_epi32((const int*)sin_tab,i,4));
+	__m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(YM2151_TL_TAB_LEN),p);
+	return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),tl_tab,p,valid,4);
+}
+
+/* add an operator output to the inputs it is connected to */
+__attribute__((target("avx2")))
+static inline void YM2151_connect_avx2(__m256i* bus,const int32_t* route,__m256i out)
+{
+	__m256i r = YM2151_LOAD(route);
+	__m256i bit;
+	int i;
+	for(i=0;i<5;i++)
+	{
+		bit = _mm256_set1_epi32(1<<i);
+		bit = _mm256_cmpeq_epi32(_mm256_and_si256(r,bit),bit);
+		bus[i] = _mm256_add_epi32(bus[i],_mm256_and_si256(out,bit));
+	}
+}
+
+__attribute__((target("avx2")))
+static inline int YM2151_sum_avx2(__m256i v)
+{
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),_mm256_extracti128_si256(v,1));
+	s = _mm_add_epi32(s,_mm_shuffle_epi32(s,_MM_SHUFFLE(1,0,3,2)));
+	s = _mm_add_epi32(s,_mm_shuffle_epi32(s,_MM_SHUFFLE(2,3,0,1)));
+	return _mm_cvtsi128_si32(s);
+}
+
+/* calculate all channels and mix them, like the scalar code in YM2151_calc_sample */
+__attribute__((target("avx2")))
+static void YM2151_calc_avx2(YM2151* ym,int* l,int* r)
+{
+	const int sz = sizeof(YM2151Operator);
+	const __m256i offset = _mm256_setr_epi32(0,4*sz,8*sz,12*sz,16*sz,20*sz,24*sz,28*sz);
+	const __m256i phase_mask = _mm256_set1_epi32(~FREQ_MASK);
+	const __m256i bits = _mm256_setr_epi32(1,2,4,8,16,32,64,128);
+	YM2151Operator *op = ym->oper;
+	__m256i bus[5]; /* m2, c1, c2, mem, out (same order as YM2151_ROUTE_*) */
+	__m256i am, env[4], phase[4], prev, out, pm, shift, mute;
+	int32_t env7[8];
+	int i;
+
+	if (ym->simd_dirty)
+		YM2151_load_avx2(ym);
+
+	/* AMS 0 gives a shift count of -1, so no AM */
+	am = _mm256_sub_epi32(YM2151_LOAD(ym->simd_ams),_mm256_set1_epi32(1));
+	am = _mm256_sllv_epi32(_mm256_set1_epi32(ym->lfa),am);
+
+	/* everything that does not depend on the other operators */
+	for(i=0;i<4;i++)
+	{
+		env[i] = _mm256_add_epi32(YM2151_LOAD(ym->simd_tl[i]),YM2151_GATHER(op[i].volume));
+		env[i] = _mm256_add_epi32(env[i],_mm256_and_si256(am,YM2151_LOAD(ym->simd_am_mask[i])));
+		phase[i] = _mm256_and_si256(YM2151_LOAD(ym->simd_phase[i]),phase_mask);
+	}
+	prev = YM2151_LOAD(ym->simd_fb_curr);
+	out = _mm256_add_epi32(YM2151_LOAD(ym->simd_fb_prev),prev);
+	shift = YM2151_LOAD(ym->simd_fb_shift);
+
+	for(i=0;i<5;i++)
+		bus[i] = _mm256_setzero_si256();
+
+	/* restore delayed sample (MEM) value to m2 or c2 */
+	YM2151_connect_avx2(bus,ym->route[0],YM2151_LOAD(ym->simd_mem));
+
+	/* M1 */
+	YM2151_connect_avx2(bus,ym->route[1],prev);
+	pm = _mm256_andnot_si256(_mm256_cmpeq_epi32(shift,_mm256_setzero_si256()),_mm256_sllv_epi32(out,shift));
+	YM2151_STORE(ym->simd_fb_prev,prev);
+	YM2151_STORE(ym->simd_fb_curr,YM2151_op_calc_avx2(phase[0],env[0],pm));
+
+	/* M2 */
+	out = YM2151_op_calc_avx2(phase[1],env[1],_mm256_slli_epi32(bus[0],15));
+	YM2151_connect_avx2(bus,ym->route[2],out);
+
+	/* C1 */
+	out = YM2151_op_calc_avx2(phase[2],env[2],_mm256_slli_epi32(bus[1],15));
+	YM2151_connect_avx2(bus,ym->route[3],out);
+
+	/* C2 */
+	out = YM2151_op_calc_avx2(phase[3],env[3],_mm256_slli_epi32(bus[2],15));
+	if (ym->noise & 0x80)
+	{
+		uint32_t noiseout = 0;
+		YM2151_STORE(env7,env[3]);
+		if ((uint32_t)env7[7] < 0x3ff)
+			noiseout = (env7[7] ^ 0x3ff) * 2;
+		out = _mm256_insert_epi32(out,(ym->noise_rng&0x10000) ? noiseout : -noiseout,7);
+	}
+	out = _mm256_add_epi32(bus[4],out);
+	YM2151_STORE(ym->simd_mem,bus[3]);
+
+	/* clip, mute and pan */
+	out = _mm256_max_epi32(_mm256_min_epi32(out,_mm256_set1_epi32(16383)),_mm256_set1_epi32(-16384));
+	mute = _mm256_and_si256(_mm256_set1_epi32(ym->mute_mask),bits);
+	out = _mm256_andnot_si256(_mm256_cmpeq_epi32(mute,bits),out);
+	*l = YM2151_sum_avx2(_mm256_and_si256(out,YM2151_LOAD(ym->simd_pan[0])));
+	*r = YM2151_sum_avx2(_mm256_and_si256(out,YM2151_LOAD(ym->simd_pan[1])));
+}
+
+/* phase generator, idle channels are skipped like in the scalar code */
+__attribute__((target("avx2")))
+static void YM2151_phase_avx2(YM2151* ym)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i bits = _mm256_setr_epi32(1,2,4,8,16,32,64,128);
+	__m256i active, pms, mod, use_pm, kc, inc, pm_inc;
+	int i;
+
+	if (ym->simd_dirty)
+		YM2151_load_avx2(ym);
+
+	active = _mm256_and_si256(_mm256_set1_epi32(ym->chan_active),bits);
+	active = _mm256_cmpeq_epi32(active,bits);
+
+	/* LFO phase modulation, -128..+127 scaled by PMS */
+	pms = YM2151_LOAD(ym->simd_pms);
+	mod = _mm256_set1_epi32(ym->lfp);
+	mod = _mm256_blendv_epi8(_mm256_sllv_epi32(mod,_mm256_sub_epi32(pms,_mm256_set1_epi32(5))),
+	                         _mm256_srav_epi32(mod,_mm256_sub_epi32(_mm256_set1_epi32(6),pms)),
+	                         _mm256_cmpgt_epi32(_mm256_set1_epi32(6),pms));
+	use_pm = _mm256_or_si256(_mm256_cmpeq_epi32(pms,zero),_mm256_cmpeq_epi32(mod,zero));
+	use_pm = _mm256_andnot_si256(use_pm,active);
+	kc = _mm256_add_epi32(YM2151_LOAD(ym->simd_kc_i),mod);
+
+	for(i=0;i<4;i++)
+	{
+		inc = YM2151_LOAD(ym->simd_freq[i]);
+		if (!_mm256_testz_si256(use_pm,use_pm))
+		{
+			pm_inc = _mm256_add_epi32(kc,YM2151_LOAD(ym->simd_dt2[i]));
+			pm_inc = _mm256_mask_i32gather_epi32(zero,(const int*)freq,pm_inc,use_pm,4);
+			pm_inc = _mm256_add_epi32(pm_inc,YM2151_LOAD(ym->simd_dt1[i]));
+			pm_inc = _mm256_srli_epi32(_mm256_mullo_epi32(pm_inc,YM2151_LOAD(ym->simd_mul[i])),1);
+			inc = _mm256_blendv_epi8(inc,pm_inc,use_pm);
+		}
+		inc = _mm256_add_epi32(YM2151_LOAD(ym->simd_phase[i]),_mm256_and_si256(inc,active));
+		YM2151_STORE(ym->simd_phase[i],inc);
+	}
+}
+#endif
+
+/* Called before the operators are changed. If the SIMD core is in use,
+** the operators are updated and the SIMD core reloads them later. */
+static void YM2151_sync(YM2151* ym)
+{
+#ifdef YM2151_X86
+	if (ym->core == YM2151_CORE_AVX2 && !ym->simd_dirty)
+		YM2151_store_avx2(ym);
+#endif
+	ym->simd_dirty = 1;
+}
+
+/* The SIMD core always calculates all channels, with only a few active
+** channels the scalar code is faster. */
+#define YM2151_SIMD_MIN_CHANNELS 6
+
+static int YM2151_use_simd(YM2151* ym)
+{
+#ifdef YM2151_X86
+	if (ym->core == YM2151_CORE_AVX2)
+	{
+		if (__builtin_popcount(ym->chan_active) >= YM2151_SIMD_MIN_CHANNELS)
+			return 1;
+		YM2151_sync(ym);
+	}
+#endif
+	return 0;
+}
+
 void YM2151_advance_eg(YM2151* ym)
 {
 	YM2151Operator *op;
 	unsigned int i;
+	uint32_t ops;
 
 	ym->eg_timer += ym->eg_timer_add;
 
@@ -1118,10 +1396,16 @@ void YM2151_advance_eg(YM2151* ym)
 
 		ym->eg_cnt++;
 
-		/* envelope generator */
-		for(i=0;i<32;i++)
+		/* envelope generator, operators in idle channels are all in EG_OFF */
+		ops = 0;
+		for(i=0;i<8;i++)
+			if (ym->chan_active & 1<<i)
+				ops |= 0xf<<(i*4);
+		while(ops)
         {
-            op = &ym->oper[i]; /* CH 0 M1 */
+            i = __builtin_ctz(ops);
+            ops &= ops-1;
+            op = &ym->oper[i];
 
 			switch(op->state)
 			{
@@ -1161,6 +1445,7 @@ void YM2151_advance_eg(YM2151* ym)
 					{
 						op->volume = MAX_ATT_INDEX;
 						op->state = EG_OFF;
+						ym->chan_check |= 1<<(i>>2);
 					}
 
 				}
@@ -1175,6 +1460,7 @@ void YM2151_advance_eg(YM2151* ym)
 					{
 						op->volume = MAX_ATT_INDEX;
 						op->state = EG_OFF;
+						ym->chan_check |= 1<<(i>>2);
 					}
 
 				}
@@ -1188,6 +1474,7 @@ void YM2151_advance_eg(YM2151* ym)
 void YM2151_advance(YM2151 *ym)
 {
 	YM2151Operator *op;
+	uint32_t active;
 	unsigned int i;
 	int a,p;
 
@@ -1289,11 +1576,21 @@ void YM2151_advance(YM2151 *ym)
 
 
 	/* phase generator */
+#ifdef YM2151_X86
+	if (YM2151_use_simd(ym))
+		YM2151_phase_avx2(ym);
+	else
+#endif
+	{
+	active = ym->chan_active;
 	op = &ym->oper[0]; /* CH 0 M1 */
 	i = 8;
 	do
 	{
-		if (op->pms)    /* only when phase modulation from LFO is enabled for this channel */
+		/* idle channels can only leave EG_OFF by a key on, which clears the phase */
+		if (!(active & 1<<(8-i)))
+			;
+		else if (op->pms)    /* only when phase modulation from LFO is enabled for this channel */
 		{
 			int32_t mod_ind = ym->lfp;       /* -128..+127 (8bits signed) */
 			if (op->pms < 6)
@@ -1328,6 +1625,7 @@ void YM2151_advance(YM2151 *ym)
 		op+=4;
 		i--;
 	}while (i);
+	}
 
 
 	/* CSM is calculated *after* the phase generator calculations (verified on real chip)
@@ -1343,6 +1641,8 @@ void YM2151_advance(YM2151 *ym)
 	{
 		if (ym->csm_req==2)    /* KEY ON */
 		{
+			ym->chan_active = 0xff;
+			YM2151_sync(ym);
 			op = &ym->oper[0]; /* CH 0 M1 */
 			i = 32;
 			do
@@ -1372,9 +1672,28 @@ void YM2151_advance(YM2151 *ym)
 //  device_reset - device-specific reset
 //-------------------------------------------------
 
+// The tables are shared by all chip instances. They are built by the first
+// call to YM2151_init, other threads initializing a chip wait until done.
+static int tables_state; // 0 = not built, 1 = building, 2 = done
+
+static void YM2151_init_tables()
+{
+    int expected = 0;
+    if(__atomic_load_n(&tables_state,__ATOMIC_ACQUIRE) == 2)
+        return;
+    if(__atomic_compare_exchange_n(&tables_state,&expected,1,0,__ATOMIC_ACQUIRE,__ATOMIC_ACQUIRE))
+    {
+        init_tables();
+        __atomic_store_n(&tables_state,2,__ATOMIC_RELEASE);
+        return;
+    }
+    while(__atomic_load_n(&tables_state,__ATOMIC_ACQUIRE) != 2)
+        ;
+}
+
 void YM2151_init(YM2151* ym,int clk)
 {
-	init_tables();
+	YM2151_init_tables();
     ym->rate = clk/64;
 
 	//m_stream = stream_alloc(0, 2, clock() / 64);
@@ -1395,13 +1714,34 @@ void YM2151_init(YM2151* ym,int clk)
 		YM2151_set_connect(ym,&ym->oper[i*4], i, ym->connect[i]);
 
     ym->mute_mask=0;
+    ym->simd_dirty=1;
+    YM2151_set_core(ym,YM2151_CORE_AUTO);
+    ym->chan_active=0xff;
+    ym->chan_check=0xff;
 
 }
 
 
+int YM2151_set_core(YM2151* ym,int core)
+{
+    int best = YM2151_CORE_SCALAR;
+#ifdef YM2151_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        best = YM2151_CORE_AVX2;
+#endif
+    if(core == YM2151_CORE_AUTO || core > best)
+        core = best;
+    YM2151_sync(ym);
+    ym->core = core;
+    return core;
+}
+
 void YM2151_reset(YM2151* ym)
 {
 	int i;
+	/* the SIMD core state is discarded, not written back */
+	ym->simd_dirty = 1;
 	/* initialize hardware registers */
 	for (i=0; i<32; i++)
 	{
@@ -1440,6 +1780,8 @@ void YM2151_reset(YM2151* ym)
 
 	ym->csm_req   = 0;
 	ym->status    = 0;
+	ym->chan_active = 0xff;
+	ym->chan_check = 0xff;
 
 	YM2151_write_reg(ym, 0x1b, 0);    /* only because of CT1, CT2 output pins */
 	YM2151_write_reg(ym, 0x18, 0);    /* set LFO frequency */
@@ -1452,29 +1794,74 @@ void YM2151_reset(YM2151* ym)
 }
 
 
-void YM2151_update(YM2151* ym)
+static int YM2151_chan_off(YM2151* ym,unsigned int chan)
 {
-    YM2151_advance_eg(ym);
+	YM2151Operator *op = &ym->oper[chan*4];
+	return op[0].state == EG_OFF && op[1].state == EG_OFF &&
+		op[2].state == EG_OFF && op[3].state == EG_OFF;
+}
 
-    int ch;
-    for(ch=0; ch<8; ch++)
-        ym->chanout[ch] = 0;
+/* A channel is idle when all operators are off and the feedback and MEM
+** values have decayed. Calculating it would only output zero. */
+static int YM2151_chan_idle(YM2151* ym,unsigned int chan)
+{
+	YM2151Operator *op = &ym->oper[chan*4];
+#ifdef YM2151_X86
+	if (ym->core == YM2151_CORE_AVX2 && !ym->simd_dirty)
+		return YM2151_chan_off(ym,chan) &&
+			!ym->simd_fb_prev[chan] && !ym->simd_fb_curr[chan] && !ym->simd_mem[chan];
+#endif
+	return YM2151_chan_off(ym,chan) &&
+		!op->fb_out_prev && !op->fb_out_curr && !op->mem_value;
+}
 
-    for(ch=0; ch<7; ch++)
-        YM2151_chan_calc(ym,ch);
-    YM2151_chan7_calc(ym);
+static void YM2151_calc_sample(YM2151* ym,int* l,int* r)
+{
+    YM2151_advance_eg(ym);
 
+    int ch;
     int outl = 0;
     int outr = 0;
-    int32_t out = 0;
-    for(ch=0; ch<8; ch++) {
-        if(!(ym->mute_mask & 1<<ch))
+#ifdef YM2151_X86
+    if(YM2151_use_simd(ym))
+        YM2151_calc_avx2(ym,&outl,&outr);
+    else
+#endif
+    {
+        uint32_t active = ym->chan_active;
+        for(ch=0; ch<8; ch++)
+            ym->chanout[ch] = 0;
+        for(ch=0; ch<7; ch++)
+            if(active & 1<<ch)
+                YM2151_chan_calc(ym,ch);
+        if(active & 0x80)
+            YM2151_chan7_calc(ym);
+
+        int32_t out = 0;
+        for(ch=0; ch<8; ch++) {
+            if(!(ym->mute_mask & 1<<ch))
+            {
+                out = ym->chanout[ch];
+                if(out > 16383 || out < -16384)
+                    out = 16383^(out>>31);
+                outl += out & ym->pan[2*ch];
+                outr += out & ym->pan[2*ch+1];
+            }
+        }
+    }
+
+    // only channels where an operator has recently turned off can go idle
+    uint32_t check = ym->chan_check;
+    while(check)
+    {
+        ch = __builtin_ctz(check);
+        check &= check-1;
+        if(!YM2151_chan_off(ym,ch))
+            ym->chan_check &= ~(1<<ch);
+        else if(YM2151_chan_idle(ym,ch))
         {
-            out = ym->chanout[ch];
-            if(out > 16383 || out < -16384)
-                out = 16383^(out>>31);
-            outl += out & ym->pan[2*ch];
-            outr += out & ym->pan[2*ch+1];
+            ym->chan_active &= ~(1<<ch);
+            ym->chan_check &= ~(1<<ch);
         }
     }
 
@@ -1487,6 +1874,15 @@ void YM2151_update(YM2151* ym)
     else if (outr < -32768)
         outr = -32768;
 
+    *l = outl;
+    *r = outr;
+}
+
+void YM2151_update(YM2151* ym)
+{
+    int outl, outr;
+    YM2151_calc_sample(ym,&outl,&outr);
+
     // last samples, used for interpolation
     ym->out[2] = ym->out[0];
     ym->out[3] = ym->out[1];
@@ -1498,4 +1894,21 @@ void YM2151_update(YM2151* ym)
     YM2151_advance(ym);
 }
 
-
+void YM2151_render(YM2151* ym,int32_t* out,int frames)
+{
+    int i, outl, outr;
+    if(frames < 1)
+        return;
+    for(i=0; i<frames; i++)
+    {
+        YM2151_calc_sample(ym,&outl,&outr);
+        *out++ = outl;
+        *out++ = outr;
+        YM2151_advance(ym);
+    }
+    out -= 2;
+    ym->out[2] = frames > 1 ? out[-2]/32768.0 : ym->out[0];
+    ym->out[3] = frames > 1 ? out[-1]/32768.0 : ym->out[1];
+    ym->out[0] = out[0]/32768.0;
+    ym->out[1] = out[1]/32768.0;
+}
@@ -54,6 +54,13 @@ enum {
 ** Ishmair - for the datasheet and motivation.
 */
 
+// operator processing core
+enum {
+    YM2151_CORE_AUTO = 0, // best supported
+    YM2151_CORE_SCALAR,
+    YM2151_CORE_AVX2,
+};
+
 enum {
     YM2151_TIMER_IRQ_A_OFF,
     YM2151_TIMER_IRQ_B_OFF,
@@ -166,13 +173,35 @@ struct YM2151
 	uint32_t      timer_B_index_old;      /* timer B previous index */
 
     uint32_t mute_mask;
+    uint32_t chan_active;   /* channels that may produce output, idle channels are skipped */
+    uint32_t chan_check;    /* channels to check for idle state */
+    int core;
+
+    /* SIMD core state, operator data by channel. Reloaded from the operators
+    ** after register writes, the feedback and MEM values are kept here. */
+    int32_t route[4][8];    /* connections (MEM, M1, M2, C1) */
+    int32_t simd_phase[4][8];
+    int32_t simd_freq[4][8];
+    int32_t simd_dt1[4][8];
+    int32_t simd_dt2[4][8];
+    int32_t simd_mul[4][8];
+    int32_t simd_tl[4][8];
+    int32_t simd_am_mask[4][8];
+    int32_t simd_ams[8];
+    int32_t simd_pms[8];
+    int32_t simd_kc_i[8];
+    int32_t simd_fb_shift[8];
+    int32_t simd_fb_prev[8];
+    int32_t simd_fb_curr[8];
+    int32_t simd_mem[8];
+    int32_t simd_pan[2][8];
+    int simd_dirty;
     double out[4];
 
     int rate;
 
 };
 
-void YM2151_init_tables(YM2151* ym);
 void YM2151_envelope_KONKOFF(YM2151* ym,YM2151Operator * op, int v);
 void YM2151_set_connect(YM2151* ym,YM2151Operator *om1, int cha, int v);
 void YM2151_advance(YM2151* ym);
@@ -188,7 +217,12 @@ void YM2151Operator_key_on(struct YM2151Operator *op,uint32_t key_set, uint32_t
 void YM2151Operator_key_off(struct YM2151Operator *op,uint32_t key_set);
 
 void YM2151_init(YM2151* ym,int clk);
+int YM2151_set_core(YM2151* ym,int core);
 void YM2151_reset(YM2151* ym);
 void YM2151_update(YM2151* ym);
 
+// Render 'frames' stereo samples to 'out' (interleaved, 16-bit range).
+// ym->out holds the last two samples afterwards, like after YM2151_update.
+void YM2151_render(YM2151* ym,int32_t* out,int frames);
+
 #endif // YM2151_H_INCLUDED
@@ -9,7 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "../qp.h"
+#include "../loader.h"
 #include "ini.h"
 #include "audit.h"
 
@@ -0,0 +1,81 @@
+/*
+    Rational event scheduler
+*/
+#include <math.h>
+
+#include "clock.h"
+
+// largest denominator produced by QP_ClockRational
+#define CLOCK_MAX_DEN 1000
+
+void QP_ClockInit(QP_Clock* c,uint32_t Num,uint32_t Den,uint32_t Rate)
+{
+    c->Num = Num ? Num : 1;
+    c->Den = Den ? Den : 1;
+    c->Rate = Rate;
+    c->Step = (uint64_t)c->Den*Rate;
+    c->Next = c->Step;
+}
+
+// a*b/c without overflowing the intermediate product
+static uint64_t QP_ClockMulDiv(uint64_t a,uint64_t b,uint64_t c)
+{
+#ifdef __SIZEOF_INT128__
+    return (unsigned __int128)a*b/c;
+#else
+    // exact as long as (c-1)*b fits in 64 bits
+    return a/c*b + a%c*b/c;
+#endif
+}
+
+// Change the event or sample rate. The fraction of the current event
+// period that is left is kept, the rest of the period runs at the new rate.
+void QP_ClockSetRate(QP_Clock* c,uint32_t Num,uint32_t Den,uint32_t Rate)
+{
+    uint64_t step;
+    if(!Num)
+        Num = 1;
+    if(!Den)
+        Den = 1;
+    if(Num == c->Num && Den == c->Den && Rate == c->Rate)
+        return;
+
+    step = (uint64_t)Den*Rate;
+    if(c->Step)
+        c->Next = QP_ClockMulDiv(c->Next,step,c->Step);
+    else
+        c->Next = step;
+    c->Num = Num;
+    c->Den = Den;
+    c->Rate = Rate;
+    c->Step = step;
+}
+
+// Continued fraction expansion, stops when the fraction is exact to
+// double precision or the denominator gets too large.
+void QP_ClockRational(double value,uint32_t* num,uint32_t* den)
+{
+    double x = value;
+    uint64_t p0=0, q0=1, p1=1, q1=0, p2, q2, a;
+    int i;
+
+    for(i=0;i<32;i++)
+    {
+        a = (uint64_t)floor(x);
+        p2 = a*p1+p0;
+        q2 = a*q1+q0;
+        if(q2 > CLOCK_MAX_DEN || p2 > UINT32_MAX)
+            break;
+        p0=p1; q0=q1; p1=p2; q1=q2;
+        if(fabs(value-(double)p1/q1) <= value*1e-12 || x-a < 1e-12)
+            break;
+        x = 1/(x-a);
+    }
+    if(!q1)
+    {
+        p1 = (uint64_t)(value+0.5);
+        q1 = 1;
+    }
+    *num = p1 ? p1 : 1;
+    *den = q1;
+}
@@ -0,0 +1,42 @@
+#ifndef CLOCK_H_INCLUDED
+#define CLOCK_H_INCLUDED
+
+#include <stdint.h>
+
+// Rational event scheduler. Events occur at Num/Den Hz on a timebase of
+// Rate samples per second. Only integer arithmetic is used, so event
+// positions are exact no matter how the timebase is split into blocks.
+typedef struct {
+    uint32_t Num;
+    uint32_t Den;
+    uint32_t Rate;
+    uint64_t Step; // distance between events, in units of 1/Num samples
+    uint64_t Next; // distance to the next event, in units of 1/Num samples
+} QP_Clock;
+
+void QP_ClockInit(QP_Clock* c,uint32_t Num,uint32_t Den,uint32_t Rate);
+void QP_ClockSetRate(QP_Clock* c,uint32_t Num,uint32_t Den,uint32_t Rate); // keeps the current position
+
+// Find a fraction close to a value, for tick rates given as doubles
+void QP_ClockRational(double value,uint32_t* num,uint32_t* den);
+
+// samples that can be processed before the next event is due
+static inline uint32_t QP_ClockUntil(QP_Clock* c)
+{
+    return c->Next / c->Num;
+}
+// must not advance past the next event
+static inline void QP_ClockAdvance(QP_Clock* c,uint32_t samples)
+{
+    c->Next -= (uint64_t)samples*c->Num;
+}
+// returns nonzero if an event is due at the current sample
+static inline int QP_ClockEvent(QP_Clock* c)
+{
+    if(c->Next >= c->Num)
+        return 0;
+    c->Next += c->Step;
+    return 1;
+}
+
+#endif // CLOCK_H_INCLUDED
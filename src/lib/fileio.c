@@ -9,7 +9,7 @@
 
 #include "fileio.h"
 
-    char fileio_error[100];
+char fileio_error[100];
 
 int load_file(char* filename, uint8_t** dataptr, uint32_t* filesize)
 {
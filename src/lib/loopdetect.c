@@ -7,6 +7,41 @@
 
 #include "loopdetect.h"
 
+// Initialize the loop ID table. Returns nonzero on failure.
+int QP_LoopTableInit(QP_LoopTable *lt,uint32_t size)
+{
+    lt->Size = size;
+    lt->PageCnt = (size+LOOPDETECT_PAGE_SIZE-1)>>LOOPDETECT_PAGE_BITS;
+    lt->Page = calloc(lt->PageCnt,sizeof(*lt->Page));
+    if(!lt->Page)
+    {
+        lt->PageCnt = 0;
+        return -1;
+    }
+    return 0;
+}
+void QP_LoopTableFree(QP_LoopTable *lt)
+{
+    uint32_t i;
+    for(i=0;i<lt->PageCnt;i++)
+        free(lt->Page[i]);
+    free(lt->Page);
+    lt->Page = NULL;
+    lt->PageCnt = 0;
+}
+// Allocate the page for a position. Returns NULL if the position is out of
+// range or the allocation fails.
+uint32_t* QP_LoopTableAlloc(QP_LoopTable *lt,uint32_t pos)
+{
+    uint32_t page = pos>>LOOPDETECT_PAGE_BITS;
+    if(page >= lt->PageCnt || pos >= lt->Size)
+        return NULL;
+    lt->Page[page] = calloc(LOOPDETECT_PAGE_SIZE,sizeof(**lt->Page));
+    if(!lt->Page[page])
+        return NULL;
+    return &lt->Page[page][pos&(LOOPDETECT_PAGE_SIZE-1)];
+}
+
 // Initialize loop detection and allocate memory for the loop detection state.
 // You should not really be calling any other loop detection functions if this fails (returns nonzero).
 int QP_LoopDetectInit(QP_LoopDetect *ld)
@@ -17,8 +52,11 @@ int QP_LoopDetectInit(QP_LoopDetect *ld)
         return -1;
     }
 
-    ld->Data = malloc(ld->DataSize*sizeof(*ld->Data));
-    memset(ld->Data,0,ld->DataSize*sizeof(*ld->Data));
+    if(QP_LoopTableInit(&ld->Data,ld->DataSize))
+    {
+        ld->NextLoopId = 0;
+        return -1;
+    }
     ld->Song = malloc(ld->SongCnt*sizeof(*ld->Song));
     memset(ld->Song,0,ld->SongCnt*sizeof(*ld->Song));
     ld->Track = malloc(ld->TrackCnt*sizeof(*ld->Track));
@@ -30,7 +68,7 @@ int QP_LoopDetectInit(QP_LoopDetect *ld)
 // Free allocated memory
 void QP_LoopDetectFree(QP_LoopDetect *ld)
 {
-    free(ld->Data);
+    QP_LoopTableFree(&ld->Data);
     free(ld->Song);
     free(ld->Track);
 }
@@ -78,9 +116,11 @@ void QP_LoopDetectCheck(QP_LoopDetect *ld,int trackid,unsigned int position) //
     if(S->LoopId[S->StackPos] == 0)
         S->LoopId[S->StackPos] = GetNextId(ld);
 
-    int* data = &ld->Data[position];
+    uint32_t* data = QP_LoopTableEntry(&ld->Data,position);
+    if(!data)
+        return;
 
-    if(*data == S->LoopId[S->StackPos] && S->LoopCnt>=0 && S->LoopCnt < INT_MAX)
+    if(*data == (uint32_t)S->LoopId[S->StackPos] && S->LoopCnt>=0 && S->LoopCnt < INT_MAX)
     {
         S->LoopCnt++;
         S->LoopId[S->StackPos] = GetNextId(ld);
@@ -101,9 +141,9 @@ void QP_LoopDetectJump(QP_LoopDetect *ld,int trackid,unsigned int position) // c
     if(S->LoopCnt<0)
         return;
 
-    int* data = &ld->Data[position];
+    int data = QP_LoopTableRead(&ld->Data,position);
 
-    if(!*data)
+    if(!data)
         return;
 
     int i, j;
@@ -118,11 +158,11 @@ void QP_LoopDetectJump(QP_LoopDetect *ld,int trackid,unsigned int position) // c
         S2 = &ld->Song[ld->Track[i].SongId];
         for(j=0;j<=S2->StackPos;j++)
         {
-            if(*data == S2->LoopId[j])
+            if(data == S2->LoopId[j])
             {
                 // subroutine- we just take the same loop ID
                 if(S->StackPos)
-                    S->LoopId[j] = *data;
+                    S->LoopId[j] = data;
                 S->LoopCnt = -2;
                 return;
             }
@@ -1,10 +1,27 @@
 #ifndef LOOPDETECT_H_INCLUDED
 #define LOOPDETECT_H_INCLUDED
 
+#include <stdint.h>
+
 #define LOOPDETECT_MAX_STACK 8
 
+// positions per page in the loop ID table
+#define LOOPDETECT_PAGE_BITS 10
+#define LOOPDETECT_PAGE_SIZE (1<<LOOPDETECT_PAGE_BITS)
+
+typedef struct QP_LoopTable QP_LoopTable;
 typedef struct QP_LoopDetect QP_LoopDetect;
 
+// Last loop ID seen at each data position. Only small parts of the sound
+// data are ever executed, so the table is paged and pages are allocated
+// when first written.
+struct QP_LoopTable
+{
+    uint32_t Size;
+    uint32_t PageCnt;
+    uint32_t **Page;
+};
+
 struct QP_LoopDetectSong
 {
     int StackPos;
@@ -21,7 +38,7 @@ struct QP_LoopDetect
 {
     int NextLoopId;
     int DataSize;
-    int *Data;
+    QP_LoopTable Data;
     void *Driver;
     int SongCnt;
     int TrackCnt;
@@ -31,6 +48,28 @@ struct QP_LoopDetect
     int (*CheckValid)(void *driver,int trackid);
 };
 
+int  QP_LoopTableInit(QP_LoopTable *lt,uint32_t size);
+void QP_LoopTableFree(QP_LoopTable *lt);
+uint32_t* QP_LoopTableAlloc(QP_LoopTable *lt,uint32_t pos);
+
+// Get the entry for writing, allocating its page if needed. Returns NULL if
+// the page could not be allocated, the position is then not checked.
+static inline uint32_t* QP_LoopTableEntry(QP_LoopTable *lt,uint32_t pos)
+{
+    uint32_t page = pos>>LOOPDETECT_PAGE_BITS;
+    if(page < lt->PageCnt && lt->Page[page])
+        return &lt->Page[page][pos&(LOOPDETECT_PAGE_SIZE-1)];
+    return QP_LoopTableAlloc(lt,pos);
+}
+// Read an entry, unwritten positions are 0
+static inline uint32_t QP_LoopTableRead(QP_LoopTable *lt,uint32_t pos)
+{
+    uint32_t page = pos>>LOOPDETECT_PAGE_BITS;
+    if(page < lt->PageCnt && lt->Page[page])
+        return lt->Page[page][pos&(LOOPDETECT_PAGE_SIZE-1)];
+    return 0;
+}
+
 // initialize loop detection
 int  QP_LoopDetectInit(QP_LoopDetect *ld);
 void QP_LoopDetectFree(QP_LoopDetect *ld);
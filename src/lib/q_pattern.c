@@ -11,65 +11,59 @@
 #include "../s2x/track.h"
 #include "q_pattern.h"
 
-
-static Q_State *Q;
-static S2X_State *S;
-
-static struct QP_Pattern *P;
-
-static uint8_t q_pattern_arg_byte(uint32_t* TrackPos)
+static uint8_t q_pattern_arg_byte(Q_State* Q,uint32_t* TrackPos)
 {
     uint8_t r = Q->McuData[*TrackPos];
     *TrackPos += 1;
     return r;
 }
 // parse word operands
-static uint16_t q_pattern_arg_word(uint32_t* TrackPos)
+static uint16_t q_pattern_arg_word(Q_State* Q,uint32_t* TrackPos)
 {
     uint16_t r = (Q->McuData[*TrackPos+1]<<8) | (Q->McuData[*TrackPos]<<0);
     *TrackPos += 2;
     return r;
 }
 // parse track position operands
-static uint32_t q_pattern_arg_pos(uint32_t* TrackPos)
+static uint32_t q_pattern_arg_pos(Q_State* Q,uint32_t* TrackPos)
 {
     uint32_t r = ((Q->McuData[*TrackPos+2]<<16) | (Q->McuData[*TrackPos+1]<<8) | (Q->McuData[*TrackPos]<<0)) - Q->McuPosBase;
     *TrackPos += 3;
     return r;
 }
 // parse operands for conditional jumps / set register commands
-static uint16_t q_pattern_arg_operand(uint32_t* TrackPos,uint8_t mode,uint16_t *regs)
+static uint16_t q_pattern_arg_operand(Q_State* Q,uint32_t* TrackPos,uint8_t mode,uint16_t *regs)
 {
     uint16_t val;
     if(mode&0x80)
     {
         // immediate operand
         if(mode&0x40)
-            val = q_pattern_arg_word(TrackPos);
+            val = q_pattern_arg_word(Q,TrackPos);
         else
-            val = q_pattern_arg_byte(TrackPos);
+            val = q_pattern_arg_byte(Q,TrackPos);
     }
     else
     {
         // register operand
-        val = regs[q_pattern_arg_byte(TrackPos)];
+        val = regs[q_pattern_arg_byte(Q,TrackPos)];
         if(mode&0x40) // indirect
             val = regs[val];
     }
     return val;
 }
 
-static void q_generate(int TrackNo)
+static void q_generate(Q_State* Q,struct QP_Pattern* P,QP_Audio* Audio,int TrackNo)
 {
-    static uint16_t regs[256];
+    uint16_t regs[256];
     int i, left, skip;
     uint32_t pos, jump;
     uint8_t cmd, setflags;
     uint16_t mask, data, temp, dest, source, lfsr;
     int subpos, reppos, looppos;
-    static uint32_t substack[Q_MAX_SUB_STACK], repstack[Q_MAX_REPEAT_STACK], loopstack[Q_MAX_LOOP_STACK];
-    static uint8_t repcount[Q_MAX_REPEAT_STACK], loopcount[Q_MAX_LOOP_STACK];
-    static uint8_t transpose[Q_MAX_TRKCHN];
+    uint32_t substack[Q_MAX_SUB_STACK], repstack[Q_MAX_REPEAT_STACK], loopstack[Q_MAX_LOOP_STACK];
+    uint8_t repcount[Q_MAX_REPEAT_STACK], loopcount[Q_MAX_LOOP_STACK];
+    uint8_t transpose[Q_MAX_TRKCHN];
     int maxcommands = 50000;
 
     P->len = 0;
@@ -78,7 +72,7 @@ static void q_generate(int TrackNo)
         return;
 
     // copy paramters
-    SDL_LockAudioDevice(Audio->dev);
+    QP_AudioLock(Audio);
     memcpy(regs,Q->Register,sizeof(Q->Register));
     memcpy(substack,T->SubStack,sizeof(T->SubStack));
     memcpy(repstack,T->RepeatStack,sizeof(T->RepeatStack));
@@ -95,7 +89,7 @@ static void q_generate(int TrackNo)
     lfsr = Q->LFSR1;
     left = T->RestCount;
     pos = T->Position;
-    SDL_UnlockAudioDevice(Audio->dev);
+    QP_AudioUnlock(Audio);
 
     // insert empty rows
     while(left--)
@@ -117,7 +111,7 @@ static void q_generate(int TrackNo)
             return;
         }
 
-        cmd = q_pattern_arg_byte(&pos);
+        cmd = q_pattern_arg_byte(Q,&pos);
         maxcommands--;
 
         if(cmd<0x80 && maxcommands)
@@ -158,12 +152,12 @@ static void q_generate(int TrackNo)
             case 0x2f:
                 skip=5;break;
             case 0x0c: // tempo sequence
-                cmd = q_pattern_arg_byte(&pos);
+                cmd = q_pattern_arg_byte(Q,&pos);
                 skip = cmd;
                 break;
             case 0x17: // song message
                 while(cmd!=0)
-                    cmd = q_pattern_arg_byte(&pos);
+                    cmd = q_pattern_arg_byte(Q,&pos);
                 break;
             // channel write (byte argument)
             case 0x04:
@@ -176,10 +170,10 @@ static void q_generate(int TrackNo)
             case 0x29:
             case 0x2a:
             case 0x2b:
-                mask = q_pattern_arg_byte(&pos);
-                dest = q_pattern_arg_byte(&pos);
+                mask = q_pattern_arg_byte(Q,&pos);
+                dest = q_pattern_arg_byte(Q,&pos);
                 if(cmd&0x40)
-                    temp = q_pattern_arg_byte(&pos);
+                    temp = q_pattern_arg_byte(Q,&pos);
                 i = 0;
                 while(mask&0xff)
                 {
@@ -188,7 +182,7 @@ static void q_generate(int TrackNo)
                         if(cmd&0x40)
                             data = temp;
                         else
-                            data = q_pattern_arg_byte(&pos);
+                            data = q_pattern_arg_byte(Q,&pos);
 
                         if(dest&0x80)
                             data = regs[data];
@@ -204,10 +198,10 @@ static void q_generate(int TrackNo)
             // channel write (word argument)
             case 0x1b:
             case 0x30:
-                mask = q_pattern_arg_byte(&pos);
-                dest = q_pattern_arg_byte(&pos);
+                mask = q_pattern_arg_byte(Q,&pos);
+                dest = q_pattern_arg_byte(Q,&pos);
                 if(cmd&0x40)
-                    temp = (dest&0x80) ? q_pattern_arg_byte(&pos) : q_pattern_arg_word(&pos);
+                    temp = (dest&0x80) ? q_pattern_arg_byte(Q,&pos) : q_pattern_arg_word(Q,&pos);
                 i = 0;
                 while(mask&0xff)
                 {
@@ -216,7 +210,7 @@ static void q_generate(int TrackNo)
                         if(cmd&0x40)
                             data = temp;
                         else
-                            data = (dest&0x80) ? q_pattern_arg_byte(&pos) : q_pattern_arg_word(&pos);
+                            data = (dest&0x80) ? q_pattern_arg_byte(Q,&pos) : q_pattern_arg_word(Q,&pos);
 
                         if(dest&0x80)
                             data = regs[data&0xff];
@@ -233,7 +227,7 @@ static void q_generate(int TrackNo)
             case 0x18:
             case 0x19:
                 pos++;
-                mask = q_pattern_arg_word(&pos);
+                mask = q_pattern_arg_word(Q,&pos);
                 if(mask & 0x8000)
                     pos+=2;
                 mask<<=1;
@@ -244,16 +238,16 @@ static void q_generate(int TrackNo)
                 }
                 break;
             case 0x10: // jump
-                pos = q_pattern_arg_pos(&pos);
+                pos = q_pattern_arg_pos(Q,&pos);
                 break;
             case 0x11: // sub
                 substack[subpos] = pos+3;
-                pos = q_pattern_arg_pos(&pos);
+                pos = q_pattern_arg_pos(Q,&pos);
                 subpos++;
                 break;
             case 0x12: // repeat
-                dest = q_pattern_arg_byte(&pos);
-                jump = q_pattern_arg_pos(&pos);
+                dest = q_pattern_arg_byte(Q,&pos);
+                jump = q_pattern_arg_pos(Q,&pos);
                 data = reppos;
                 if(data > 0 && repstack[data-1] == pos)
                 {
@@ -274,8 +268,8 @@ static void q_generate(int TrackNo)
                 }
                 break;
             case 0x13: // loop
-                dest = q_pattern_arg_byte(&pos);
-                jump = q_pattern_arg_pos(&pos);
+                dest = q_pattern_arg_byte(Q,&pos);
+                jump = q_pattern_arg_pos(Q,&pos);
                 data = looppos;
 
                 if(data > 0 && loopstack[data-1] == pos)
@@ -297,13 +291,13 @@ static void q_generate(int TrackNo)
                 }
                 break;
             case 0x1e: // set reg
-                data = q_pattern_arg_byte(&pos);
+                data = q_pattern_arg_byte(Q,&pos);
                 uint32_t reg;
                 // destination register no
-                dest = q_pattern_arg_byte(&pos);
+                dest = q_pattern_arg_byte(Q,&pos);
                 if(data&0x40) // indirect
                     dest = regs[dest]&0xff;
-                source = q_pattern_arg_operand(&pos,data<<2,regs);
+                source = q_pattern_arg_operand(Q,&pos,data<<2,regs);
                 reg = regs[dest];
                 setflags = 0;
                 switch(data&0x0f)
@@ -347,14 +341,14 @@ static void q_generate(int TrackNo)
                 regs[dest] = reg&0xffff;
                 break;
             case 0x1f: // conditional jump
-                data = q_pattern_arg_byte(&pos);
+                data = q_pattern_arg_byte(Q,&pos);
                 uint16_t op1,op2;
                 uint32_t jump1, jump2;
                 int res;
-                op1 = q_pattern_arg_operand(&pos,data,regs);
-                op2 = q_pattern_arg_operand(&pos,data<<2,regs);
-                jump1 = q_pattern_arg_pos(&pos);
-                jump2 = q_pattern_arg_pos(&pos);
+                op1 = q_pattern_arg_operand(Q,&pos,data,regs);
+                op2 = q_pattern_arg_operand(Q,&pos,data<<2,regs);
+                jump1 = q_pattern_arg_pos(Q,&pos);
+                jump2 = q_pattern_arg_pos(Q,&pos);
                 switch(data&0x0f)
                 {
                 default:
@@ -394,9 +388,9 @@ static void q_generate(int TrackNo)
             case 0x26:
             case 0x27:
                 dest = cmd&7;
-                mask = q_pattern_arg_byte(&pos);
+                mask = q_pattern_arg_byte(Q,&pos);
                 if(cmd&0x40)
-                    temp = q_pattern_arg_byte(&pos);
+                    temp = q_pattern_arg_byte(Q,&pos);
                 for(i=0;i<Q_MAX_TRKCHN;i++)
                 {
                     if(mask&0x80)
@@ -404,7 +398,7 @@ static void q_generate(int TrackNo)
                         if(cmd&0x40)
                             data = temp;
                         else
-                            data = q_pattern_arg_byte(&pos);
+                            data = q_pattern_arg_byte(Q,&pos);
 
                         // add transpose offset
                         if(((cmd&0x3f) == 0x20) && data < 0x7f)
@@ -447,16 +441,14 @@ static void q_generate(int TrackNo)
 
 // ============================================================================
 
-static uint32_t posbase;
-
-static uint8_t s2x_pattern_arg_byte(uint32_t* TrackPos)
+static uint8_t s2x_pattern_arg_byte(S2X_State* S,uint32_t* TrackPos)
 {
     uint8_t r = S->Data[*TrackPos];
     *TrackPos += 1;
     return r;
 }
 // parse track position operands
-static uint32_t s2x_pattern_arg_pos(uint32_t* TrackPos)
+static uint32_t s2x_pattern_arg_pos(S2X_State* S,uint32_t posbase,uint32_t* TrackPos)
 {
     uint32_t r = posbase;
     if(S->DriverType == S2X_TYPE_NA)
@@ -466,9 +458,9 @@ static uint32_t s2x_pattern_arg_pos(uint32_t* TrackPos)
     *TrackPos += 2;
     return r;
 }
-static uint32_t s2x_s86jump(uint32_t* TrackPos)
+static uint32_t s2x_s86jump(S2X_State* S,uint32_t posbase,uint32_t* TrackPos)
 {
-    uint32_t songtab = posbase + S->FMSongTab + (2*s2x_pattern_arg_byte(TrackPos));
+    uint32_t songtab = posbase + S->FMSongTab + (2*s2x_pattern_arg_byte(S,TrackPos));
     return posbase + ((S->Data[songtab]<<8)|(S->Data[songtab+1]&0xff));
 }
 static int16_t s2x_fmkeycode(uint8_t d)
@@ -478,19 +470,19 @@ static int16_t s2x_fmkeycode(uint8_t d)
     return ((d>>2)*3)+(d&3);
 }
 
-static void s2x_generate(int TrackNo)
+static void s2x_generate(S2X_State* S,struct QP_Pattern* P,QP_Audio* Audio,int TrackNo)
 {
     struct S2X_TrackCommandEntry* CmdTab = S2X_TrackCommandTable[S->DriverType];
 
-    static uint16_t cjump;
+    uint16_t cjump;
     int i, left, skip;
-    uint32_t pos, jump;
+    uint32_t pos, jump, posbase;
     uint8_t cmd;
     uint16_t mask, data, temp, dest;
     int subpos, reppos, looppos;
-    static uint32_t substack[S2X_MAX_SUB_STACK], repstack[S2X_MAX_REPEAT_STACK], loopstack[S2X_MAX_LOOP_STACK];
-    static uint8_t repcount[S2X_MAX_REPEAT_STACK], loopcount[S2X_MAX_LOOP_STACK];
-    static uint8_t transpose[S2X_MAX_TRKCHN];
+    uint32_t substack[S2X_MAX_SUB_STACK], repstack[S2X_MAX_REPEAT_STACK], loopstack[S2X_MAX_LOOP_STACK];
+    uint8_t repcount[S2X_MAX_REPEAT_STACK], loopcount[S2X_MAX_LOOP_STACK];
+    uint8_t transpose[S2X_MAX_TRKCHN];
     int maxcommands = 50000;
 
     P->len = 0;
@@ -499,7 +491,7 @@ static void s2x_generate(int TrackNo)
         return;
 
     // copy paramters
-    SDL_LockAudioDevice(Audio->dev);
+    QP_AudioLock(Audio);
     cjump = (S->CJump) ? 0x400 : T->Flags&0x400;
     memcpy(substack,T->SubStack,sizeof(T->SubStack));
     memcpy(repstack,T->RepeatStack,sizeof(T->RepeatStack));
@@ -515,7 +507,7 @@ static void s2x_generate(int TrackNo)
     left = T->RestCount;
     posbase = T->PositionBase;
     pos = T->Position+posbase;
-    SDL_UnlockAudioDevice(Audio->dev);
+    QP_AudioUnlock(Audio);
 
     // insert empty rows
     while(left--)
@@ -537,7 +529,7 @@ static void s2x_generate(int TrackNo)
             return;
         }
 
-        cmd = s2x_pattern_arg_byte(&pos);
+        cmd = s2x_pattern_arg_byte(S,&pos);
         maxcommands--;
 
         if(cmd<0x80 && maxcommands)
@@ -554,9 +546,9 @@ static void s2x_generate(int TrackNo)
             case S2X_CMD_WAV:
             case S2X_CMD_FRQ:
             case S2X_CMD_TRS:
-                mask = s2x_pattern_arg_byte(&pos);
+                mask = s2x_pattern_arg_byte(S,&pos);
                 if(cmd&0x40)
-                    temp = s2x_pattern_arg_byte(&pos);
+                    temp = s2x_pattern_arg_byte(S,&pos);
                 for(i=0;i<S2X_MAX_TRKCHN;i++)
                 {
                     if(mask&0x80)
@@ -564,7 +556,7 @@ static void s2x_generate(int TrackNo)
                         if(cmd&0x40)
                             data = temp;
                         else
-                            data = s2x_pattern_arg_byte(&pos);
+                            data = s2x_pattern_arg_byte(S,&pos);
                         // transpose write
                         if(skip == S2X_CMD_TRS)
                             transpose[i] = data;
@@ -592,24 +584,24 @@ static void s2x_generate(int TrackNo)
                     break;
                 }
             case S2X_CMD_JUMP: // jump
-                pos = s2x_pattern_arg_pos(&pos);
+                pos = s2x_pattern_arg_pos(S,posbase,&pos);
                 break;
             case S2X_CMD_CALL: // sub
                 substack[subpos] = pos+2-posbase;
-                pos = s2x_pattern_arg_pos(&pos);
+                pos = s2x_pattern_arg_pos(S,posbase,&pos);
                 subpos++;
                 break;
             case S2X_CMD_JUMP86: // jump
-                pos = s2x_s86jump(&pos);
+                pos = s2x_s86jump(S,posbase,&pos);
                 break;
             case S2X_CMD_CALL86: // sub
                 substack[subpos] = pos+1-posbase;
-                pos = s2x_s86jump(&pos);
+                pos = s2x_s86jump(S,posbase,&pos);
                 subpos++;
                 break;
             case S2X_CMD_REPT: // repeat
-                dest = s2x_pattern_arg_byte(&pos);
-                jump = s2x_pattern_arg_pos(&pos);
+                dest = s2x_pattern_arg_byte(S,&pos);
+                jump = s2x_pattern_arg_pos(S,posbase,&pos);
                 data = reppos;
                 if(data > 0 && repstack[data-1] == pos-posbase)
                 {
@@ -630,8 +622,8 @@ static void s2x_generate(int TrackNo)
                 }
                 break;
             case S2X_CMD_LOOP: // loop
-                dest = s2x_pattern_arg_byte(&pos);
-                jump = s2x_pattern_arg_pos(&pos);
+                dest = s2x_pattern_arg_byte(S,&pos);
+                jump = s2x_pattern_arg_pos(S,posbase,&pos);
                 data = looppos;
 
                 if(data > 0 && loopstack[data-1] == pos-posbase)
@@ -692,22 +684,18 @@ static void s2x_generate(int TrackNo)
 
 // ============================================================================
 
-void QP_PatternGenerate(int TrackNo,struct QP_Pattern* Pat)
+void QP_PatternGenerate(QP_Context* ctx,int TrackNo,struct QP_Pattern* P)
 {
-    P = Pat;
-    switch(DriverInterface->Type)
+    switch(ctx->DriverInterface->Type)
     {
     case DRIVER_QUATTRO:
-        Q = DriverInterface->Driver;
-        q_generate(TrackNo);
+        q_generate(ctx->DriverInterface->Driver,P,ctx->Audio,TrackNo);
         break;
     case DRIVER_SYSTEM2:
-        S = DriverInterface->Driver;
-        s2x_generate(TrackNo);
+        s2x_generate(ctx->DriverInterface->Driver,P,ctx->Audio,TrackNo);
         break;
     default:
         P->len=0;
         break;
     }
-    Q = DriverInterface->Driver;
 }
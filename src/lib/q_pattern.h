@@ -1,10 +1,12 @@
 #ifndef Q_PATTERN_H_INCLUDED
 #define Q_PATTERN_H_INCLUDED
 
+#include "../context.h"
+
 struct QP_Pattern {
     int pat[32][8];
     int len;
 };
-void QP_PatternGenerate(int TrackNo,struct QP_Pattern* P);
+void QP_PatternGenerate(QP_Context* ctx,int TrackNo,struct QP_Pattern* P);
 
 #endif // Q_PATTERN_H_INCLUDED
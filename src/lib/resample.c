@@ -0,0 +1,321 @@
+/*
+    Polyphase windowed-sinc resampler
+
+    Converts the chip output to the audio device or file rate. The filter
+    is a Kaiser windowed sinc, stored as a table of phases. Coefficients
+    for positions between two phases are linearly interpolated.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "resample.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QP_RESAMPLE_X86 1
+#include <immintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static const struct {
+    int Taps;      // at 1:1 ratio, scaled up when downsampling
+    int Phases;
+    double Beta;   // Kaiser window parameter
+    double Cutoff; // passband edge relative to the output Nyquist frequency
+} QP_ResampleQuality[QP_RESAMPLE_QUALITY_MAX] = {
+    {  16,  128,  5.0, 0.80 },
+    {  32,  256,  7.0, 0.88 },
+    {  64,  512,  9.0, 0.93 },
+    { 128, 1024, 11.0, 0.96 },
+};
+
+static float QP_ResampleDotC(const float* x,const float* h0,const float* h1,float frac,int taps)
+{
+    float a0=0, a1=0;
+    int i;
+    for(i=0;i<taps;i++)
+    {
+        a0 += x[i]*h0[i];
+        a1 += x[i]*h1[i];
+    }
+    return a0 + (a1-a0)*frac;
+}
+
+#ifdef QP_RESAMPLE_X86
+__attribute__((target("sse")))
+static float QP_ResampleDotSSE(const float* x,const float* h0,const float* h1,float frac,int taps)
+{
+    __m128 a0 = _mm_setzero_ps();
+    __m128 a1 = _mm_setzero_ps();
+    __m128 v;
+    int i;
+    for(i=0;i<taps;i+=4)
+    {
+        v = _mm_loadu_ps(x+i);
+        a0 = _mm_add_ps(a0,_mm_mul_ps(v,_mm_loadu_ps(h0+i)));
+        a1 = _mm_add_ps(a1,_mm_mul_ps(v,_mm_loadu_ps(h1+i)));
+    }
+    a0 = _mm_add_ps(a0,_mm_mul_ps(_mm_sub_ps(a1,a0),_mm_set1_ps(frac)));
+    a0 = _mm_add_ps(a0,_mm_movehl_ps(a0,a0));
+    a0 = _mm_add_ss(a0,_mm_shuffle_ps(a0,a0,1));
+    return _mm_cvtss_f32(a0);
+}
+
+__attribute__((target("avx")))
+static float QP_ResampleDotAVX(const float* x,const float* h0,const float* h1,float frac,int taps)
+{
+    __m256 a0 = _mm256_setzero_ps();
+    __m256 a1 = _mm256_setzero_ps();
+    __m256 v;
+    __m128 s0, s1;
+    int i;
+    for(i=0;i<taps;i+=8)
+    {
+        v = _mm256_loadu_ps(x+i);
+        a0 = _mm256_add_ps(a0,_mm256_mul_ps(v,_mm256_loadu_ps(h0+i)));
+        a1 = _mm256_add_ps(a1,_mm256_mul_ps(v,_mm256_loadu_ps(h1+i)));
+    }
+    s0 = _mm_add_ps(_mm256_castps256_ps128(a0),_mm256_extractf128_ps(a0,1));
+    s1 = _mm_add_ps(_mm256_castps256_ps128(a1),_mm256_extractf128_ps(a1,1));
+    s0 = _mm_add_ps(s0,_mm_mul_ps(_mm_sub_ps(s1,s0),_mm_set1_ps(frac)));
+    s0 = _mm_add_ps(s0,_mm_movehl_ps(s0,s0));
+    s0 = _mm_add_ss(s0,_mm_shuffle_ps(s0,s0,1));
+    return _mm_cvtss_f32(s0);
+}
+#endif
+
+// zeroth order modified Bessel function, for the Kaiser window
+static double QP_ResampleBesselI0(double x)
+{
+    double sum=1, term=1;
+    int k;
+    for(k=1;k<50;k++)
+    {
+        term *= (x/(2*k))*(x/(2*k));
+        sum += term;
+        if(term < sum*1e-12)
+            break;
+    }
+    return sum;
+}
+
+static void QP_ResampleMakeFilter(QP_Resampler* rs,double fc,double beta)
+{
+    int p,k;
+    int half = rs->Taps/2;
+    double x,w,h,sum;
+    double i0beta = QP_ResampleBesselI0(beta);
+
+    for(p=0;p<=rs->Phases;p++)
+    {
+        float* row = rs->Coeff+p*rs->Taps;
+        sum = 0;
+        for(k=0;k<rs->Taps;k++)
+        {
+            // distance from the output position, which lies between taps
+            // half-1 and half
+            x = k - (half-1) - (double)p/rs->Phases;
+            w = x/half;
+            w = (w*w < 1) ? QP_ResampleBesselI0(beta*sqrt(1-w*w))/i0beta : 0;
+            h = x == 0 ? 2*fc : sin(2*M_PI*fc*x)/(M_PI*x);
+            row[k] = h*w;
+            sum += h*w;
+        }
+        // unity gain at DC for every phase
+        for(k=0;k<rs->Taps;k++)
+            row[k] /= sum;
+    }
+}
+
+// Initialize the resampler. Returns nonzero on failure.
+int QP_ResamplerInit(QP_Resampler* rs,double InRate,double OutRate,int Channels,int Quality)
+{
+    int i;
+    double ratio = InRate/OutRate;
+
+    memset(rs,0,sizeof(*rs));
+    if(InRate <= 0 || OutRate <= 0 || Channels < 1 || Channels > QP_RESAMPLE_MAX_CHANNELS)
+        return -1;
+    if(Quality < 0)
+        Quality = 0;
+    if(Quality >= QP_RESAMPLE_QUALITY_MAX)
+        Quality = QP_RESAMPLE_QUALITY_MAX-1;
+
+    rs->InRate = InRate;
+    rs->OutRate = OutRate;
+    rs->Channels = Channels;
+    rs->Quality = Quality;
+    rs->Step = (uint64_t)(ratio*4294967296.0+0.5);
+
+    // a longer filter is needed to keep the transition band when downsampling
+    rs->Taps = QP_ResampleQuality[Quality].Taps;
+    if(ratio > 1)
+        rs->Taps = (int)ceil(rs->Taps*ratio);
+    rs->Taps = (rs->Taps+7)&~7;
+    rs->Phases = QP_ResampleQuality[Quality].Phases;
+
+    rs->HistSize = rs->Taps+4*QP_RESAMPLE_BLOCK;
+    rs->Coeff = malloc((rs->Phases+1)*rs->Taps*sizeof(float));
+    rs->InBuf = malloc(QP_RESAMPLE_BLOCK*Channels*sizeof(float));
+    if(!rs->Coeff || !rs->InBuf)
+    {
+        QP_ResamplerFree(rs);
+        return -1;
+    }
+    for(i=0;i<Channels;i++)
+    {
+        rs->History[i] = malloc(rs->HistSize*sizeof(float));
+        if(!rs->History[i])
+        {
+            QP_ResamplerFree(rs);
+            return -1;
+        }
+    }
+
+    QP_ResampleMakeFilter(rs,0.5*QP_ResampleQuality[Quality].Cutoff/(ratio > 1 ? ratio : 1),
+                          QP_ResampleQuality[Quality].Beta);
+
+    rs->Dot = QP_ResampleDotC;
+#ifdef QP_RESAMPLE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx"))
+        rs->Dot = QP_ResampleDotAVX;
+    else if(__builtin_cpu_supports("sse"))
+        rs->Dot = QP_ResampleDotSSE;
+#endif
+
+    QP_ResamplerReset(rs);
+    return 0;
+}
+
+void QP_ResamplerFree(QP_Resampler* rs)
+{
+    int i;
+    free(rs->Coeff);
+    free(rs->InBuf);
+    for(i=0;i<QP_RESAMPLE_MAX_CHANNELS;i++)
+        free(rs->History[i]);
+    memset(rs,0,sizeof(*rs));
+}
+
+// Clear the filter history. The history is primed so that the output is
+// aligned with the input, the first output sample is at input position 0.
+void QP_ResamplerReset(QP_Resampler* rs)
+{
+    int i;
+    for(i=0;i<rs->Channels;i++)
+        memset(rs->History[i],0,rs->HistSize*sizeof(float));
+    rs->HistFill = rs->Taps/2-1;
+    rs->Pos = 0;
+}
+
+// Discard used history
+static void QP_ResampleDiscard(QP_Resampler* rs)
+{
+    int i;
+    int used = rs->Pos>>32;
+
+    if(used > rs->HistFill)
+        used = rs->HistFill;
+    if(!used)
+        return;
+    for(i=0;i<rs->Channels;i++)
+        memmove(rs->History[i],rs->History[i]+used,(rs->HistFill-used)*sizeof(float));
+    rs->HistFill -= used;
+    rs->Pos -= (uint64_t)used<<32;
+}
+
+// Discard used history and pull more input
+static void QP_ResampleRefill(QP_Resampler* rs,QP_ResamplerFill fill,void* data)
+{
+    int i,j,len;
+    int ch = rs->Channels;
+    float* in;
+
+    QP_ResampleDiscard(rs);
+
+    while(rs->HistFill < rs->HistSize)
+    {
+        len = rs->HistSize - rs->HistFill;
+        if(len > QP_RESAMPLE_BLOCK)
+            len = QP_RESAMPLE_BLOCK;
+        fill(data,rs->InBuf,len);
+
+        for(i=0;i<ch;i++)
+        {
+            in = rs->InBuf+i;
+            for(j=0;j<len;j++)
+                rs->History[i][rs->HistFill+j] = in[j*ch];
+        }
+        rs->HistFill += len;
+    }
+}
+
+// Calculate one output frame
+static inline float* QP_ResampleFrame(QP_Resampler* rs,float* out)
+{
+    int ch;
+    uint32_t idx = rs->Pos>>32;
+    uint64_t ph = (uint64_t)(uint32_t)rs->Pos * rs->Phases;
+    const float *h0 = rs->Coeff + (ph>>32)*rs->Taps;
+    float frac = (uint32_t)ph * (1.0f/4294967296.0f);
+
+    for(ch=0;ch<rs->Channels;ch++)
+        *out++ = rs->Dot(rs->History[ch]+idx,h0,h0+rs->Taps,frac,rs->Taps);
+
+    rs->Pos += rs->Step;
+    return out;
+}
+
+void QP_ResamplerProcess(QP_Resampler* rs,float* out,int frames,QP_ResamplerFill fill,void* data)
+{
+    int i;
+    for(i=0;i<frames;i++)
+    {
+        if((rs->Pos>>32)+rs->Taps > (uint64_t)rs->HistFill)
+            QP_ResampleRefill(rs,fill,data);
+        out = QP_ResampleFrame(rs,out);
+    }
+}
+
+int QP_ResamplerNeeded(QP_Resampler* rs,int frames)
+{
+    int64_t need;
+    if(frames < 1)
+        return 0;
+    need = (int64_t)((rs->Pos+(uint64_t)(frames-1)*rs->Step)>>32) + rs->Taps - rs->HistFill;
+    return need > 0 ? need : 0;
+}
+
+int QP_ResamplerWrite(QP_Resampler* rs,const float* in,int frames)
+{
+    int i,j;
+    int ch = rs->Channels;
+
+    QP_ResampleDiscard(rs);
+    if(frames < 0 || rs->HistFill+frames > rs->HistSize)
+        return -1;
+
+    for(i=0;i<ch;i++)
+    {
+        for(j=0;j<frames;j++)
+            rs->History[i][rs->HistFill+j] = in[j*ch+i];
+    }
+    rs->HistFill += frames;
+    return 0;
+}
+
+void QP_ResamplerRead(QP_Resampler* rs,float* out,int frames)
+{
+    int i;
+    for(i=0;i<frames;i++)
+        out = QP_ResampleFrame(rs,out);
+}
+
+double QP_ResamplerGetLatency(QP_Resampler* rs)
+{
+    return (rs->Taps/2)*rs->OutRate/rs->InRate;
+}
@@ -0,0 +1,66 @@
+#ifndef RESAMPLE_H_INCLUDED
+#define RESAMPLE_H_INCLUDED
+
+#include <stdint.h>
+
+// quality settings, higher is slower and has more latency
+enum {
+    QP_RESAMPLE_FAST = 0,
+    QP_RESAMPLE_MEDIUM,
+    QP_RESAMPLE_HIGH,
+    QP_RESAMPLE_BEST,
+    QP_RESAMPLE_QUALITY_MAX
+};
+
+#define QP_RESAMPLE_DEFAULT QP_RESAMPLE_HIGH
+#define QP_RESAMPLE_MAX_CHANNELS 4
+
+// input frames requested from the fill function at a time
+#define QP_RESAMPLE_BLOCK 256
+
+// Fill function, must write exactly 'frames' interleaved frames to 'buf'
+typedef void (*QP_ResamplerFill)(void* data,float* buf,int frames);
+
+typedef struct QP_Resampler QP_Resampler;
+
+struct QP_Resampler
+{
+    double InRate;
+    double OutRate;
+    int Channels;
+    int Quality;
+
+    int Taps;    // filter length in input samples, multiple of 8
+    int Phases;  // number of polyphase branches
+    float* Coeff; // (Phases+1)*Taps, one row per fractional position
+
+    uint64_t Step; // input samples per output sample, 32.32 fixed point
+    uint64_t Pos;  // position of the first tap in History, 32.32 fixed point
+
+    int HistSize; // frames in each history buffer
+    int HistFill; // valid frames in each history buffer
+    float* History[QP_RESAMPLE_MAX_CHANNELS];
+    float* InBuf; // interleaved block from the fill function
+
+    float (*Dot)(const float* x,const float* h0,const float* h1,float frac,int taps);
+};
+
+int  QP_ResamplerInit(QP_Resampler* rs,double InRate,double OutRate,int Channels,int Quality);
+void QP_ResamplerFree(QP_Resampler* rs);
+void QP_ResamplerReset(QP_Resampler* rs);
+
+// Produce 'frames' interleaved output frames, pulling input as needed
+void QP_ResamplerProcess(QP_Resampler* rs,float* out,int frames,QP_ResamplerFill fill,void* data);
+
+// Push interface, for when the input must be generated in step with the
+// output. QP_ResamplerNeeded returns the number of input frames to write
+// before 'frames' output frames can be read. QP_ResamplerWrite returns
+// nonzero if the input does not fit in the history buffer.
+int  QP_ResamplerNeeded(QP_Resampler* rs,int frames);
+int  QP_ResamplerWrite(QP_Resampler* rs,const float* in,int frames);
+void QP_ResamplerRead(QP_Resampler* rs,float* out,int frames);
+
+// Filter delay in output samples
+double QP_ResamplerGetLatency(QP_Resampler* rs);
+
+#endif // RESAMPLE_H_INCLUDED
@@ -1,5 +1,9 @@
 /*
     VGM writing
+
+    The thread running the sound driver only queues events, the writer
+    thread does the encoding and file I/O. Delays are added up on the
+    producer side and queued before the next write.
 */
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,191 +14,343 @@
 #include <time.h>
 
 #include "vgm.h"
-#include "fileio.h"
 
-// has to be larger than ~20MB
-#define VGM_BUFFER 50000000
+// file writes are done in chunks of this size
+#define VGM_CHUNK_SIZE 0x40000
+// writer poll interval (ms) when the ring is empty
+#define VGM_WRITER_SLEEP 2
 
-    uint32_t buffer_size;
-    uint32_t delayq;
-    uint32_t samplecnt;
-    uint32_t loop_set;
-    uint8_t* vgmdata;
-    uint8_t* data;
-    char* filename;
+// internal events (not VGM commands)
+enum {
+    VGM_EVENT_DELAY = 0x00,
+    VGM_EVENT_LOOP = 0x01,
+};
 
-// Increments destination pointer
-void my_memcpy(uint8_t** dest, void* src, int size)
+static void vgm_flush(QP_Vgm* v)
 {
-    memcpy(*dest,src,size);
-    *dest += size;
+    if(v->chunk_fill && fwrite(v->chunk,1,v->chunk_fill,v->file) != v->chunk_fill)
+        v->error = 1;
+    v->chunk_fill = 0;
 }
 
-void add_datablockcmd(uint8_t** dest, uint8_t dtype, uint32_t size, uint32_t romsize, uint32_t offset)
+// Append to the file
+static void vgm_put(QP_Vgm* v, const void* data, uint32_t size)
 {
-    **dest = 0x67;*dest+=1;
-    **dest = 0x66;*dest+=1;
-    **dest = dtype;*dest+=1;
+    const uint8_t* src = data;
+    uint32_t len;
+
+    v->pos += size;
+    while(size)
+    {
+        len = VGM_CHUNK_SIZE - v->chunk_fill;
+        if(len > size)
+            len = size;
+        memcpy(v->chunk+v->chunk_fill,src,len);
+        v->chunk_fill += len;
+        src += len;
+        size -= len;
+        if(v->chunk_fill == VGM_CHUNK_SIZE)
+            vgm_flush(v);
+    }
+}
+
+static void vgm_put8(QP_Vgm* v, uint8_t d)
+{
+    vgm_put(v,&d,1);
+}
+
+static void add_datablockcmd(QP_Vgm* v, uint8_t dtype, uint32_t size, uint32_t romsize, uint32_t offset)
+{
+    vgm_put8(v,0x67);
+    vgm_put8(v,0x66);
+    vgm_put8(v,dtype);
     size += 8;
-    my_memcpy(dest,&size,4);
-    my_memcpy(dest,&romsize,4);
-    my_memcpy(dest,&offset,4);
+    vgm_put(v,&size,4);
+    vgm_put(v,&romsize,4);
+    vgm_put(v,&offset,4);
 }
 
-void add_delay(uint8_t** dest, int delay)
+static void add_delay(QP_Vgm* v, int delay)
 {
-    samplecnt += delay;
+    static const uint8_t maxdelay[3] = {0x61,0xff,0xff};
+    v->samplecnt += delay;
 
     int commandcount = floor(delay/65535);
     uint16_t finalcommand = delay%65535;
 
     while(commandcount)
     {
-        **dest = 0x61;*dest+=1;
-        **dest = 0xff;*dest+=1;
-        **dest = 0xff;*dest+=1;
+        vgm_put(v,maxdelay,3);
         commandcount--;
     }
 
     if(finalcommand > 16)
     {
-        **dest = 0x61;*dest+=1;
-        my_memcpy(dest,&finalcommand,2);
+        vgm_put8(v,0x61);
+        vgm_put(v,&finalcommand,2);
     }
     else if(finalcommand > 0)
     {
-        **dest = 0x70 + finalcommand-1;
-        *dest+=1;
+        vgm_put8(v,0x70 + finalcommand-1);
     }
 }
 
-void vgm_open(char* fname)
+// Write the queued delay, keeping the remainder
+static void vgm_flush_delay(QP_Vgm* v)
 {
-    filename = (char*)malloc(strlen(fname)+10);
-    strcpy(filename,fname);
-    delayq=0;
-    loop_set=0;
+    if(v->delayq/10 > 1)
+    {
+        add_delay(v,v->delayq/10);
+        v->delayq=v->delayq%10;
+    }
+}
 
-    // create initial buffer
-    vgmdata=(uint8_t*)malloc(VGM_BUFFER);
-    data = vgmdata;
-    buffer_size = VGM_BUFFER;
-    memset(data, 0, VGM_BUFFER);
+// Encode an event (writer side)
+static void vgm_encode(QP_Vgm* v, QP_VgmEvent* e)
+{
+    uint8_t cmd[5];
+    int len = 0;
 
-    // vgm magic
-    memcpy(data, "Vgm ", 4);
+    if(e->command == VGM_EVENT_DELAY)
+    {
+        v->delayq += e->value;
+        return;
+    }
 
-    // version
-    data+=8;
-    *data++ = 0x71;
-    *data++ = 0x01;
+    vgm_flush_delay(v);
 
-    //data offset
-    *(uint32_t*)(vgmdata+0x34)=0x100-0x34;
+    if(e->command == VGM_EVENT_LOOP)
+    {
+        v->loop_set = v->samplecnt;
+        *(uint32_t*)(v->header+0x1c)= v->pos-0x1c;
+        return;
+    }
 
-    data=vgmdata+0x100;
-}
+// todo: need to handle command types if using other chips
+    cmd[len++] = e->command;
 
-void vgm_poke32(int32_t offset, uint32_t d)
-{
-    *(uint32_t*)(vgmdata+offset)= d;
+    if(e->command == 0xe1) // C352
+    {
+        cmd[len++] = e->reg>>8;
+        cmd[len++] = e->reg&0xff;
+        cmd[len++] = e->value>>8;
+        cmd[len++] = e->value&0xff;
+    }
+    else if(e->command == 0x54) // YM2151
+    {
+        cmd[len++] = e->reg;
+        cmd[len++] = e->value;
+    }
+    else // following is for D0-D6 commands...
+    {
+        cmd[len++] = e->port;
+        cmd[len++] = (e->reg&0xff);
+        cmd[len++] = (e->value&0xff);
+    }
+    vgm_put(v,cmd,len);
 }
 
-void vgm_poke8(int32_t offset, uint8_t d)
+// Encode all queued events. Returns zero if the ring was empty.
+static int vgm_drain(QP_Vgm* v)
 {
-    *(uint8_t*)(vgmdata+offset)= d;
+    uint32_t pos = v->read;
+    uint32_t end = __atomic_load_n(&v->write,__ATOMIC_ACQUIRE);
+
+    if(pos == end)
+        return 0;
+    while(pos != end)
+    {
+        vgm_encode(v,&v->ring[pos & (VGM_RING_SIZE-1)]);
+        pos++;
+        // free space early so the producer does not wait for the whole batch
+        if(!(pos & 1023))
+            __atomic_store_n(&v->read,pos,__ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&v->read,pos,__ATOMIC_RELEASE);
+    return 1;
 }
 
-// notice: start offset was replaced with ROM mask.
-void vgm_datablock(uint8_t dbtype, uint32_t dbsize, uint8_t* datablock, uint32_t maxsize, uint32_t mask, int32_t flags)
+static void vgm_writer(void* data)
 {
-    add_datablockcmd(&data, dbtype, dbsize|flags, maxsize, 0);
-
-    int i;
-    for(i=0;i<dbsize;i++)
-        *data++ = datablock[i & mask];
-
-    //my_memcpy(&data, datablock, dbsize);
+    QP_Vgm* v = data;
+    int stop;
+    for(;;)
+    {
+        // everything queued before stop was set is encoded
+        stop = __atomic_load_n(&v->stop,__ATOMIC_ACQUIRE);
+        if(vgm_drain(v))
+            continue;
+        if(stop)
+            break;
+        QP_WorkerSleep(VGM_WRITER_SLEEP);
+    }
 }
 
-void vgm_setloop()
+// Queue an event (producer side). If the ring is full, waits for the
+// writer, which only happens when rendering faster than the file can be
+// written.
+static void vgm_push(QP_Vgm* v, uint8_t command, uint8_t port, uint16_t reg, uint32_t value)
 {
-    // add delays
-    if(delayq/10 > 1)
+    uint32_t pos = v->write;
+    QP_VgmEvent* e;
+
+    if(pos - __atomic_load_n(&v->read,__ATOMIC_ACQUIRE) >= VGM_RING_SIZE)
     {
-        add_delay(&data,delayq/10);
-        delayq=delayq%10;
+        v->waits++;
+        // without a writer thread, the events are encoded here
+        if(!v->running)
+            vgm_drain(v);
+        while(pos - __atomic_load_n(&v->read,__ATOMIC_ACQUIRE) >= VGM_RING_SIZE)
+            QP_WorkerSleep(1);
     }
 
-    loop_set = samplecnt;
-    *(uint32_t*)(vgmdata+0x1c)= data-vgmdata-0x1c;
+    e = &v->ring[pos & (VGM_RING_SIZE-1)];
+    e->command = command;
+    e->port = port;
+    e->reg = reg;
+    e->value = value;
+    __atomic_store_n(&v->write,pos+1,__ATOMIC_RELEASE);
 }
 
-void vgm_write(uint8_t command, uint8_t port, uint16_t reg, uint16_t value)
+static void vgm_push_delay(QP_Vgm* v)
 {
-    if(delayq/10 > 1)
+    if(v->delay)
     {
-        add_delay(&data,delayq/10);
-        delayq=delayq%10;
+        vgm_push(v,VGM_EVENT_DELAY,0,0,v->delay);
+        v->delay = 0;
     }
+}
 
-// todo: need to handle command types if using other chips
-    *data++ = command;
-
-    if(command == 0xe1) // C352
+int vgm_open(QP_Vgm* v, char* fname)
+{
+    memset(v,0,sizeof(*v));
+    v->filename = (char*)malloc(strlen(fname)+1);
+    v->ring = (QP_VgmEvent*)malloc(VGM_RING_SIZE*sizeof(QP_VgmEvent));
+    v->chunk = (uint8_t*)malloc(VGM_CHUNK_SIZE);
+    if(v->filename)
     {
-        *data++ = reg>>8;
-        *data++ = reg&0xff;
-        *data++ = value>>8;
-        *data++ = value&0xff;
+        strcpy(v->filename,fname);
+        v->file = fopen(v->filename,"wb");
     }
-    else if(command == 0x54) // YM2151
+    if(!v->filename || !v->ring || !v->chunk || !v->file)
     {
-        *data++ = reg;
-        *data++ = value;
+        if(v->file)
+            fclose(v->file);
+        free(v->filename);
+        free(v->ring);
+        free(v->chunk);
+        memset(v,0,sizeof(*v));
+        return -1;
     }
-    else // following is for D0-D6 commands...
+
+    // vgm magic
+    memcpy(v->header, "Vgm ", 4);
+
+    // version
+    v->header[8] = 0x71;
+    v->header[9] = 0x01;
+
+    //data offset
+    *(uint32_t*)(v->header+0x34)=0x100-0x34;
+
+    // the header is written again at close
+    vgm_put(v,v->header,0x100);
+    return 0;
+}
+
+int vgm_start(QP_Vgm* v)
+{
+    if(QP_WorkerInit(&v->writer,"QP_VgmWriter"))
+        return -1;
+    v->running = 1;
+    QP_WorkerRun(&v->writer,vgm_writer,v);
+    return 0;
+}
+
+static void vgm_stop_writer(QP_Vgm* v)
+{
+    vgm_push_delay(v);
+    __atomic_store_n(&v->stop,1,__ATOMIC_RELEASE);
+    if(v->running)
     {
-        *data++ = port;
-        *data++ = (reg&0xff);
-        *data++ = (value&0xff);
+        QP_WorkerWait(&v->writer);
+        QP_WorkerFree(&v->writer);
+        v->running = 0;
     }
+    vgm_drain(v);
+}
+
+void vgm_poke32(QP_Vgm* v, int32_t offset, uint32_t d)
+{
+    if(offset >= 0 && offset <= 0x100-4)
+        *(uint32_t*)(v->header+offset)= d;
+}
 
-    // resize buffer if needed
-    if(buffer_size-(data-vgmdata) < 1000000)
+void vgm_poke8(QP_Vgm* v, int32_t offset, uint8_t d)
+{
+    if(offset >= 0 && offset < 0x100)
+        *(uint8_t*)(v->header+offset)= d;
+}
+
+// notice: start offset was replaced with ROM mask.
+// Written directly, so this must be called before vgm_start.
+void vgm_datablock(QP_Vgm* v, uint8_t dbtype, uint32_t dbsize, uint8_t* datablock, uint32_t maxsize, uint32_t mask, int32_t flags)
+{
+    uint32_t i, offset, len;
+
+    add_datablockcmd(v, dbtype, dbsize|flags, maxsize, 0);
+
+    // the mask is one less than a power of two
+    for(i=0;i<dbsize;i+=len)
     {
-        uint8_t* temp;
-        temp = realloc(vgmdata,buffer_size*2);
-        if(temp)
-        {
-            buffer_size *= 2;
-            data = temp+(data-vgmdata);
-            vgmdata = temp;
-        }
+        offset = i & mask;
+        len = mask+1-offset;
+        if(len > dbsize-i || !len)
+            len = dbsize-i;
+        vgm_put(v,datablock+offset,len);
     }
 }
 
+void vgm_setloop(QP_Vgm* v)
+{
+    vgm_push_delay(v);
+    vgm_push(v,VGM_EVENT_LOOP,0,0,0);
+}
+
+void vgm_write(QP_Vgm* v, uint8_t command, uint8_t port, uint16_t reg, uint16_t value)
+{
+    vgm_push_delay(v);
+    vgm_push(v,command,port,reg,value);
+}
+
 // delay is in VGM samples*10.
-void vgm_delay(uint32_t delay)
+void vgm_delay(QP_Vgm* v, uint32_t delay)
 {
-    delayq+=delay;
+    v->delay+=delay;
 }
 
 // https://github.com/cppformat/cppformat/pull/130/files
-void gd3_write_string(char* s)
+static void gd3_write_string(uint8_t** dest, char* s)
 {
+    wchar_t temp[256];
     size_t l;
     #if defined(_WIN32) && defined(__MINGW32__) && !defined(__NO_ISOCEXT)
-        l = _snwprintf((wchar_t*)data,256,L"%S", s);
+        l = _snwprintf(temp,256,L"%S", s);
     #else
-        l = swprintf((wchar_t*)data,256,L"%s", s);
+        l = swprintf(temp,256,L"%s", s);
     #endif // defined
 
-    data += (l+1)*2;
+    memcpy(*dest,temp,(l+1)*2);
+    *dest += (l+1)*2;
 }
 
-void vgm_write_tag(char* gamename,int songid)
+// Must be called after vgm_stop.
+void vgm_write_tag(QP_Vgm* v, char* gamename,int songid)
 {
+    uint8_t tag[11*512];
+    uint8_t* data = tag;
+    uint32_t len;
+
     time_t t;
     struct tm * tm;
     time(&t);
@@ -207,49 +363,66 @@ void vgm_write_tag(char* gamename,int songid)
         sprintf(tracknotes,"Song ID: %03x\n",songid&0x7ff);
     strcpy(tracknotes+strlen(tracknotes),"Generated using QuattroPlay by ctr (Built "__DATE__" "__TIME__")");
 
-    // Tag offset
-    *(uint32_t*)(vgmdata+0x14)= data-vgmdata-0x14;
-
-    memcpy(data, "Gd3 \x00\x01\x00\x00" , 8);
-    uint8_t* len_s = data+8;
-    data+=12;
+    gd3_write_string(&data, ""); // Track name
+    gd3_write_string(&data, ""); // Track name (native)
+    gd3_write_string(&data, gamename); // Game name
+    gd3_write_string(&data, ""); // Game name (native)
+    gd3_write_string(&data, "Arcade Machine"); // System name
+    gd3_write_string(&data, ""); // System name (native)
+    gd3_write_string(&data, ""); // Author name
+    gd3_write_string(&data, ""); // Author name (native)
+    gd3_write_string(&data, ts); // Time
+    gd3_write_string(&data, ""); // Pack author
+    gd3_write_string(&data, tracknotes); // Notes
 
-    gd3_write_string(""); // Track name
-    gd3_write_string(""); // Track name (native)
-    gd3_write_string(gamename); // Game name
-    gd3_write_string(""); // Game name (native)
-    gd3_write_string("Arcade Machine"); // System name
-    gd3_write_string(""); // System name (native)
-    gd3_write_string(""); // Author name
-    gd3_write_string(""); // Author name (native)
-    gd3_write_string(ts); // Time
-    gd3_write_string(""); // Pack author
-    gd3_write_string(tracknotes); // Notes
+    // Tag offset
+    *(uint32_t*)(v->header+0x14)= v->pos-0x14;
 
-    *(uint32_t*)(len_s) = data-len_s-4;        // length
+    len = data-tag;
+    vgm_put(v, "Gd3 \x00\x01\x00\x00", 8);
+    vgm_put(v, &len, 4);
+    vgm_put(v, tag, len);
 }
 
-void vgm_stop()
+void vgm_stop(QP_Vgm* v)
 {
-    if(delayq/10 > 1)
+    vgm_stop_writer(v);
+    if(v->delayq/10 > 1)
     {
-        add_delay(&data,delayq/10);
-        delayq=0;
+        add_delay(v,v->delayq/10);
+        v->delayq=0;
     }
-    *data++ = 0x66;
+    vgm_put8(v,0x66);
 
     // Sample count/loop sample count
-    *(uint32_t*)(vgmdata+0x18)= samplecnt;
-    if(loop_set)
-        *(uint32_t*)(vgmdata+0x20)= samplecnt-loop_set;
+    *(uint32_t*)(v->header+0x18)= v->samplecnt;
+    if(v->loop_set)
+        *(uint32_t*)(v->header+0x20)= v->samplecnt-v->loop_set;
 }
 
-void vgm_close()
+void vgm_close(QP_Vgm* v)
 {
-    // EoF offset
-    *(uint32_t*)(vgmdata+0x04)= data-vgmdata-4;
+    if(v->running)
+        vgm_stop_writer(v);
 
-    write_file(filename, vgmdata, data-vgmdata);
-
-    free(vgmdata);
+    // EoF offset
+    *(uint32_t*)(v->header+0x04)= v->pos-4;
+
+    vgm_flush(v);
+    if(fseek(v->file,0,SEEK_SET) || fwrite(v->header,1,0x100,v->file) != 0x100)
+        v->error = 1;
+    if(fclose(v->file))
+        v->error = 1;
+
+    if(v->error)
+        fprintf(stderr,"Error writing %s\n",v->filename);
+    else
+        printf("%u bytes written to %s.\n",v->pos,v->filename);
+    if(v->waits)
+        printf("VGM writer fell behind %u times\n",v->waits);
+
+    free(v->ring);
+    free(v->chunk);
+    free(v->filename);
+    memset(v,0,sizeof(*v));
 }
@@ -1,20 +1,62 @@
 #ifndef VGM_H_INCLUDED
 #define VGM_H_INCLUDED
 
+#include <stdio.h>
 #include <stdint.h>
 
-// samplerom, samplelen, rom_offset
-//void vgm_open(char* fname, uint8_t* datablock, uint32_t dbsize, uint32_t startoffset);
-void vgm_open(char* fname);
-void vgm_write(uint8_t command, uint8_t port, uint16_t reg, uint16_t value);
-void vgm_delay(uint32_t delay);
-void vgm_setloop();
-void vgm_loop();
-void vgm_stop();
-void vgm_write_tag(char* gamename,int songid);
-void vgm_close();
-void vgm_poke32(int32_t offset, uint32_t d);
-void vgm_poke8(int32_t offset, uint8_t d);
-void vgm_datablock(uint8_t dbtype, uint32_t dbsize, uint8_t* datablock, uint32_t maxsize, uint32_t mask, int32_t flags);
+#include "worker.h"
+
+// events queued between the render thread and the writer, power of two
+#define VGM_RING_SIZE 65536
+
+typedef struct {
+    uint8_t command; // VGM command, or an internal event (see vgm.c)
+    uint8_t port;
+    uint16_t reg;
+    uint32_t value;
+} QP_VgmEvent;
+
+// VGM log state. Each sound driver instance logs to its own.
+// Chip writes and delays are queued in a ring by the thread running the
+// driver, without allocating or blocking on I/O. A writer thread encodes
+// them and streams the file in chunks. The header is written at close.
+typedef struct {
+    FILE* file;
+    char* filename;
+    uint8_t header[0x100];
+    int error;
+
+    // writer side
+    uint32_t pos; // file position, including unflushed data
+    uint32_t delayq;
+    uint32_t samplecnt;
+    uint32_t loop_set;
+    uint8_t* chunk;
+    uint32_t chunk_fill;
+
+    // producer side
+    uint32_t delay; // not yet queued
+    uint32_t waits; // times the ring was full
+
+    QP_VgmEvent* ring;
+    uint32_t read, write; // free running, accessed atomically
+    int stop;
+    int running;
+    QP_Worker writer;
+} QP_Vgm;
+
+int  vgm_open(QP_Vgm* v, char* fname);
+// Start the writer thread, after the data blocks are written.
+int  vgm_start(QP_Vgm* v);
+void vgm_write(QP_Vgm* v, uint8_t command, uint8_t port, uint16_t reg, uint16_t value);
+void vgm_delay(QP_Vgm* v, uint32_t delay);
+void vgm_setloop(QP_Vgm* v);
+// Stop the writer thread and end the command stream.
+void vgm_stop(QP_Vgm* v);
+void vgm_write_tag(QP_Vgm* v, char* gamename,int songid);
+void vgm_close(QP_Vgm* v);
+void vgm_poke32(QP_Vgm* v, int32_t offset, uint32_t d);
+void vgm_poke8(QP_Vgm* v, int32_t offset, uint8_t d);
+void vgm_datablock(QP_Vgm* v, uint8_t dbtype, uint32_t dbsize, uint8_t* datablock, uint32_t maxsize, uint32_t mask, int32_t flags);
 
 #endif // VGM_H_INCLUDED
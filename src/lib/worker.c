@@ -0,0 +1,181 @@
+/*
+    Worker thread
+*/
+#include <string.h>
+
+#include "worker.h"
+
+#ifdef QP_NO_SDL
+
+#include <time.h>
+
+static int QP_WorkerSemInit(QP_WorkerSem* s)
+{
+    s->Count = 0;
+    if(pthread_mutex_init(&s->Lock,NULL))
+        return -1;
+    if(pthread_cond_init(&s->Cond,NULL))
+    {
+        pthread_mutex_destroy(&s->Lock);
+        return -1;
+    }
+    return 0;
+}
+
+static void QP_WorkerSemFree(QP_WorkerSem* s)
+{
+    pthread_cond_destroy(&s->Cond);
+    pthread_mutex_destroy(&s->Lock);
+}
+
+static void QP_WorkerSemPost(QP_WorkerSem* s)
+{
+    pthread_mutex_lock(&s->Lock);
+    s->Count++;
+    pthread_cond_signal(&s->Cond);
+    pthread_mutex_unlock(&s->Lock);
+}
+
+static void QP_WorkerSemWait(QP_WorkerSem* s)
+{
+    pthread_mutex_lock(&s->Lock);
+    while(!s->Count)
+        pthread_cond_wait(&s->Cond,&s->Lock);
+    s->Count--;
+    pthread_mutex_unlock(&s->Lock);
+}
+
+static void* QP_WorkerThread(void* data)
+{
+    QP_Worker* w = data;
+    for(;;)
+    {
+        QP_WorkerSemWait(&w->Start);
+        if(w->Quit)
+            break;
+        w->Job(w->Data);
+        QP_WorkerSemPost(&w->Done);
+    }
+    return NULL;
+}
+
+// Start the worker thread. Returns nonzero on failure.
+int QP_WorkerInit(QP_Worker* w,const char* name)
+{
+    memset(w,0,sizeof(*w));
+    if(QP_WorkerSemInit(&w->Start))
+        return -1;
+    if(QP_WorkerSemInit(&w->Done))
+    {
+        QP_WorkerSemFree(&w->Start);
+        return -1;
+    }
+    w->Running = !pthread_create(&w->Thread,NULL,QP_WorkerThread,w);
+    if(!w->Running)
+    {
+        QP_WorkerSemFree(&w->Start);
+        QP_WorkerSemFree(&w->Done);
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the worker thread. Must not be called while a job is running.
+void QP_WorkerFree(QP_Worker* w)
+{
+    if(!w->Running)
+        return;
+    w->Quit = 1;
+    QP_WorkerSemPost(&w->Start);
+    pthread_join(w->Thread,NULL);
+    QP_WorkerSemFree(&w->Start);
+    QP_WorkerSemFree(&w->Done);
+    memset(w,0,sizeof(*w));
+}
+
+void QP_WorkerRun(QP_Worker* w,QP_WorkerJob job,void* data)
+{
+    w->Job = job;
+    w->Data = data;
+    QP_WorkerSemPost(&w->Start);
+}
+
+void QP_WorkerWait(QP_Worker* w)
+{
+    QP_WorkerSemWait(&w->Done);
+}
+
+void QP_WorkerSleep(int ms)
+{
+    struct timespec ts = {ms/1000,(ms%1000)*1000000L};
+    nanosleep(&ts,NULL);
+}
+
+#else
+
+#include "SDL2/SDL_timer.h"
+
+static int QP_WorkerThread(void* data)
+{
+    QP_Worker* w = data;
+    for(;;)
+    {
+        SDL_SemWait(w->Start);
+        if(w->Quit)
+            break;
+        w->Job(w->Data);
+        SDL_SemPost(w->Done);
+    }
+    return 0;
+}
+
+// Start the worker thread. Returns nonzero on failure.
+int QP_WorkerInit(QP_Worker* w,const char* name)
+{
+    memset(w,0,sizeof(*w));
+    w->Start = SDL_CreateSemaphore(0);
+    w->Done = SDL_CreateSemaphore(0);
+    if(w->Start && w->Done)
+        w->Thread = SDL_CreateThread(QP_WorkerThread,name,w);
+    if(!w->Thread)
+    {
+        QP_WorkerFree(w);
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the worker thread. Must not be called while a job is running.
+void QP_WorkerFree(QP_Worker* w)
+{
+    if(w->Thread)
+    {
+        w->Quit = 1;
+        SDL_SemPost(w->Start);
+        SDL_WaitThread(w->Thread,NULL);
+    }
+    if(w->Start)
+        SDL_DestroySemaphore(w->Start);
+    if(w->Done)
+        SDL_DestroySemaphore(w->Done);
+    memset(w,0,sizeof(*w));
+}
+
+void QP_WorkerRun(QP_Worker* w,QP_WorkerJob job,void* data)
+{
+    w->Job = job;
+    w->Data = data;
+    SDL_SemPost(w->Start);
+}
+
+void QP_WorkerWait(QP_Worker* w)
+{
+    SDL_SemWait(w->Done);
+}
+
+void QP_WorkerSleep(int ms)
+{
+    SDL_Delay(ms);
+}
+
+#endif // QP_NO_SDL
@@ -0,0 +1,49 @@
+#ifndef WORKER_H_INCLUDED
+#define WORKER_H_INCLUDED
+
+#ifdef QP_NO_SDL
+#include <pthread.h>
+#else
+#include "SDL2/SDL_mutex.h"
+#include "SDL2/SDL_thread.h"
+#endif
+
+typedef void (*QP_WorkerJob)(void* data);
+
+// A thread that runs one job at a time. QP_WorkerRun starts a job and
+// QP_WorkerWait waits for it to finish. Everything written before
+// QP_WorkerRun is visible to the job, and everything written by the job
+// is visible after QP_WorkerWait.
+#ifdef QP_NO_SDL
+// pthread backend, used when building without SDL (see Makefile lib target)
+typedef struct {
+    pthread_mutex_t Lock;
+    pthread_cond_t Cond;
+    int Count;
+} QP_WorkerSem;
+#endif
+
+typedef struct {
+#ifdef QP_NO_SDL
+    pthread_t Thread;
+    int Running;
+    QP_WorkerSem Start;
+    QP_WorkerSem Done;
+#else
+    SDL_Thread* Thread;
+    SDL_sem* Start;
+    SDL_sem* Done;
+#endif
+    QP_WorkerJob Job;
+    void* Data;
+    int Quit;
+} QP_Worker;
+
+int  QP_WorkerInit(QP_Worker* w,const char* name);
+void QP_WorkerFree(QP_Worker* w);
+void QP_WorkerRun(QP_Worker* w,QP_WorkerJob job,void* data);
+void QP_WorkerWait(QP_Worker* w);
+// Sleep the calling thread, for polling.
+void QP_WorkerSleep(int ms);
+
+#endif // WORKER_H_INCLUDED
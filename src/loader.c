@@ -15,14 +15,49 @@
 #include "libgen.h"
 #endif // WIN32
 
-#include "SDL2/SDL.h"
-
-#include "qp.h"
-#include "legacy.h"
+#include "macro.h"
+#include "loader.h"
+#include "driver.h"
+#include "context.h"
+#include "drv/quattro.h"
+#include "emu/c352.h"
+#include "emu/ym2151.h"
 
 #include "lib/vgm.h"
 #include "lib/ini.h"
 #include "lib/fileio.h"
+#include "lib/resample.h"
+
+char QP_IniPath[128];
+char QP_WavePath[128];
+char QP_DataPath[128];
+
+// Defaults before the global configuration is read
+void QP_GameDefaults(QP_Game *G)
+{
+    memset(G,0,sizeof(QP_Game));
+
+    G->AutoPlay = -1;
+
+    G->MuteRear=0;
+    G->BaseGain=32.0;
+    G->UIGain=1.0;
+    G->AudioBuffer=1024;
+    G->RenderAhead=0;
+    G->ResampleQuality=QP_RESAMPLE_DEFAULT;
+    G->C352Core=C352_CORE_AUTO;
+    G->YM2151Core=YM2151_CORE_AUTO;
+    G->SampleCache=0;
+    G->FMThread=0;
+    G->DriverOnly=0;
+    G->BuildIndex=1;
+
+    G->Headless=0;
+    G->Analyze=0;
+    G->RenderLoops=2;
+    G->RenderTime=0;
+    G->RenderRate=0;
+}
 
 static int rom_deinterleave(QP_Game *G)
 {
@@ -60,16 +95,15 @@ char* my_realpath(char* filepath)
 
 // Loads game ini, then the sound data and wave roms...
 // this is a huge and messy function and needs to be replaced.
-int LoadGame(QP_Game *G)
+// Does not touch any globals other than the paths, so it can be used to load
+// games in the background. Errors are appended to msgstring.
+int LoadGameData(QP_Game *G,int *DriverType,char *msgstring)
 {
-    //Q_State* Q = G->QDrv;
-
-    static char msgstring[1024];
-    static char *filename;
-    static char *path;
+    char *filename;
+    char *path;
     //static char gamehackname[128];
-    static char wave0[16];
-    static char wave1[16];
+    char wave0[16];
+    char wave1[16];
 
     int byteswap = 0;
     int interleave=0;
@@ -97,22 +131,20 @@ int LoadGame(QP_Game *G)
     unsigned int action_reg = 0;
     unsigned int action_data = 0;
 
-    static int patchtype[64];
-    static int patchaddr[64];
-    static int patchdata[64];
+    int patchtype[64];
+    int patchaddr[64];
+    int patchdata[64];
 
-    static char wave_filename[16][128];
-    static char data_filename[16][128];
-    static char driver_name[128];
+    char wave_filename[16][128];
+    char data_filename[16][128];
+    char driver_name[128];
 
     char *ini_realpath = 0;
 
     filename = malloc(2048);
     path = malloc(2048);
-    msgstring[0] = 0;
     path[0] = 0;
 
-    sprintf(msgstring,"Failed to load '%s':",G->Name);
     int loadok = strlen(msgstring);
 
     // if dot is found, direct path to ini is assumed
@@ -260,7 +292,7 @@ int LoadGame(QP_Game *G)
                     G->Playlist[G->SongCount].SongID = action_reg;
                     G->Playlist[G->SongCount].Bank = -1;
                     strncpy(G->Playlist[G->SongCount].Title,initest.value,254);
-                    G->Playlist[G->SongCount].script[action_id].wait_type=0;
+                    G->Playlist[G->SongCount].script[action_id].wait_type=3;
                     G->Playlist[G->SongCount].script[action_id].wait_count=2;
                     G->Playlist[G->SongCount].script[action_id].action_id=-1;
                     G->SongCount++;
@@ -301,7 +333,6 @@ int LoadGame(QP_Game *G)
         else
             strcat(msgstring,ini_error[initest.status]);
 
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error",msgstring,NULL);
         ini_close(&initest);
 
         free(filename);
@@ -425,13 +456,7 @@ int LoadGame(QP_Game *G)
 #endif
 
     if(loadok != strlen(msgstring))
-    {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error",msgstring,NULL);
         return -1;
-    }
-
-    DriverInterface = (struct QP_DriverInterface*)malloc(sizeof(struct QP_DriverInterface));
-    memset(DriverInterface,0,sizeof(struct QP_DriverInterface));
 
     for(i=0;driver_name[i];i++)
         driver_name[i] = tolower(driver_name[i]);
@@ -440,42 +465,64 @@ int LoadGame(QP_Game *G)
     {
         if(!strcmp(driver_name,DriverTable[i].name))
         {
-            printf("loading driver: %s\n",DriverTable[i].name);
-            if(DriverCreate(DriverInterface,i))
-                break;
-            QDrv = NULL;
-            if(i == DRIVER_QUATTRO)
-                QDrv = DriverInterface->Driver;
+            *DriverType = DriverTable[i].type;
             return 0;
         }
     }
-    if(i==DRIVER_COUNT)
-        sprintf(msgstring,"%s Unable to find matching driver type for \"%s\"",msgstring,driver_name);
-    else
-        sprintf(msgstring,"%s Failed to create driver \"%s\"",msgstring,driver_name);
-    SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error",msgstring,NULL);
+    sprintf(msgstring+strlen(msgstring)," Unable to find matching driver type for \"%s\"",driver_name);
     return -1;
 }
 
-int UnloadGame(QP_Game *G)
+void FreeGameData(QP_Game *G)
 {
-    if(G->Data)
-        free(G->Data);
-    if(G->WaveData)
-        free(G->WaveData);
-    //free(Q_Chip);
-    QDrv = NULL;
-    DriverDestroy(DriverInterface);
-    free(DriverInterface);
-    DriverInterface=0;
+    free(G->Data);
+    free(G->WaveData);
+    G->Data = NULL;
+    G->WaveData = NULL;
+}
+
+int LoadGame(QP_Context *ctx)
+{
+    QP_Game *G = ctx->Game;
+    struct QP_DriverInterface *di;
+    char* msgstring = ctx->Error;
+    int type;
+
+    sprintf(msgstring,"Failed to load '%s':",G->Name);
+    if(LoadGameData(G,&type,msgstring))
+        return -1;
+
+    di = (struct QP_DriverInterface*)malloc(sizeof(struct QP_DriverInterface));
+    if(di)
+        memset(di,0,sizeof(struct QP_DriverInterface));
+    ctx->DriverInterface = di;
+
+    if(!di || DriverCreate(di,type))
+    {
+        sprintf(msgstring+strlen(msgstring)," Failed to create driver \"%s\"",DriverTable[type].name);
+        return -1;
+    }
+    msgstring[0] = 0;
     return 0;
 }
 
-int InitGame(QP_Game *Game)
+int UnloadGame(QP_Context *ctx)
 {
-    if(DriverInit())
+    FreeGameData(ctx->Game);
+    DriverDestroy(ctx->DriverInterface);
+    free(ctx->DriverInterface);
+    ctx->DriverInterface=0;
+    return 0;
+}
+
+int InitGame(QP_Context *ctx)
+{
+    QP_Game *Game = ctx->Game;
+    char filename[FILENAME_MAX];
+
+    if(DriverInit(ctx))
     {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error","Failed to initialize driver",NULL);
+        strcpy(ctx->Error,"Failed to initialize driver");
         return -1;
     }
     // Initialize sound chip and some initial sound driver parameters.
@@ -486,86 +533,66 @@ int InitGame(QP_Game *Game)
     Game->PlaylistSongID = 0;
     Game->ActionTimer = 0;
 
-    static char filename[FILENAME_MAX];
-
-    char* audiodev = NULL;
-    if(strlen(Game->AudioDevice))
-        audiodev = Game->AudioDevice;
-
     if(Game->VgmLog)
     {
         strcpy(filename,"qp_log.vgm");
-        if(Game->AutoPlay >= 0)
+        if(strlen(Game->VgmFile))
+            strcpy(filename,Game->VgmFile);
+        else if(Game->AutoPlay >= 0)
         {
             sprintf(filename,"%s_%03x.vgm",Game->Name,Game->AutoPlay&0x7ff);
         }
-        vgm_open(filename);
-
-        DriverInitVgm();
+        if(vgm_open(&ctx->Vgm,filename))
+        {
+            printf("Could not open VGM log '%s'\n",filename);
+            Game->VgmLog = 0;
+        }
+        else
+        {
+            DriverInitVgm(ctx);
+            if(vgm_start(&ctx->Vgm))
+                printf("Could not start VGM writer, writing from the render thread\n");
+        }
     }
 
     Game->QueueSong=Game->AutoPlay;
 
-    DriverReset(1);
-
-    if(QP_AudioInit(Audio,DriverGetChipRate(),Game->AudioBuffer,4,audiodev))
-    {
-        // we couldn't initialize audio with 4 channels, let's try 2 instead...
-        Game->Gain/=2; // you'll thank me for this
-        if(QP_AudioInit(Audio,DriverGetChipRate(),Game->AudioBuffer,2,audiodev))
-            return -1;
-    }
-
-    Audio->state.AutoPlaySong = Game->AutoPlay;
-    Audio->state.MuteRear = Game->MuteRear;
-    Audio->state.Gain = Game->BaseGain*Game->Gain;
-
-    if(Game->WavLog)
-    {
-        strcpy(filename,"qp_log.wav");
-        if(Game->AutoPlay >= 0)
-        {
-            sprintf(filename,"%s_%03x.wav",Game->Name,Game->AutoPlay&0x7ff);
-        }
-        QP_AudioWavOpen(Audio,filename);
-    }
+    // the render state needs the context as soon as audio starts
+    ctx->State->Context = ctx;
 
+    DriverReset(ctx,1);
     return 0;
 }
 
-void DeInitGame(QP_Game *Game)
+// Audio output must be closed before calling this
+void DeInitGame(QP_Context *ctx)
 {
-    if(Audio->state.FileLogging)
-    {
-        SDL_LockAudioDevice(Audio->dev);
-        QP_AudioWavClose(Audio);
-        SDL_UnlockAudioDevice(Audio->dev);
-    }
+    QP_Game *Game = ctx->Game;
 
     if(Game->VgmLog)
     {
-        SDL_LockAudioDevice(Audio->dev);
-        DriverCloseVgm();
-        vgm_stop();
-        vgm_write_tag(strlen(Game->Title) ? Game->Title : Game->Name,Game->AutoPlay);
-        vgm_close();
-        SDL_UnlockAudioDevice(Audio->dev);
+        DriverCloseVgm(ctx);
+        vgm_stop(&ctx->Vgm);
+        vgm_write_tag(&ctx->Vgm,strlen(Game->Title) ? Game->Title : Game->Name,Game->AutoPlay);
+        vgm_close(&ctx->Vgm);
     }
 
-    DriverDeinit();
+    DriverDeinit(ctx);
 }
 
-void ResetGame(QP_Game *Game)
+void ResetGame(QP_Context *ctx)
 {
-    DriverReset(0);
+    QP_Game *Game = ctx->Game;
+    DriverReset(ctx,0);
     Game->PlaylistControl=0;
     Game->Fadeout=0;
     Game->QueueSong=Game->AutoPlay;
 }
 
 // Perform register action (song triggers).
-void GameDoAction(QP_Game *G,unsigned int id)
+void GameDoAction(QP_Context *ctx,unsigned int id)
 {
+    QP_Game *G = ctx->Game;
     if(id > 255)
         return;
     int i,reg;
@@ -573,23 +600,24 @@ void GameDoAction(QP_Game *G,unsigned int id)
     {
         reg = G->Action[id].reg[i];
         if(reg<0x100)
-            DriverSetParameter(G->Action[id].reg[i],G->Action[id].data[i]);
+            DriverSetParameter(ctx,G->Action[id].reg[i],G->Action[id].data[i]);
         //G->QDrv->Register[G->Action[id].reg[i]&0xff] = G->Action[id].data[i];
         else if(reg<0x120)
-            DriverRequestSong(G->Action[id].reg[i]&0x1f,G->Action[id].data[i]&0x7ff);
+            DriverRequestSong(ctx,G->Action[id].reg[i]&0x1f,G->Action[id].data[i]&0x7ff);
         //G->QDrv->SongRequest[G->Action[id].reg[i]&0x1f] = G->Action[id].data[i];
     }
     return;
 }
 
-void GameDoUpdate(QP_Game *G)
+void GameDoUpdate(QP_Context *ctx)
 {
+    QP_Game *G = ctx->Game;
     int i;
 
     // todo...
-    if(DriverInterface->Type == DRIVER_QUATTRO && QDrv->BootSong != 0)
+    if(ctx->DriverInterface->Type == DRIVER_QUATTRO && ((Q_State*)ctx->DriverInterface->Driver)->BootSong != 0)
     {
-        Audio->state.Gain = G->BaseGain*G->Gain*G->UIGain*(1-G->Fadeout);
+        ctx->State->Gain = G->BaseGain*G->Gain*G->UIGain*(1-G->Fadeout);
         return;
     }
 
@@ -603,7 +631,7 @@ void GameDoUpdate(QP_Game *G)
         int state = 0;
         int SongReq = G->PlaylistSongID & 0x800 ? 8 : 0;
 
-        int loopcnt = DriverGetLoopCount(SongReq);
+        int loopcnt = DriverGetLoopCount(ctx,SongReq);
 
         // time out
         if(S->wait_type == 2)
@@ -612,22 +640,22 @@ void GameDoUpdate(QP_Game *G)
             if(++G->PlaylistLoop > 1)
                 state = 1;
         }
-        if(S->wait_type == 1 && DriverGetPlayingTime(SongReq) > S->wait_count)
+        if(S->wait_type == 1 && DriverGetPlayingTime(ctx,SongReq) > S->wait_count)
             state=1;
-        if(S->wait_type == 0 && loopcnt >= S->wait_count)
+        if((S->wait_type == 0 || S->wait_type == 3) && loopcnt >= S->wait_count)
             state=1;
 
         // song is stopped
         //if((QDrv->SongRequest[SongReq]&0x8000) == 0)
-        if(!(DriverGetSongStatus(SongReq)&(SONG_STATUS_PLAYING|SONG_STATUS_STOPPING)))
+        if(!(DriverGetSongStatus(ctx,SongReq)&(SONG_STATUS_PLAYING|SONG_STATUS_STOPPING)))
             state=2;
 
         if(G->Fadeout>1)
         {
-            for(i=0;i<DriverGetSlotCount();i++)
-                DriverStopSong(i);
+            for(i=0;i<DriverGetSlotCount(ctx);i++)
+                DriverStopSong(ctx,i);
             for(i=0;i<15;i++)
-                DriverUpdateTick();
+                DriverUpdateTick(ctx);
             G->Fadeout=0;
         }
 
@@ -643,7 +671,7 @@ void GameDoUpdate(QP_Game *G)
             {
                 // do the previous action immediately...
                 if(G->ActionTimer)
-                    GameDoAction(G,G->QueueAction);
+                    GameDoAction(ctx,G->QueueAction);
                 Q_DEBUG("doing action %d...\n",S->action_id);
                 G->ActionTimer=20; // some songs don't like when actions are triggered immediately after loop...
                 G->QueueAction=S->action_id;
@@ -655,12 +683,12 @@ void GameDoUpdate(QP_Game *G)
                 G->PlaylistLoop=60;
                 //G->QDrv->SongRequest[SongReq]|=0x2000;
 
-                if(DriverInterface->Type == DRIVER_QUATTRO)
-                    DriverFadeOutSong(SongReq);
+                if(ctx->DriverInterface->Type == DRIVER_QUATTRO)
+                    DriverFadeOutSong(ctx,SongReq);
                 else
                     G->Fadeout+=0.01;
             }
-            DriverResetLoopCount();
+            DriverResetLoopCount(ctx);
             break;
         case 2:
             G->PlaylistLoop++;
@@ -668,7 +696,7 @@ void GameDoUpdate(QP_Game *G)
             {
                 // if all voices are silent, advance immediately.
                 // otherwise, we will wait half a second before advancing
-                if(DriverDetectSilence())
+                if(DriverDetectSilence(ctx))
                     break;
             }
             else if(G->PlaylistLoop<60)
@@ -691,11 +719,11 @@ void GameDoUpdate(QP_Game *G)
     {
         G->Fadeout=0;
 
-        for(i=0;i<DriverGetSlotCount();i++)
-            DriverStopSong(i);
+        for(i=0;i<DriverGetSlotCount(ctx);i++)
+            DriverStopSong(ctx,i);
 
         // driver may need to process the stop first
-        DriverUpdateTick();
+        DriverUpdateTick(ctx);
 
         G->QueueSong = G->Playlist[G->PlaylistPosition].SongID;
         G->PlaylistSongID = G->Playlist[G->PlaylistPosition].SongID;
@@ -704,13 +732,13 @@ void GameDoUpdate(QP_Game *G)
         G->PlaylistLoop = 0;
         G->ActionTimer = 0;
         if(G->Playlist[G->PlaylistPosition].Bank >= 0)
-            GameDoAction(G,G->Playlist[G->PlaylistPosition].Bank);
+            GameDoAction(ctx,G->Playlist[G->PlaylistPosition].Bank);
     }
 
     if(G->QueueSong >= 0)
     {
-        DriverResetLoopCount();
-        DriverRequestSong(G->QueueSong & 0x800 ? 8 : 0, G->QueueSong&0x7ff);
+        DriverResetLoopCount(ctx);
+        DriverRequestSong(ctx,G->QueueSong & 0x800 ? 8 : 0, G->QueueSong&0x7ff);
         //Q_LoopDetectionReset(G->QDrv);
         //G->QDrv->SongRequest[G->QueueSong & 0x800 ? 8 : 0] = 0x4000 | (G->QueueSong&0x7ff);
     }
@@ -718,7 +746,7 @@ void GameDoUpdate(QP_Game *G)
     G->QueueSong = -1;
 
     if(G->ActionTimer && --G->ActionTimer == 0)
-        GameDoAction(G,G->QueueAction);
+        GameDoAction(ctx,G->QueueAction);
 
-    Audio->state.Gain = G->BaseGain*G->Gain*G->UIGain*(1-G->Fadeout);
+    ctx->State->Gain = G->BaseGain*G->Gain*G->UIGain*(1-G->Fadeout);
 }
@@ -3,8 +3,15 @@
 
 #include <stdint.h>
 
+struct QP_Context;
+
 #define GAME_CONFIG_MAX 256
 
+// Search paths for game configs and ROMs
+extern char QP_IniPath[128];
+extern char QP_WavePath[128];
+extern char QP_DataPath[128];
+
 typedef struct {
     int cnt;
     uint16_t reg[32];
@@ -12,7 +19,7 @@ typedef struct {
 } QP_GameAction;
 
 typedef struct {
-    int wait_type;
+    int wait_type; // 0 = loops, 1 = seconds, 2 = jump, 3 = default
     int wait_count;
     int action_id;
 } QP_PlaylistScript;
@@ -45,6 +52,8 @@ typedef struct {
     // audio configuration
     char AudioDevice[256];
     int AudioBuffer;
+    int RenderAhead; // frames buffered by the render thread (0 = auto)
+    int ResampleQuality; // used when the output rate differs from the chip rate
 
     // Global configuration
     int WavLog;
@@ -54,12 +63,27 @@ typedef struct {
     int BootSong;
     float BaseGain;
 
+    // Offline rendering (no audio device)
+    int Headless;
+    int Analyze; // measure all songs without rendering
+    int RenderLoops; // stop after this many loops (0 = ignore)
+    double RenderTime; // stop after this many seconds (0 = no limit)
+    int RenderRate; // output sample rate (0 = chip rate)
+    char OutputFile[256]; // overrides the default log filename
+    char VgmFile[256]; // overrides the default VGM log filename
+
     // Game configuration
     float UIGain;
     float Fadeout;
     float Gain;
     int MuteRear;
     int ChipFreq; // sound chip frequency, best to not touch this.
+    int C352Core; // C352 emulation core (0 = best available)
+    int YM2151Core; // YM2151 emulation core (0 = best available)
+    int SampleCache; // decoded sample cache size in MB (0 = disabled)
+    int FMThread; // render FM on a worker thread (System 2x)
+    int DriverOnly; // only the driver tick is run, sound chips are not rendered
+    int BuildIndex; // update the song index in the background
 
     QP_GameAction Action[256];
     QP_GameConfig Config[GAME_CONFIG_MAX];
@@ -79,13 +103,18 @@ typedef struct {
     int ActionTimer;
 } QP_Game;
 
-int LoadGame(QP_Game *Game);
-int UnloadGame(QP_Game *Game);
+void QP_GameDefaults(QP_Game *Game);
+int LoadGameData(QP_Game *Game,int *DriverType,char *msgstring);
+void FreeGameData(QP_Game *Game);
+
+// The following take the game from ctx->Game (see context.h)
+int LoadGame(struct QP_Context *ctx);
+int UnloadGame(struct QP_Context *ctx);
 
-int  InitGame(QP_Game *Game);
-void DeInitGame(QP_Game *Game);
+int  InitGame(struct QP_Context *ctx);
+void DeInitGame(struct QP_Context *ctx);
 
-void GameDoAction(QP_Game *G,unsigned int actionid);
-void GameDoUpdate(QP_Game *G);
+void GameDoAction(struct QP_Context *ctx,unsigned int actionid);
+void GameDoUpdate(struct QP_Context *ctx);
 
 #endif // LOADER_H_INCLUDED
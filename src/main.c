@@ -6,8 +6,15 @@
 #include "SDL2/SDL.h"
 
 #include "qp.h"
+#include "render.h"
+#include "analyze.h"
+#include "bench.h"
+#include "batch.h"
+#include "legacy.h"
 
 #include "lib/vgm.h"
+#include "emu/c352.h"
+#include "emu/ym2151.h"
 #include "lib/audit.h"
 #include "lib/ini.h"
 
@@ -41,6 +48,25 @@ portafix = 0\n\
 ; Audio buffer size (default = 2048)\n\
 ; Set it to a higher value if you encounter audio issues.\n\
 audiobuffer = 2048\n\
+; Number of samples rendered ahead of the audio device. Defaults to twice\n\
+; the audio buffer size. Increase if you hear dropouts when fast forwarding.\n\
+; renderahead = 4096\n\
+; Resampling quality, used if the audio device does not support the chip\n\
+; sample rate. 0 = fast, 1 = medium, 2 = high (default), 3 = best\n\
+resamplequality = 2\n\
+; C352 emulation core. 0 = best available (default), 1 = C, 2 = SSE4.1,\n\
+; 3 = AVX2. All cores produce the same output.\n\
+; c352core = 0\n\
+; YM2151 emulation core. 0 = best available (default), 1 = C, 2 = AVX2.\n\
+; ym2151core = 0\n\
+; Size of the decoded sample cache in MB, 0 = disabled (default).\n\
+; samplecache = 0\n\
+; Set to 1 to render the FM chip on a separate thread in System 2x games.\n\
+; Output is the same. Mostly useful when rendering faster than real time.\n\
+; fmthread = 0\n\
+; Set to 0 to disable the song length index, which is updated in the\n\
+; background when the game list is shown.\n\
+; songindex = 1\n\
 ; Audio device name (https://wiki.libsdl.org/SDL_GetAudioDeviceName)\n\
 ; Leave this intact for now\n\
 ; audiodevice =\n";
@@ -49,27 +75,26 @@ int main(int argc, char *argv[])
 {
     int loop = 0;
     int val = 0;
-    SDL_Init(SDL_INIT_AUDIO|SDL_INIT_VIDEO|SDL_INIT_TIMER);
+    char* batchfile = NULL;
+    int bench = 0;
 
     Audio = (QP_Audio*)malloc(sizeof(QP_Audio));
     memset(Audio,0,sizeof(QP_Audio));
 
     Game = (QP_Game*)malloc(sizeof(QP_Game));
-    memset(Game,0,sizeof(QP_Game));
 
     Audit = (QP_Audit*)malloc(sizeof(QP_Audit));
     memset(Audit,0,sizeof(QP_Audit));
 
-    DriverInterface=0;
-
-    if(!Audio || !Game)
+    Context = (QP_Context*)malloc(sizeof(QP_Context));
+    if(!Audio || !Game || !Context)
         return -1;
+    memset(Context,0,sizeof(QP_Context));
+    Context->Game = Game;
+    Context->Audio = Audio;
+    Context->State = &Audio->state;
 
-    Game->AutoPlay = -1;
-
-    Game->MuteRear=0;
-    Game->BaseGain=32.0;
-    Game->AudioBuffer=1024;
+    QP_GameDefaults(Game);
 
     FILE* f = NULL;
     f = fopen(config_filename,"r");
@@ -79,7 +104,6 @@ int main(int argc, char *argv[])
         if(!f)
         {
             SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error","Config file does not exist. Please create one.",NULL);
-            SDL_Quit();
             return -1;
         }
         fputs(default_config,f);
@@ -113,13 +137,26 @@ int main(int argc, char *argv[])
                     strcpy(Game->AudioDevice,initest.value);
                 else if(!strcmp(initest.key,"audiobuffer"))
                     Game->AudioBuffer = atoi(initest.value);
+                else if(!strcmp(initest.key,"renderahead"))
+                    Game->RenderAhead = atoi(initest.value);
+                else if(!strcmp(initest.key,"resamplequality"))
+                    Game->ResampleQuality = atoi(initest.value);
+                else if(!strcmp(initest.key,"c352core"))
+                    Game->C352Core = atoi(initest.value);
+                else if(!strcmp(initest.key,"ym2151core"))
+                    Game->YM2151Core = atoi(initest.value);
+                else if(!strcmp(initest.key,"samplecache"))
+                    Game->SampleCache = atoi(initest.value);
+                else if(!strcmp(initest.key,"fmthread"))
+                    Game->FMThread = atoi(initest.value);
+                else if(!strcmp(initest.key,"songindex"))
+                    Game->BuildIndex = atoi(initest.value);
             }
         }
         ini_close(&initest);
     }
     else
     {
-        SDL_Quit();
         return -1;
     }
 
@@ -144,6 +181,52 @@ int main(int argc, char *argv[])
         {
             Game->VgmLog=1;
         }
+        else if(!strcmp(argv[i],"-r") || !strcmp(argv[i],"--render"))
+        {
+            Game->Headless=1;
+        }
+        else if(!strcmp(argv[i],"--analyze"))
+        {
+            Game->Analyze=1;
+        }
+        else if(!strcmp(argv[i],"--bench"))
+        {
+            bench=1;
+        }
+        else if(!strcmp(argv[i],"--batch") && i+1<argc)
+        {
+            i++;
+            batchfile = argv[i];
+        }
+        else if((!strcmp(argv[i],"-o") || !strcmp(argv[i],"--output")) && i+1<argc)
+        {
+            i++;
+            if(snprintf(Game->OutputFile,sizeof(Game->OutputFile),"%s",argv[i]) >= (int)sizeof(Game->OutputFile))
+            {
+                printf("Output filename too long\n");
+                return -1;
+            }
+        }
+        else if((!strcmp(argv[i],"-l") || !strcmp(argv[i],"--loops")) && i+1<argc)
+        {
+            i++;
+            Game->RenderLoops = atoi(argv[i]);
+        }
+        else if((!strcmp(argv[i],"-t") || !strcmp(argv[i],"--time")) && i+1<argc)
+        {
+            i++;
+            Game->RenderTime = atof(argv[i]);
+        }
+        else if(!strcmp(argv[i],"--rate") && i+1<argc)
+        {
+            i++;
+            Game->RenderRate = atoi(argv[i]);
+        }
+        else if((!strcmp(argv[i],"-q") || !strcmp(argv[i],"--quality")) && i+1<argc)
+        {
+            i++;
+            Game->ResampleQuality = atoi(argv[i]);
+        }
         else
         {
             if(standard_args == 0)
@@ -157,7 +240,117 @@ int main(int argc, char *argv[])
 
     }
 
-    //Game->QDrv = QDrv;
+    if(batchfile)
+    {
+        SDL_Init(0);
+
+        val = QP_Batch(Game,batchfile);
+
+        SDL_Quit();
+
+        free(Audit);
+        free(Audio);
+        free(Game);
+        free(Context);
+
+        return val ? -1 : 0;
+    }
+
+    if(bench)
+    {
+        if(!strlen(Game->Name) || Game->AutoPlay < 0)
+        {
+            printf("A game name and song ID is required for the benchmark\n");
+            return -1;
+        }
+
+        SDL_Init(0);
+
+        val = LoadGame(Context);
+        if(!val)
+            val = QP_Bench(Context);
+        else
+            printf("%s\n",Context->Error);
+        UnloadGame(Context);
+
+        SDL_Quit();
+
+        free(Audit);
+        free(Audio);
+        free(Game);
+        free(Context);
+
+        return val ? -1 : 0;
+    }
+
+    if(Game->Analyze)
+    {
+        if(!strlen(Game->Name))
+        {
+            fprintf(stderr,"A game name is required for analysis\n");
+            return -1;
+        }
+
+        SDL_Init(0);
+
+        // only the report is written to stdout
+        val = LoadGame(Context);
+        if(!val)
+            val = QP_Analyze(Context);
+        else
+            fprintf(stderr,"%s\n",Context->Error);
+        UnloadGame(Context);
+
+        SDL_Quit();
+
+        free(Audit);
+        free(Audio);
+        free(Game);
+        free(Context);
+
+        return val ? -1 : 0;
+    }
+
+    if(Game->Headless)
+    {
+        if(!strlen(Game->Name) || Game->AutoPlay < 0)
+        {
+            printf("A game name and song ID is required for rendering\n");
+            return -1;
+        }
+
+        SDL_Init(0);
+
+        Game->WavLog=1;
+        val = LoadGame(Context);
+        if(!val)
+        {
+            printf("loading driver: %s\n",DriverTable[Context->DriverInterface->Type].name);
+            val = InitGame(Context);
+        }
+        if(!val)
+        {
+            val = QP_AudioOpen(Audio,Context);
+            if(!val)
+                val = QP_Render(Context);
+            QP_AudioClose(Audio);
+            DeInitGame(Context);
+        }
+        if(val && strlen(Context->Error))
+            printf("%s\n",Context->Error);
+        UnloadGame(Context);
+
+        SDL_Quit();
+
+        free(Audit);
+        free(Audio);
+        free(Game);
+        free(Context);
+
+        return val ? -1 : 0;
+    }
+
+    SDL_Init(SDL_INIT_AUDIO|SDL_INIT_VIDEO|SDL_INIT_TIMER);
 
     if(!strlen(Game->Name))
         loop=1;
@@ -168,6 +361,13 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    SongIndex = (QP_SongIndex*)malloc(sizeof(QP_SongIndex));
+    if(SongIndex && QP_SongIndexInit(SongIndex,SONGINDEX_FILENAME))
+    {
+        free(SongIndex);
+        SongIndex = NULL;
+    }
+
     while(1)
     {
         if(val == -1)
@@ -184,9 +384,25 @@ int main(int argc, char *argv[])
             else
                 strcpy(Game->Name,Audit->Entry[--val].Name);
         }
-        val = (LoadGame(Game) || InitGame(Game));
+        val = LoadGame(Context);
+        if(!val)
+        {
+            printf("loading driver: %s\n",DriverTable[Context->DriverInterface->Type].name);
+            QP_SongIndexSetPlaylistWait(SongIndex,Game);
+            val = InitGame(Context);
+        }
+        if(!val && QP_AudioOpen(Audio,Context))
+        {
+            QP_AudioClose(Audio);
+            DeInitGame(Context);
+            val = -1;
+        }
         if(!val)
         {
+            QDrv = NULL;
+            if(Context->DriverInterface->Type == DRIVER_QUATTRO)
+                QDrv = Context->DriverInterface->Driver;
+
             QP_AudioSetPause(Audio,0);
             Audio->state.UpdateRequest = QPAUDIO_CHIP_PLAY|QPAUDIO_DRV_PLAY;
 
@@ -194,21 +410,30 @@ int main(int argc, char *argv[])
 
             QP_AudioClose(Audio);
 
-            // Audio must be closed or locked before calling this
-            DeInitGame(Game);
+            // Audio must be closed before calling this
+            DeInitGame(Context);
         }
-        UnloadGame(Game);
+        else
+            SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Error",Context->Error,NULL);
+        UnloadGame(Context);
 
         if(val != -1 && !loop)
             break;
     }
 
+    if(SongIndex)
+    {
+        QP_SongIndexFree(SongIndex);
+        free(SongIndex);
+    }
+
     ui_deinit();
     SDL_Quit();
 
     free(Audit);
     free(Audio);
     free(Game);
+    free(Context);
 
     return 0;
 }
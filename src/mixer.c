@@ -0,0 +1,244 @@
+/*
+    Mixing and render timing
+
+    Runs the sound driver and chips for a block of output frames. This does
+    not depend on SDL, the audio device code in audio.c and the library
+    API both render through QP_AudioRender.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mixer.h"
+#include "driver.h"
+#include "lib/vgm.h"
+
+// Mix chip output to the output stream. chipch is the number of chip
+// samples per frame, missing channels are treated as silent.
+static void QP_AudioMix(QP_AudioCallbackData* S,float* stream,float* chip,int chipch,int frames,int updatemode)
+{
+    int i,j;
+    float c[4] = {0,0,0,0};
+
+    if(updatemode & QPAUDIO_MUTE)
+    {
+        for(i=0;i<frames*S->OutChannels;i++)
+            stream[i] = 0;
+        return;
+    }
+
+    for(i=0;i<frames;i++)
+    {
+        for(j=0;j<chipch;j++)
+            c[j] = chip[j];
+
+        if(S->OutChannels==1)
+            *stream = S->Gain*(c[0]+c[1]+c[2]+c[3]);
+        else if(S->OutChannels==2)
+        {
+            stream[0] = S->Gain*(c[0]+c[2]);
+            stream[1] = S->Gain*(c[1]+c[3]);
+        }
+        else if(S->OutChannels==4)
+        {
+            stream[0] = S->Gain*c[0];
+            stream[1] = S->Gain*c[1];
+            stream[2] = S->Gain*c[2];
+            stream[3] = S->Gain*c[3];
+        }
+        else
+        {
+            // unlikely...
+            for(j=0;j<S->OutChannels;j++)
+                stream[j] = c[0]+c[1]+c[2]+c[3];
+        }
+
+        chip += chipch;
+        stream += S->OutChannels;
+    }
+}
+
+// Run any pending driver ticks
+static void QP_AudioDriverTick(QP_AudioCallbackData* S)
+{
+    uint32_t delay;
+    while(QP_ClockEvent(&S->DriverClock))
+    {
+        DriverUpdateTick(S->Context);
+
+        if(S->Context->Game->VgmLog)
+        {
+            // VGM delay is in 1/10 samples, keep the remainder
+            S->VgmDelay += 441000ULL*S->TickDen;
+            delay = S->VgmDelay / S->TickNum;
+            S->VgmDelay -= (uint64_t)delay*S->TickNum;
+            vgm_delay(&S->Context->Vgm,delay);
+        }
+
+        GameDoUpdate(S->Context);
+    }
+}
+
+// Set the driver tick clock timebase. Also picks up tick rate changes and
+// fast forward.
+static void QP_AudioSetClock(QP_AudioCallbackData* S,uint32_t Rate)
+{
+    double TickRate = DriverGetTickRate(S->Context);
+    if(TickRate != S->TickRate)
+    {
+        S->TickRate = TickRate;
+        QP_ClockRational(TickRate,&S->TickNum,&S->TickDen);
+    }
+    QP_ClockSetRate(&S->DriverClock,S->TickNum*(S->FastForward ? 32 : 1),S->TickDen,Rate);
+}
+
+// Render frames between two driver ticks
+static void QP_AudioRenderSegment(QP_AudioCallbackData* S,float* stream,int frames,int chipch,int updatemode)
+{
+    int len;
+    while(frames > 0)
+    {
+        len = frames > QPAUDIO_BLOCK_SIZE ? QPAUDIO_BLOCK_SIZE : frames;
+        DriverRenderBlock(S->Context,S->ChipBuffer,len,chipch);
+        QP_AudioMix(S,stream,S->ChipBuffer,chipch,len,updatemode);
+        stream += len*S->OutChannels;
+        frames -= len;
+    }
+}
+
+// Render at the chip rate, so the chip can be rendered in blocks. The
+// buffer is split where driver ticks occur.
+static void QP_AudioRenderNative(QP_AudioCallbackData* S,float* stream,int frames,int updatemode)
+{
+    int chipch = S->MuteRear ? 2 : 4;
+    uint32_t len;
+
+    if(updatemode & QPAUDIO_DRV_PLAY)
+    {
+        while(frames > 0)
+        {
+            QP_AudioDriverTick(S);
+            len = QP_ClockUntil(&S->DriverClock);
+            if(len > frames)
+                len = frames;
+            QP_AudioRenderSegment(S,stream,len,chipch,updatemode);
+            QP_ClockAdvance(&S->DriverClock,len);
+            stream += len*S->OutChannels;
+            frames -= len;
+        }
+        return;
+    }
+    QP_AudioRenderSegment(S,stream,frames,chipch,updatemode);
+}
+
+// Resampler fill function. Renders and mixes at the chip rate
+static void QP_AudioResampleFill(void* data,float* buf,int frames)
+{
+    QP_AudioCallbackData* S = data;
+    QP_AudioRenderNative(S,buf,frames,S->ResampleMode);
+}
+
+// Render audio and run the sound driver. Called by the render thread, or
+// directly when rendering to a file.
+void QP_AudioRender(QP_AudioCallbackData* S,float* stream,int frames)
+{
+    float* start = stream;
+
+    int i;
+    float ChipOut[4] = {0,0,0,0};
+
+    int updatemode = S->UpdateRequest;
+
+    uint32_t ChipRate = DriverGetChipRate(S->Context);
+
+    if((updatemode & QPAUDIO_CHIP_PLAY) && ChipRate == S->SampleRate)
+    {
+        QP_AudioSetClock(S,ChipRate);
+        QP_AudioRenderNative(S,stream,frames,updatemode);
+    }
+    else if((updatemode & QPAUDIO_CHIP_PLAY) && S->Resample)
+    {
+        // mixing is linear, so the resampler only needs the output channels
+        QP_AudioSetClock(S,ChipRate);
+        S->ResampleMode = updatemode;
+        QP_ResamplerProcess(&S->Resampler,stream,frames,QP_AudioResampleFill,S);
+    }
+    else
+    {
+        QP_AudioSetClock(S,S->SampleRate);
+        QP_ClockSetRate(&S->ChipClock,ChipRate,1,S->SampleRate);
+        for(i=0;i<frames;i++)
+        {
+            if(updatemode & QPAUDIO_DRV_PLAY)
+            {
+                QP_AudioDriverTick(S);
+                QP_ClockAdvance(&S->DriverClock,1);
+            }
+            if(updatemode & QPAUDIO_CHIP_PLAY)
+            {
+                while(QP_ClockEvent(&S->ChipClock))
+                    DriverUpdateChip(S->Context);
+                QP_ClockAdvance(&S->ChipClock,1);
+
+                DriverSampleChip(S->Context,ChipOut,S->MuteRear ? 2 : 4);
+            }
+            QP_AudioMix(S,stream,ChipOut,4,1,updatemode);
+
+            stream += S->OutChannels;
+        }
+    }
+
+    if(S->FileLogging)
+    {
+        fwrite(start,S->OutChannels*4,frames,S->logfile);
+        S->LogSamples += frames;
+    }
+}
+
+// Set up resampling from the chip rate to the output rate, if needed.
+// If the resampler can't be initialized, sample and hold is used.
+static void QP_AudioInitResampler(QP_AudioCallbackData* S,int ChipRate,int Quality)
+{
+    if(ChipRate == S->SampleRate)
+        return;
+    if(QP_ResamplerInit(&S->Resampler,ChipRate,S->SampleRate,S->OutChannels,Quality))
+        return;
+    S->Resample = 1;
+}
+
+// Reset the render state. The context is kept.
+void QP_AudioStateReset(QP_AudioCallbackData* S)
+{
+    memset(&S->ChipClock,0,sizeof(QP_Clock));
+    memset(&S->DriverClock,0,sizeof(QP_Clock));
+    S->TickRate=0;
+    S->VgmDelay=0;
+    S->MuteRear=0;
+    S->Gain=2.0;
+    S->FastForward=0;
+    S->FileLogging=0;
+    S->LogSamples=0;
+    S->Resample=0;
+}
+
+int QP_AudioStateInit(QP_AudioCallbackData* S,int ChipRate,int SampleRate,int SampleCount,int ChannelCount,int Quality)
+{
+    QP_AudioStateReset(S);
+
+    S->OutChannels = ChannelCount;
+    S->SampleRate = SampleRate ? SampleRate : ChipRate;
+    S->SampleCount = SampleCount;
+
+    QP_AudioInitResampler(S,ChipRate,Quality);
+    return 0;
+}
+
+void QP_AudioStateFree(QP_AudioCallbackData* S)
+{
+    if(S->Resample)
+    {
+        QP_ResamplerFree(&S->Resampler);
+        S->Resample=0;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+    Mixing and render timing
+*/
+#ifndef MIXER_H_INCLUDED
+#define MIXER_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lib/clock.h"
+#include "lib/resample.h"
+
+enum {
+    QPAUDIO_DRV_PLAY = 1,
+    QPAUDIO_CHIP_PLAY = 2,
+    QPAUDIO_MUTE = 4,
+};
+// max frames rendered by the driver per call
+#define QPAUDIO_BLOCK_SIZE 256
+
+typedef struct {
+
+    struct QP_Context* Context; // driver and game to play
+
+    // temporary home for this variable until i find a better place.
+    int AutoPlaySong;
+
+    int UpdateRequest;
+
+    uint32_t SampleRate;
+
+    int FastForward;
+
+    QP_Clock ChipClock; // only used if the chip is not rendered at its own rate
+    QP_Clock DriverClock;
+    double TickRate;
+    uint32_t TickNum, TickDen; // TickRate as a fraction
+    uint64_t VgmDelay; // remainder of VGM delays
+
+    float Gain;
+
+    int MuteRear; // set to mute rear channels (for systems that don't have them)
+    int OutChannels; // words per sample
+    int SampleCount;
+
+    int FileLogging;
+    FILE* logfile;
+    uint32_t LogSamples;
+
+    float ChipBuffer[QPAUDIO_BLOCK_SIZE*4];
+
+    // set if the chip rate differs from the output rate
+    int Resample;
+    QP_Resampler Resampler;
+    int ResampleMode;
+
+} QP_AudioCallbackData;
+
+// Render audio and run the sound driver. The Context member must be set.
+void QP_AudioRender(QP_AudioCallbackData* S,float* stream,int frames);
+
+// Set up the render state for the output format. SampleRate can be 0 to
+// render at the chip rate. The context is kept. Resample is set if the chip
+// output is resampled, otherwise a different rate uses sample and hold.
+int  QP_AudioStateInit(QP_AudioCallbackData* S,int ChipRate,int SampleRate,int SampleCount,int ChannelCount,int Quality);
+void QP_AudioStateReset(QP_AudioCallbackData* S);
+void QP_AudioStateFree(QP_AudioCallbackData* S);
+
+#endif // MIXER_H_INCLUDED
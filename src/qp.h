@@ -15,18 +15,18 @@
 #include "driver.h"
 #include "audio.h"
 #include "loader.h"
+#include "context.h"
 #include "lib/audit.h"
-
-    char QP_IniPath[128];
-    char QP_WavePath[128];
-    char QP_DataPath[128];
+#include "songindex.h"
 
     char QP_DragDropPath[256];
 
+    // Context used by the user interface. Game and Audio point to the
+    // members of Context.
+    QP_Context *Context;
     QP_Audio *Audio;
     QP_Game  *Game;
     QP_Audit *Audit;
-
-    struct QP_DriverInterface *DriverInterface;
+    QP_SongIndex *SongIndex;
 
 #endif // QP_H_INCLUDED
@@ -0,0 +1,155 @@
+/*
+    QuattroPlay library API
+
+    A player owns a context with its own game and render state, so it only
+    uses the code shared with the application (loader, drivers, mixer).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quattroplay.h"
+#include "loader.h"
+#include "driver.h"
+#include "context.h"
+#include "mixer.h"
+
+// frames rendered per call by default, only used as a hint
+#define PLAYER_BLOCK_SIZE 1024
+
+struct QP_Player {
+    QP_Context Context;
+    QP_Game Game;
+    QP_AudioCallbackData State;
+};
+
+void QP_PlayerSetPaths(const char* inipath,const char* datapath,const char* wavepath)
+{
+    snprintf(QP_IniPath,sizeof(QP_IniPath),"%s",inipath);
+    snprintf(QP_DataPath,sizeof(QP_DataPath),"%s",datapath);
+    snprintf(QP_WavePath,sizeof(QP_WavePath),"%s",wavepath);
+}
+
+QP_Player* QP_PlayerOpen(const char* game,int rate,int channels,char* error,int errlen)
+{
+    QP_Player* p;
+    QP_Context* ctx;
+    QP_Game* G;
+
+    if(!strlen(QP_IniPath))
+        QP_PlayerSetPaths("ini","roms","roms");
+
+    p = malloc(sizeof(QP_Player));
+    if(!p)
+    {
+        if(error)
+            snprintf(error,errlen,"Out of memory");
+        return NULL;
+    }
+    memset(&p->Context,0,sizeof(QP_Context));
+    memset(&p->State,0,sizeof(QP_AudioCallbackData));
+
+    ctx = &p->Context;
+    G = &p->Game;
+    QP_GameDefaults(G);
+    snprintf(G->Name,sizeof(G->Name),"%s",game);
+    ctx->Game = G;
+    ctx->State = &p->State;
+
+    if(channels != 1 && channels != 2 && channels != 4)
+    {
+        snprintf(ctx->Error,sizeof(ctx->Error),"Unsupported channel count %d",channels);
+        goto fail;
+    }
+    if(LoadGame(ctx))
+        goto fail;
+    // the boot song is played silently, as when a song is given on the
+    // command line
+    G->BootSong = 2;
+    if(InitGame(ctx))
+        goto fail;
+
+    // rear channels are mixed down, same as the application
+    if(channels < 4)
+        G->Gain/=2;
+    QP_AudioStateInit(&p->State,DriverGetChipRate(ctx),rate,PLAYER_BLOCK_SIZE,channels,G->ResampleQuality);
+    p->State.AutoPlaySong = G->AutoPlay;
+    p->State.MuteRear = G->MuteRear;
+    p->State.Gain = G->BaseGain*G->Gain;
+    p->State.UpdateRequest = QPAUDIO_CHIP_PLAY|QPAUDIO_DRV_PLAY;
+    return p;
+
+fail:
+    if(error)
+        snprintf(error,errlen,"%s",ctx->Error);
+    UnloadGame(ctx);
+    free(p);
+    return NULL;
+}
+
+void QP_PlayerClose(QP_Player* p)
+{
+    if(!p)
+        return;
+    QP_AudioStateFree(&p->State);
+    DeInitGame(&p->Context);
+    UnloadGame(&p->Context);
+    free(p);
+}
+
+int QP_PlayerGetSampleRate(QP_Player* p)
+{
+    return p->State.SampleRate;
+}
+
+int QP_PlayerGetSongCount(QP_Player* p)
+{
+    return DriverGetSongCount(&p->Context,0);
+}
+
+void QP_PlayerRequestSong(QP_Player* p,int id)
+{
+    p->Game.PlaylistControl = 0;
+    p->Game.Fadeout = 0;
+    p->Game.QueueSong = id & 0xfff;
+}
+
+void QP_PlayerStopSong(QP_Player* p,int slot)
+{
+    DriverStopSong(&p->Context,slot);
+}
+
+void QP_PlayerFadeOutSong(QP_Player* p,int slot)
+{
+    DriverFadeOutSong(&p->Context,slot);
+}
+
+void QP_PlayerGetStatus(QP_Player* p,int slot,QP_PlayerStatus* status)
+{
+    QP_Context* ctx = &p->Context;
+    int s = DriverGetSongStatus(ctx,slot);
+    status->SongId = DriverGetSongId(ctx,slot);
+    status->Playing = (s & (SONG_STATUS_PLAYING|SONG_STATUS_STOPPING)) != 0;
+    status->Time = DriverGetPlayingTime(ctx,slot);
+    status->LoopCount = DriverGetLoopCount(ctx,slot);
+}
+
+int QP_PlayerGetParameterCount(QP_Player* p)
+{
+    return DriverGetParameterCount(&p->Context);
+}
+
+void QP_PlayerSetParameter(QP_Player* p,int id,int value)
+{
+    DriverSetParameter(&p->Context,id,value);
+}
+
+int QP_PlayerGetParameter(QP_Player* p,int id)
+{
+    return DriverGetParameter(&p->Context,id);
+}
+
+void QP_PlayerRender(QP_Player* p,float* buffer,int frames)
+{
+    QP_AudioRender(&p->State,buffer,frames);
+}
@@ -0,0 +1,56 @@
+/*
+    QuattroPlay library API
+
+    Plays the sound drivers without SDL or the user interface, build with
+    "make lib". Calls for one player must not overlap, separate players can
+    be used from different threads.
+*/
+#ifndef QUATTROPLAY_H_INCLUDED
+#define QUATTROPLAY_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct QP_Player QP_Player;
+
+typedef struct {
+    int SongId;     // song ID in the slot
+    int Playing;    // nonzero if the song is playing or fading out
+    double Time;    // playing time in seconds
+    int LoopCount;
+} QP_PlayerStatus;
+
+// Set the directories with game configs and ROMs. Defaults are "ini",
+// "roms" and "roms". Must not be called while a player is being opened.
+void QP_PlayerSetPaths(const char* inipath,const char* datapath,const char* wavepath);
+
+// Load a game by its config name. rate is the output sample rate (0 = chip
+// rate), channels is 1, 2 or 4. Returns NULL on failure, with a message in
+// error if it is not NULL.
+QP_Player* QP_PlayerOpen(const char* game,int rate,int channels,char* error,int errlen);
+void QP_PlayerClose(QP_Player* p);
+
+int  QP_PlayerGetSampleRate(QP_Player* p);
+int  QP_PlayerGetSongCount(QP_Player* p);
+
+// Start a song at the next driver tick. Set bit 11 (0x800) of the ID to
+// play it in slot 8, as with the --autoplay option.
+void QP_PlayerRequestSong(QP_Player* p,int id);
+void QP_PlayerStopSong(QP_Player* p,int slot);
+void QP_PlayerFadeOutSong(QP_Player* p,int slot);
+void QP_PlayerGetStatus(QP_Player* p,int slot,QP_PlayerStatus* status);
+
+// Driver parameters (registers), see the game config for their meaning.
+int  QP_PlayerGetParameterCount(QP_Player* p);
+void QP_PlayerSetParameter(QP_Player* p,int id,int value);
+int  QP_PlayerGetParameter(QP_Player* p,int id);
+
+// Render interleaved frames.
+void QP_PlayerRender(QP_Player* p,float* buffer,int frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QUATTROPLAY_H_INCLUDED
@@ -0,0 +1,85 @@
+/*
+    Offline (headless) rendering
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "SDL2/SDL.h"
+
+#include "qp.h"
+#include "render.h"
+
+// give up if the song has not started after this many seconds
+#define RENDER_START_TIMEOUT 10
+
+int QP_RenderSong(QP_Context *ctx,QP_RenderResult* r)
+{
+    QP_Game* G = ctx->Game;
+    QP_AudioCallbackData* S = ctx->State;
+
+    int slot = G->AutoPlay & 0x800 ? 8 : 0;
+    int started = 0;
+    int status;
+    int BlockSize = S->SampleCount;
+    int frames;
+
+    uint64_t pos = 0;
+    uint64_t maxpos = G->RenderTime * S->SampleRate;
+    uint64_t timeout = RENDER_START_TIMEOUT * S->SampleRate;
+
+    memset(r,0,sizeof(*r));
+    float* buffer = malloc(BlockSize*S->OutChannels*sizeof(float));
+    if(!buffer)
+        return -1;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    S->UpdateRequest = QPAUDIO_CHIP_PLAY|QPAUDIO_DRV_PLAY;
+
+    while(1)
+    {
+        frames = BlockSize;
+        if(maxpos && pos + frames > maxpos)
+            frames = maxpos - pos;
+
+        QP_AudioRender(S,buffer,frames);
+        pos += frames;
+
+        if(maxpos && pos >= maxpos)
+            break;
+
+        status = DriverGetSongStatus(ctx,slot);
+        if(status & SONG_STATUS_PLAYING)
+            started = 1;
+        else if(!started && pos > timeout)
+            break;
+
+        // song has ended
+        if(started && !(status & (SONG_STATUS_PLAYING|SONG_STATUS_STOPPING)))
+            break;
+        if(G->RenderLoops && DriverGetLoopCount(ctx,slot) >= G->RenderLoops)
+            break;
+    }
+
+    r->Started = started;
+    r->Elapsed = (double)(SDL_GetPerformanceCounter()-start)/SDL_GetPerformanceFrequency();
+    r->Length = (double)pos / S->SampleRate;
+
+    S->UpdateRequest = 0;
+    free(buffer);
+    return started ? 0 : -1;
+}
+
+int QP_Render(QP_Context *ctx)
+{
+    QP_RenderResult r;
+    int val = QP_RenderSong(ctx,&r);
+
+    if(!r.Started)
+        printf("Song %03x did not start\n",ctx->Game->AutoPlay&0x7ff);
+    printf("Rendered %.2f seconds in %.2f seconds (%.1fx realtime)\n",
+           r.Length, r.Elapsed, r.Elapsed > 0 ? r.Length/r.Elapsed : 0);
+    return val;
+}
@@ -0,0 +1,18 @@
+#ifndef RENDER_H_INCLUDED
+#define RENDER_H_INCLUDED
+
+#include "context.h"
+
+typedef struct {
+    int Started;
+    double Length;  // seconds rendered
+    double Elapsed; // seconds taken
+} QP_RenderResult;
+
+// Render the song set in AutoPlay to the WAV log as fast as possible.
+// The game must be loaded and initialized with Headless set.
+int QP_Render(QP_Context *ctx);
+// As above, but the result is returned instead of printed.
+int QP_RenderSong(QP_Context *ctx,QP_RenderResult* r);
+
+#endif // RENDER_H_INCLUDED
@@ -2,8 +2,9 @@
 #include <stdlib.h>
 #include <math.h>
 
-#include "../qp.h"
+#include "../driver.h"
 #include "../lib/vgm.h"
+#include "../lib/clock.h"
 
 #include "s2x.h"
 #include "helper.h"
@@ -25,7 +26,8 @@ int S2X_IInit(void* d,QP_Game *g)
 
     S->PCMClock = SYSTEMNA ? 50113000/2 : 49152000/2; // sound chip freq is master clock / 2
     C352_init(&S->PCMChip,S->PCMClock);
-    S->PCMChip.vgm_log = 0;
+    C352_set_core(&S->PCMChip,g->C352Core);
+    S->PCMChip.vgm = NULL;
     if(SYSTEMNA)
     {
         S->PCMChip.wave = g->Data;
@@ -37,17 +39,53 @@ int S2X_IInit(void* d,QP_Game *g)
         S->PCMChip.wave = g->WaveData;
         S->PCMChip.wave_mask = g->WaveMask;
     }
+    if(g->SampleCache > 0)
+        C352_cache_init(&S->PCMChip,g->SampleCache<<20);
     S->Data = g->Data;
+    S->DataSize = g->DataSize;
 
     S->FMClock = 3579545;
-    S->FMTicks = 0;
-    S->FMWriteTicks = 0;
+    S->FMTime = 0;
+    S->FMWriteSlot = 1;
     YM2151_init(&S->FMChip,S->FMClock);
+    YM2151_set_core(&S->FMChip,g->YM2151Core);
 
     S->SoundRate = S->PCMChip.rate;
-    S->FMDelta = S->FMChip.rate / S->SoundRate;
+    S->FMRate = S->FMChip.rate;
     S->FMWriteRate = SYSTEM1 ? 1.0 : 2.5;
 
+    // FM writes are scheduled in integer units to avoid drift
+    QP_ClockRational(S->FMWriteRate,&S->FMWriteNum,&S->FMWriteDen);
+    S->FMQueueRead = S->FMQueueWrite = 0;
+    S->FMQueueSize = S2X_FM_QUEUE_SIZE;
+    S->FMQueue = malloc(S->FMQueueSize*sizeof(S2X_FMWrite));
+    if(!S->FMQueue)
+    {
+        C352_cache_free(&S->PCMChip);
+        return -1;
+    }
+    S->FMDirect = g->DriverOnly;
+
+    // FM is rendered at its own rate and resampled to the C352 rate. The
+    // images start above 28 kHz, so the medium quality filter is enough.
+    if(QP_ResamplerInit(&S->FMResampler,S->FMRate,S->SoundRate,2,QP_RESAMPLE_MEDIUM))
+    {
+        C352_cache_free(&S->PCMChip);
+        free(S->FMQueue);
+        S->FMQueue = NULL;
+        return -1;
+    }
+    S->FMOut[0] = S->FMOut[1] = 0;
+
+    S->FMThreaded = 0;
+    if(g->FMThread)
+    {
+        if(QP_WorkerInit(&S->FMWorker,"S2X_FMWorker"))
+            Q_DEBUG("Could not start FM thread\n");
+        else
+            S->FMThreaded = 1;
+    }
+
     g->MuteRear = 1;
 
     return 0;
@@ -57,7 +95,7 @@ void S2X_IDeinit(void* d)
     S2X_State* S = d;
     S2X_Deinit(S);
 }
-void S2X_IVgmOpen(void* d)
+void S2X_IVgmOpen(void* d,QP_Vgm* v)
 {
     S2X_State* S = d;
 
@@ -67,26 +105,30 @@ void S2X_IVgmOpen(void* d)
         S2X_WSGLoadWave(S);
     }
 
-    vgm_datablock(0x92,0x1000000,S->PCMChip.wave,0x1000000,S->PCMChip.wave_mask,0);
-    S->PCMChip.vgm_log = 1;
+    vgm_datablock(v,0x92,0x1000000,S->PCMChip.wave,0x1000000,S->PCMChip.wave_mask,0);
+    S->PCMChip.vgm = v;
 }
-void S2X_IVgmClose(void* d)
+void S2X_IVgmClose(void* d,int muterear)
 {
     S2X_State* S = d;
-    S->PCMChip.vgm_log = 0;
-    vgm_poke32(0xdc,S->PCMClock | Audio->state.MuteRear<<31);
-    vgm_poke8(0xd6,288/4);
+    QP_Vgm* v = S->PCMChip.vgm;
+    S->PCMChip.vgm = NULL;
+    vgm_poke32(v,0xdc,S->PCMClock | muterear<<31);
+    vgm_poke8(v,0xd6,288/4);
 
-    vgm_poke32(0x30,S->FMClock);
+    vgm_poke32(v,0x30,S->FMClock);
 }
 void S2X_IReset(void* d,QP_Game* g,int initial)
 {
     S2X_State* S = d;
     Q_DEBUG("S2X: Reset\n");
     YM2151_reset(&S->FMChip);
+    QP_ResamplerReset(&S->FMResampler);
+    S->FMOut[0] = S->FMOut[1] = 0;
 
     S->FMQueueRead=0;
     S->FMQueueWrite=0;
+    S->FMWriteSlot=1;
 
     if(initial)
         S2X_Init(S);
@@ -252,41 +294,116 @@ double S2X_IChipRate(void* d)
     S2X_State* S = d;
     return S->SoundRate;
 }
-void S2X_IUpdateChip(void* d)
+// Render FM at the chip rate. The chip is rendered in blocks up to the
+// time of the next queued write.
+static void S2X_RenderFM(S2X_State *S,float* out,int frames)
 {
-    S2X_State *S = d;
-    S->FMTicks += S->FMDelta;
-    S->FMWriteTicks += S->FMDelta;
-    while(S->FMWriteTicks > S->FMWriteRate)
+    const float scale = 1.0f / (32768*6);
+    int32_t buf[C352_BLOCK*2];
+    uint64_t next;
+    int i,len;
+    while(frames > 0)
     {
-        if((S->FMQueueRead&0x1ff) != (S->FMQueueWrite&0x1ff))
-            S2X_OPMReadQueue(S);
-        S->FMWriteTicks-=S->FMWriteRate;
+        len = frames > C352_BLOCK ? C352_BLOCK : frames;
+        if(S->FMQueueRead != S->FMQueueWrite)
+        {
+            next = S->FMQueue[S->FMQueueRead&(S->FMQueueSize-1)].Time;
+            if(next <= S->FMTime)
+            {
+                S2X_OPMReadQueue(S);
+                continue;
+            }
+            if(next-S->FMTime < (uint64_t)len)
+                len = next-S->FMTime;
+        }
+        YM2151_render(&S->FMChip,buf,len);
+        S->FMTime += len;
+        for(i=0;i<len*2;i++)
+            out[i] = buf[i] * scale;
+        out += len*2;
+        frames -= len;
     }
-    while(S->FMTicks > 1.0)
+}
+
+// Get FM output at the C352 rate
+static void S2X_ResampleFM(S2X_State *S,float* out,int frames)
+{
+    float buf[C352_BLOCK*2];
+    int len, need = QP_ResamplerNeeded(&S->FMResampler,frames);
+    while(need > 0)
     {
-        YM2151_update(&S->FMChip);
-        S->FMTicks-=1.0;
+        len = need > C352_BLOCK ? C352_BLOCK : need;
+        S2X_RenderFM(S,buf,len);
+        QP_ResamplerWrite(&S->FMResampler,buf,len);
+        need -= len;
     }
+    QP_ResamplerRead(&S->FMResampler,out,frames);
+}
 
+static void S2X_FMJob(void* d)
+{
+    S2X_State *S = d;
+    S2X_ResampleFM(S,S->FMBuffer,S->FMFrames);
+}
+
+void S2X_IUpdateChip(void* d)
+{
+    S2X_State *S = d;
+    S2X_OPMReserve(S);
+    S2X_ResampleFM(S,S->FMOut,1);
     C352_update(&S->PCMChip);
 }
 void S2X_ISampleChip(void* d,float* samples,int samplecnt)
 {
     S2X_State* S = d;
+    const double scale = 1.0 / (1<<28);
     int i;
     if(samplecnt > 4)
         samplecnt=4;
     for(i=0;i<samplecnt;i++)
-        samples[i] = S->PCMChip.out[i] / (1<<28);
+        samples[i] = S->PCMChip.out[i] * scale;
     if(samplecnt > 2)
         samplecnt=2;
     for(i=0;i<samplecnt;i++)
+        samples[i] += S->FMOut[i];
+        //samples[i] += S->FMOut[i]/2; // for finallap
+}
+void S2X_IRenderBlock(void* d,float* out,int frames,int channels)
+{
+    S2X_State* S = d;
+    const double scale = 1.0 / (1<<28);
+    int32_t buf[C352_BLOCK*4];
+    float* fm = S->FMBuffer;
+    int i,j,len,n = channels > 4 ? 4 : channels;
+    int fmch = n > 2 ? 2 : n;
+    S2X_OPMReserve(S);
+    while(frames > 0)
     {
-        double last = S->FMChip.out[i+2];
-        double next = S->FMChip.out[i];
-        samples[i] += (last+(S->FMTicks*(next-last)))/6;
-        //samples[i] += (last+(S->FMTicks*(next-last)))/12; // for finallap
+        // the chips are independent, so they can be rendered separately.
+        // The FM write queue is only changed by the driver tick, which
+        // does not run during the block.
+        len = frames > C352_BLOCK ? C352_BLOCK : frames;
+        if(S->FMThreaded)
+        {
+            S->FMFrames = len;
+            QP_WorkerRun(&S->FMWorker,S2X_FMJob,S);
+            C352_render(&S->PCMChip,buf,len);
+            QP_WorkerWait(&S->FMWorker);
+        }
+        else
+        {
+            C352_render(&S->PCMChip,buf,len);
+            S2X_ResampleFM(S,fm,len);
+        }
+        for(i=0;i<len;i++)
+        {
+            for(j=0;j<n;j++)
+                out[j] = buf[i*4+j] * scale;
+            for(j=0;j<fmch;j++)
+                out[j] += fm[i*2+j];
+            out += channels;
+        }
+        frames -= len;
     }
 }
 
@@ -558,6 +675,7 @@ struct QP_DriverInterface S2X_CreateInterface()
         .IChipRate = &S2X_IChipRate,
         .IUpdateChip = &S2X_IUpdateChip,
         .ISampleChip = &S2X_ISampleChip,
+        .IRenderBlock = &S2X_IRenderBlock,
 
         .IGetMute = &S2X_IGetMute,
         .ISetMute = &S2X_ISetMute,
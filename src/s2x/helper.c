@@ -1,7 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "../qp.h"
+#include "../driver.h"
 #include "../lib/vgm.h"
 
 #include "s2x.h"
@@ -13,18 +13,6 @@
 #define SYSTEM1 (S->ConfigFlags & S2X_CFG_SYSTEM1)
 #define SYSTEMNA (S->DriverType == S2X_TYPE_NA)
 
-uint8_t S2X_ReadByte(S2X_State *S,uint32_t d)
-{
-    return S->Data[d];
-}
-
-uint16_t S2X_ReadWord(S2X_State *S,uint32_t d)
-{
-    if(SYSTEMNA) // little endian
-        return ((S->Data[d+1]<<8) | (S->Data[d]<<0));
-    return ((S->Data[d]<<8) | (S->Data[d+1]<<0));
-}
-
 void S2X_UpdateMuteMask(S2X_State *S)
 {
     if(S->SoloMask)
@@ -50,30 +38,67 @@ void S2X_OPMWrite(S2X_State *S,int ch,int op,int reg,uint8_t data)
     else if(reg == 0x08)
         data |= ch;
 
-    if(S->PCMChip.vgm_log)
-        vgm_write(0x54,0,fmreg,data);
-
-    S2X_FMWrite w = {fmreg,data};
+    if(S->PCMChip.vgm)
+        vgm_write(S->PCMChip.vgm,0x54,0,fmreg,data);
 
-    //Q_DEBUG("write queue %02x (%02x %02x)\n",S->FMQueueWrite,fmreg,data);
-    S->FMQueue[(S->FMQueueWrite++)&0x1ff] = w;
+    // nothing drains the queue if FM is not rendered
+    if(S->FMDirect)
+    {
+        YM2151_write_reg(&S->FMChip,fmreg,data);
+        return;
+    }
 
-    // flush the queue!
-    if((S->FMQueueWrite&0x1ff) == (S->FMQueueRead&0x1ff))
+    // The queue is grown between ticks, see S2X_OPMReserve. If one tick
+    // fills it anyway, the queued writes are sent now, and new writes are
+    // scheduled from the current time again.
+    if(S->FMQueueWrite-S->FMQueueRead == S->FMQueueSize)
     {
         Q_DEBUG("flushing queue (OPM is not keeping up!)\n");
         do S2X_OPMReadQueue(S);
-        while ((S->FMQueueWrite&0x1ff) != (S->FMQueueRead&0x1ff));
+        while(S->FMQueueWrite != S->FMQueueRead);
+        S->FMWriteSlot = 0;
     }
+
+    // one write is sent every FMWriteRate FM samples, in order
+    uint64_t slot = (S->FMTime*S->FMWriteDen + S->FMWriteNum-1)/S->FMWriteNum;
+    if(slot < S->FMWriteSlot)
+        slot = S->FMWriteSlot;
+    S->FMWriteSlot = slot+1;
+
+    S2X_FMWrite w = {slot*S->FMWriteNum/S->FMWriteDen,fmreg,data};
+
+    //Q_DEBUG("write queue %02x (%02x %02x)\n",S->FMQueueWrite,fmreg,data);
+    S->FMQueue[(S->FMQueueWrite++)&(S->FMQueueSize-1)] = w;
 }
 
+// Send the next queued write to the chip
 void S2X_OPMReadQueue(S2X_State *S)
 {
     //Q_DEBUG("read  queue %02x (%02x %02x)\n",S->FMQueueRead,S->FMQueue[S->FMQueueRead].Reg,S->FMQueue[S->FMQueueRead].Data);
-    S2X_FMWrite* w = &S->FMQueue[(S->FMQueueRead++)&0x1ff];
+    S2X_FMWrite* w = &S->FMQueue[(S->FMQueueRead++)&(S->FMQueueSize-1)];
     return YM2151_write_reg(&S->FMChip,w->Reg,w->Data);
 }
 
+// Double the OPM queue if it is more than half full, so the next driver tick
+// has room for its writes without allocating. Called before rendering.
+// Returns nonzero on failure
+int S2X_OPMReserve(S2X_State *S)
+{
+    uint32_t i, size = S->FMQueueSize*2;
+    S2X_FMWrite* q;
+    if(S->FMQueueWrite-S->FMQueueRead <= S->FMQueueSize/2)
+        return 0;
+    q = malloc(size*sizeof(S2X_FMWrite));
+    if(!q)
+        return -1;
+    for(i=S->FMQueueRead;i!=S->FMQueueWrite;i++)
+        q[i&(size-1)] = S->FMQueue[i&(S->FMQueueSize-1)];
+    free(S->FMQueue);
+    S->FMQueue = q;
+    S->FMQueueSize = size;
+    return 0;
+}
+
 // only used when writes need to be synchronized for link mode
 void S2X_PCMWrite(S2X_State *S,S2X_PCMVoice* V,int reg,uint16_t data)
 {
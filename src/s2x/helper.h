@@ -1,15 +1,26 @@
 #ifndef S2X_HELPER_H_INCLUDED
 #define S2X_HELPER_H_INCLUDED
 #include "../macro.h"
-#include "../qp.h"
+#include "../driver.h"
 
 uint32_t S2X_ReadPos(S2X_State *S,uint32_t d);
-uint8_t S2X_ReadByte(S2X_State *S,uint32_t d);
-uint16_t S2X_ReadWord(S2X_State *S,uint32_t d);
+// Sound data is read for every track command operand and envelope step,
+// so these are inlined.
+static inline uint8_t S2X_ReadByte(S2X_State *S,uint32_t d)
+{
+    return S->Data[d];
+}
+static inline uint16_t S2X_ReadWord(S2X_State *S,uint32_t d)
+{
+    if(S->DriverType == S2X_TYPE_NA) // little endian
+        return ((S->Data[d+1]<<8) | (S->Data[d]<<0));
+    return ((S->Data[d]<<8) | (S->Data[d+1]<<0));
+}
 // uint16_t S2X_ReadWordBE(Q_State *Q,uint32_t d);
 void S2X_UpdateMuteMask(S2X_State *S);
 void S2X_OPMWrite(S2X_State *S,int ch,int op,int reg,uint8_t data);
 void S2X_OPMReadQueue(S2X_State *S);
+int S2X_OPMReserve(S2X_State *S);
 void S2X_PCMWrite(S2X_State *S,S2X_PCMVoice* V,int reg,uint16_t data);
 
 // loop detection callback
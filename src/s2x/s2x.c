@@ -2,7 +2,7 @@
 #include <string.h>
 #include <stdint.h>
 
-#include "../qp.h"
+#include "../driver.h"
 
 #include "s2x.h"
 #include "helper.h"
@@ -17,7 +17,7 @@ void S2X_Init(S2X_State *S)
 {
     QP_LoopDetect ld = {
         .TrackCnt = S2X_MAX_TRACKS,
-        .DataSize = Game->DataSize,
+        .DataSize = S->DataSize,
         .SongCnt = 0x400,
         .CheckValid = S2X_LoopDetectValid,
         .Driver = S
@@ -42,6 +42,15 @@ void S2X_Init(S2X_State *S)
 void S2X_Deinit(S2X_State *S)
 {
     QP_LoopDetectFree(&S->LoopDetect);
+    if(S->PCMChip.cache_table)
+        Q_DEBUG("sample cache: %u hits, %u pages decoded\n",S->PCMChip.cache_hits,S->PCMChip.cache_misses);
+    C352_cache_free(&S->PCMChip);
+    if(S->FMThreaded)
+        QP_WorkerFree(&S->FMWorker);
+    S->FMThreaded = 0;
+    QP_ResamplerFree(&S->FMResampler);
+    free(S->FMQueue);
+    S->FMQueue = NULL;
 }
 
 void S2X_Reset(S2X_State *S)
@@ -70,6 +79,8 @@ void S2X_Reset(S2X_State *S)
     memset(S->Track,0,sizeof(S->Track));
     memset(S->ActiveChannel,0,sizeof(S->ActiveChannel));
     memset(S->ChannelPriority,0,sizeof(S->ChannelPriority));
+    memset(S->PriorityMask,0,sizeof(S->PriorityMask));
+    memset(S->PriorityTrack,0,sizeof(S->PriorityTrack));
 
     S->FrameCnt=0;
 
@@ -84,6 +95,9 @@ void S2X_UpdateTick(S2X_State *S)
 {
     S->FrameCnt ++;
 
+    // Busy tracks are visited on every tick even when no update is due,
+    // since the song timer, fadeout and the System 86 tempo counter are
+    // advanced per tick.
     int i;
     for(i=0;i<S2X_MAX_TRACKS;i++)
     {
@@ -9,6 +9,8 @@
 #include "../emu/c352.h"
 #include "../emu/ym2151.h"
 #include "../lib/loopdetect.h"
+#include "../lib/resample.h"
+#include "../lib/worker.h"
 
 #include "enum.h"
 #include "struct.h"
@@ -17,6 +17,9 @@
 
 #define S2X_MAX_BANK 15
 
+// initial OPM queue size, power of two
+#define S2X_FM_QUEUE_SIZE 4096
+
 typedef struct S2X_Channel S2X_Channel;
 typedef struct S2X_WSGChannel S2X_WSGChannel;
 typedef struct S2X_Track S2X_Track;
@@ -252,6 +255,7 @@ struct S2X_SE {
 };
 
 struct S2X_FMWrite {
+    uint64_t Time; // FM sample when the write is sent to the chip
     uint8_t Reg;
     uint8_t Data;
 };
@@ -260,10 +264,17 @@ struct S2X_State {
 
     // Audio configuration
     double SoundRate;
-    double FMDelta;
-    double FMTicks;
-    double FMWriteTicks;
+    uint32_t FMRate;
+    uint64_t FMTime; // FM samples rendered
+    uint64_t FMWriteSlot; // next free write slot, slot n is sent at n*FMWriteRate
+    uint32_t FMWriteNum, FMWriteDen; // FMWriteRate as a fraction
     double FMWriteRate;
+    QP_Resampler FMResampler; // FM rate to SoundRate
+    float FMOut[2]; // current FM sample at SoundRate
+    int FMThreaded;
+    QP_Worker FMWorker; // renders FM while the C352 is rendered
+    int FMFrames;
+    float FMBuffer[C352_BLOCK*2];
 
     uint32_t SoloMask;
     uint32_t MuteMask;
@@ -276,6 +287,7 @@ struct S2X_State {
 
     // ROM data
     uint8_t *Data;
+    uint32_t DataSize;
 
     // misc
     char *BankName[S2X_MAX_BANK];
@@ -308,9 +320,11 @@ struct S2X_State {
     uint8_t FMLfoAms;
     uint16_t FMLfoDepthDelta;
 
-    uint16_t FMQueueWrite;
-    uint16_t FMQueueRead;
-    S2X_FMWrite FMQueue[512];
+    uint32_t FMQueueWrite;
+    uint32_t FMQueueRead;
+    uint32_t FMQueueSize; // power of two, grows between driver ticks
+    S2X_FMWrite* FMQueue;
+    int FMDirect; // FM is not rendered, writes go straight to the chip
 
     // track vars
     uint16_t SongRequest[S2X_MAX_TRACKS+1];
@@ -331,6 +345,8 @@ struct S2X_State {
 
     // List of allocated voices for each track and the associated priority.
     S2X_ChannelPriority ChannelPriority[S2X_MAX_VOICES][S2X_MAX_TRACKS];
+    uint16_t PriorityMask[S2X_MAX_VOICES]; // tracks with a priority set
+    uint8_t PriorityTrack[S2X_MAX_VOICES]; // track with the highest priority
 };
 
 
@@ -1,12 +1,12 @@
 #ifndef S2X_TABLES_H_INCLUDED
 #define S2X_TABLES_H_INCLUDED
 
-char* S2X_DriverTypes[S2X_TYPE_MAX];
-uint8_t S2X_FMKeyCodes[0x80];
-uint8_t S2X_FMConnection[8];
-uint16_t S2X_PitchTable[0x60];
-uint16_t S2X_EnvelopeRateTable[0x80];
-uint8_t S2X_AdsrTable[16];
-uint8_t S2X_NABankTable[7];
+extern char* S2X_DriverTypes[S2X_TYPE_MAX];
+extern uint8_t S2X_FMKeyCodes[0x80];
+extern uint8_t S2X_FMConnection[8];
+extern uint16_t S2X_PitchTable[0x60];
+extern uint16_t S2X_EnvelopeRateTable[0x80];
+extern uint8_t S2X_AdsrTable[16];
+extern uint8_t S2X_NABankTable[7];
 
 #endif // S2X_TABLES_H_INCLUDED
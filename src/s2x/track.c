@@ -267,8 +267,8 @@ void S2X_TrackDisable(S2X_State *S,int TrackNo)
     //uint16_t cflags;
     for(i=0;i<S2X_MAX_VOICES;i++)
     {
-        S->ChannelPriority[i][TrackNo].channel = 0;
-        S->ChannelPriority[i][TrackNo].priority = 0;
+        if(S->PriorityMask[i] & (1<<TrackNo))
+            S2X_VoiceSetPriority(S,i,TrackNo,0,0);
     }
     for(i=0;i<S2X_MAX_TRKCHN;i++)
     {
@@ -60,21 +60,36 @@ void S2X_VoiceClearChannel(S2X_State *S,int VoiceNo)
     }
 }
 
-uint16_t S2X_VoiceGetPriority(S2X_State *S,int VoiceNo,int* TrackNo,int* ChannelNo)
+// find the track with the highest priority, lowest track number wins ties
+static int S2X_VoiceFindPriority(S2X_State *S,int VoiceNo)
 {
     int i;
-    int track = 0;
-    int channel=0;
+    int track=0;
     int priority=0;
-    for(i=0;i<S2X_MAX_TRACKS;i++)
+    uint32_t mask = S->PriorityMask[VoiceNo];
+    while(mask)
     {
+        i = __builtin_ctz(mask);
+        mask &= mask-1;
         if(S->ChannelPriority[VoiceNo][i].priority > priority)
         {
             track=i;
-            channel=S->ChannelPriority[VoiceNo][i].channel;
             priority=S->ChannelPriority[VoiceNo][i].priority;
         }
     }
+    return track;
+}
+
+uint16_t S2X_VoiceGetPriority(S2X_State *S,int VoiceNo,int* TrackNo,int* ChannelNo)
+{
+    int track = S->PriorityTrack[VoiceNo];
+    int channel=0;
+    int priority = S->ChannelPriority[VoiceNo][track].priority;
+
+    if(priority)
+        channel = S->ChannelPriority[VoiceNo][track].channel;
+    else
+        track = 0;
 
     if(TrackNo != NULL)
         *TrackNo = track;
@@ -86,8 +101,29 @@ uint16_t S2X_VoiceGetPriority(S2X_State *S,int VoiceNo,int* TrackNo,int* Channel
 
 void S2X_VoiceSetPriority(S2X_State *S,int VoiceNo,int TrackNo,int ChannelNo,int Priority)
 {
-    S->ChannelPriority[VoiceNo][TrackNo].channel = ChannelNo;
-    S->ChannelPriority[VoiceNo][TrackNo].priority = Priority;
+    S2X_ChannelPriority *P = &S->ChannelPriority[VoiceNo][TrackNo];
+    int top = S->PriorityTrack[VoiceNo];
+    uint16_t old = P->priority;
+
+    P->channel = ChannelNo;
+    P->priority = Priority;
+
+    if(P->priority)
+        S->PriorityMask[VoiceNo] |= 1<<TrackNo;
+    else
+        S->PriorityMask[VoiceNo] &= ~(1<<TrackNo);
+
+    // keep track of the highest priority track
+    if(TrackNo == top)
+    {
+        if(P->priority < old)
+            S->PriorityTrack[VoiceNo] = S2X_VoiceFindPriority(S,VoiceNo);
+    }
+    else if(P->priority > S->ChannelPriority[VoiceNo][top].priority ||
+            (P->priority && P->priority == S->ChannelPriority[VoiceNo][top].priority && TrackNo < top))
+    {
+        S->PriorityTrack[VoiceNo] = TrackNo;
+    }
 }
 
 int S2X_SetVoiceType(S2X_State *S,int VoiceNo,int VoiceType,int Count)
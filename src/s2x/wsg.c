@@ -68,6 +68,8 @@ void S2X_WSGLoadWave(S2X_State *S)
         pos+=4;
     }
 
+    // the WSG tables are small enough, no need for the sample cache
+    C352_cache_free(&S->PCMChip);
     S->PCMChip.wave = S->WSGWaveData;
     S->PCMChip.wave_mask = sizeof(S->WSGWaveData)-1;
 
@@ -245,8 +247,7 @@ void S2X_WSGChannelStart(S2X_State *S,int TrackNo,S2X_Channel *C,int ChannelNo,u
 
 void S2X_WSGChannelStop(S2X_State *S,int TrackNo,S2X_Channel *C,int ChannelNo)
 {
-    S->ChannelPriority[C->VoiceNo][TrackNo].channel = 0;
-    S->ChannelPriority[C->VoiceNo][TrackNo].priority = 0;
+    S2X_VoiceSetPriority(S,C->VoiceNo,TrackNo,0,0);
 
     C->WSG.Active = 0;
     if(C->Enabled)
@@ -0,0 +1,497 @@
+/*
+    Persistent song length index
+
+    Song lengths for every game in the library, measured with the song
+    analyzer. The index is stored as an ini file and updated in the
+    background. A game is only analyzed again if the CRC of its ini or
+    ROM files has changed.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "SDL2/SDL.h"
+
+#include "qp.h"
+#include "songindex.h"
+#include "analyze.h"
+#include "lib/ini.h"
+
+static uint32_t crc_table[256];
+
+static void QP_SongIndexMakeCrcTable()
+{
+    uint32_t c;
+    int i,j;
+    for(i=0;i<256;i++)
+    {
+        c = i;
+        for(j=0;j<8;j++)
+            c = (c & 1) ? 0xedb88320 ^ (c>>1) : c>>1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t QP_SongIndexCrc(uint32_t crc,const uint8_t* data,size_t len)
+{
+    crc = ~crc;
+    while(len--)
+        crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc>>8);
+    return ~crc;
+}
+
+static uint32_t QP_SongIndexFileCrc(const char* filename)
+{
+    uint8_t* buf;
+    size_t len;
+    uint32_t crc = 0;
+    FILE* f = fopen(filename,"rb");
+    if(!f)
+        return 0;
+    buf = malloc(0x10000);
+    if(buf)
+    {
+        while((len = fread(buf,1,0x10000,f)) > 0)
+            crc = QP_SongIndexCrc(crc,buf,len);
+        free(buf);
+    }
+    fclose(f);
+    return crc;
+}
+
+static QP_SongIndexGame* QP_SongIndexFind(QP_SongIndex* idx,const char* game)
+{
+    int i;
+    for(i=0;i<idx->GameCount;i++)
+    {
+        if(!strcmp(idx->Game[i].Name,game))
+            return &idx->Game[i];
+    }
+    return NULL;
+}
+
+static QP_SongIndexGame* QP_SongIndexAdd(QP_SongIndex* idx,const char* game)
+{
+    QP_SongIndexGame* g;
+    if(idx->GameCount == idx->GameAlloc)
+    {
+        int alloc = idx->GameAlloc ? idx->GameAlloc*2 : 64;
+        g = realloc(idx->Game,alloc*sizeof(*g));
+        if(!g)
+            return NULL;
+        idx->Game = g;
+        idx->GameAlloc = alloc;
+    }
+    g = &idx->Game[idx->GameCount++];
+    memset(g,0,sizeof(*g));
+    strncpy(g->Name,game,sizeof(g->Name)-1);
+    return g;
+}
+
+static void QP_SongIndexLoad(QP_SongIndex* idx)
+{
+    QP_SongIndexGame* g = NULL;
+    QP_SongIndexSong* s;
+    long long size, time;
+    unsigned int crc, id, silent, peak;
+    char type;
+
+    inifile_t ini;
+    if(ini_open(idx->Filename,&ini))
+        return;
+    while(!ini_readnext(&ini))
+    {
+        if(strcmp(ini.section,"game"))
+            continue;
+        if(!strcmp(ini.key,"name"))
+            g = QP_SongIndexAdd(idx,ini.value);
+        else if(!g)
+            continue;
+        else if(!strcmp(ini.key,"hash"))
+            g->Hash = strtoul(ini.value,NULL,16);
+        else if(!strcmp(ini.key,"file") && g->FileCount < SONGINDEX_MAX_FILES)
+        {
+            if(sscanf(ini.value,"%lld %lld %x",&size,&time,&crc) == 3)
+            {
+                g->File[g->FileCount].Size = size;
+                g->File[g->FileCount].Time = time;
+                g->File[g->FileCount].Crc = crc;
+                g->FileCount++;
+            }
+        }
+        else if(!strcmp(ini.key,"songs") && !g->Song)
+        {
+            g->SongCount = atoi(ini.value);
+            g->Song = calloc(g->SongCount ? g->SongCount : 1,sizeof(*g->Song));
+            if(!g->Song)
+                g->SongCount = 0;
+        }
+        else if(sscanf(ini.key,"s%x",&id) == 1 && id < g->SongCount)
+        {
+            s = &g->Song[id];
+            if(sscanf(ini.value,"%c %u %f %f %f %u",&type,&silent,&s->Length,&s->LoopStart,&s->LoopLength,&peak) != 6)
+                continue;
+            s->Type = type == 'l' ? ANALYZE_LOOP : type == 'o' ? ANALYZE_ONESHOT : ANALYZE_TIMEOUT;
+            s->Silent = silent;
+            s->Peak = peak;
+        }
+    }
+    ini_close(&ini);
+}
+
+// Write the index to disk. Must be called with the lock held.
+static int QP_SongIndexWrite(QP_SongIndex* idx)
+{
+    static const char type[] = {'-','o','l','t'};
+    char tempname[280];
+    QP_SongIndexGame* g;
+    QP_SongIndexSong* s;
+    int i,j;
+    FILE* f;
+
+    // write to a temporary file first, to not lose the index on a crash
+    snprintf(tempname,sizeof(tempname),"%s.tmp",idx->Filename);
+    f = fopen(tempname,"w");
+    if(!f)
+        return -1;
+
+    fprintf(f,"; QuattroPlay song index. This file is generated automatically.\n");
+    fprintf(f,"; s<id> = <type> <silent> <length> <loop start> <loop length> <peak>\n");
+    for(i=0;i<idx->GameCount;i++)
+    {
+        g = &idx->Game[i];
+        fprintf(f,"\n[game]\nname = %s\nhash = %08x\n",g->Name,g->Hash);
+        for(j=0;j<g->FileCount;j++)
+            fprintf(f,"file = %lld %lld %08x\n",(long long)g->File[j].Size,(long long)g->File[j].Time,g->File[j].Crc);
+        fprintf(f,"songs = %d\n",g->SongCount);
+        for(j=0;j<g->SongCount;j++)
+        {
+            s = &g->Song[j];
+            if(s->Type == ANALYZE_INVALID)
+                continue;
+            fprintf(f,"s%03x = %c %d %.3f %.3f %.3f %d\n",j,type[s->Type&3],s->Silent,
+                    s->Length,s->LoopStart,s->LoopLength,s->Peak);
+        }
+    }
+
+    if(fclose(f))
+        return -1;
+    remove(idx->Filename);
+    return rename(tempname,idx->Filename);
+}
+
+// Initialize the index and load it from disk. Returns nonzero on failure.
+int QP_SongIndexInit(QP_SongIndex* idx,const char* filename)
+{
+    memset(idx,0,sizeof(*idx));
+    QP_SongIndexMakeCrcTable();
+    strncpy(idx->Filename,filename,sizeof(idx->Filename)-1);
+    idx->Lock = SDL_CreateMutex();
+    if(!idx->Lock)
+        return -1;
+    QP_SongIndexLoad(idx);
+    return 0;
+}
+
+void QP_SongIndexFree(QP_SongIndex* idx)
+{
+    int i;
+    QP_SongIndexStop(idx);
+    for(i=0;i<idx->GameCount;i++)
+        free(idx->Game[i].Song);
+    free(idx->Game);
+    if(idx->Lock)
+        SDL_DestroyMutex(idx->Lock);
+    memset(idx,0,sizeof(*idx));
+}
+
+int QP_SongIndexSave(QP_SongIndex* idx)
+{
+    int val;
+    SDL_LockMutex(idx->Lock);
+    val = QP_SongIndexWrite(idx);
+    SDL_UnlockMutex(idx->Lock);
+    return val;
+}
+
+// Analyze a game and store the results in g. Returns nonzero on failure.
+static int QP_SongIndexAnalyze(QP_SongIndex* idx,QP_AuditEntry* e,QP_SongIndexGame* g)
+{
+    char msgstring[1024];
+    QP_AnalyzeInfo info;
+    QP_AnalyzeResult* r;
+    QP_SongIndexSong* s;
+    QP_Game* game;
+    int i, type, val = -1;
+
+    game = malloc(sizeof(QP_Game));
+    if(!game)
+        return -1;
+    memcpy(game,&idx->Config,sizeof(QP_Game));
+    strcpy(game->Name,e->Name);
+    game->Data = NULL;
+    game->WaveData = NULL;
+
+    snprintf(msgstring,sizeof(msgstring),"Failed to index '%s':",e->Name);
+    if(LoadGameData(game,&type,msgstring))
+        printf("%s\n",msgstring);
+    else if(!QP_AnalyzeSongs(game,type,ANALYZE_MAX_TIME,&info,&idx->Quit))
+    {
+        g->Song = calloc(info.SongCnt ? info.SongCnt : 1,sizeof(*g->Song));
+        if(g->Song)
+        {
+            val = 0;
+            g->SongCount = info.SongCnt;
+            for(i=0;i<info.SongCnt;i++)
+            {
+                r = &info.Result[i];
+                s = &g->Song[i];
+                s->Type = r->Type;
+                s->Silent = r->Silent;
+                s->Peak = r->Peak;
+                if(r->Type == ANALYZE_LOOP)
+                {
+                    s->LoopStart = r->Length/info.TickRate;
+                    s->LoopLength = r->Loop/info.TickRate;
+                    s->Length = s->LoopStart+s->LoopLength;
+                }
+                else if(r->Type == ANALYZE_ONESHOT)
+                    s->Length = r->Length/info.TickRate;
+            }
+        }
+        QP_AnalyzeFree(&info);
+    }
+
+    FreeGameData(game);
+    free(game);
+    return val;
+}
+
+static void QP_SongIndexUpdateGame(QP_SongIndex* idx,QP_AuditEntry* e)
+{
+    char path[SONGINDEX_MAX_FILES][128];
+    int recalc[SONGINDEX_MAX_FILES];
+    QP_SongIndexGame g, *old;
+    struct stat st;
+    int i, changed;
+
+    if(strlen(e->Name) >= sizeof(g.Name))
+        return;
+
+    memset(&g,0,sizeof(g));
+    strcpy(g.Name,e->Name);
+
+    if(snprintf(path[0],sizeof(path[0]),"%s/%s.ini",QP_IniPath,e->Name) >= (int)sizeof(path[0]))
+        return;
+    for(i=0;i<e->RomCount && i+1<SONGINDEX_MAX_FILES;i++)
+        strcpy(path[i+1],e->Rom[i].Path);
+    g.FileCount = i+1;
+
+    for(i=0;i<g.FileCount;i++)
+    {
+        g.File[i].Size = -1;
+        if(!stat(path[i],&st))
+        {
+            g.File[i].Size = st.st_size;
+            g.File[i].Time = st.st_mtime;
+        }
+    }
+
+    // only recalculate the CRC of changed files
+    SDL_LockMutex(idx->Lock);
+    old = QP_SongIndexFind(idx,e->Name);
+    changed = !old || old->FileCount != g.FileCount;
+    for(i=0;i<g.FileCount;i++)
+    {
+        recalc[i] = changed || old->File[i].Size != g.File[i].Size || old->File[i].Time != g.File[i].Time;
+        if(!recalc[i])
+            g.File[i].Crc = old->File[i].Crc;
+        changed |= recalc[i];
+    }
+    SDL_UnlockMutex(idx->Lock);
+
+    if(!changed)
+        return;
+
+    for(i=0;i<g.FileCount;i++)
+    {
+        if(recalc[i])
+            g.File[i].Crc = QP_SongIndexFileCrc(path[i]);
+        g.Hash = QP_SongIndexCrc(g.Hash,(uint8_t*)&g.File[i].Crc,sizeof(g.File[i].Crc));
+    }
+
+    // the update thread is the only writer, so old is still valid here.
+    // If the analysis fails, the old entry is kept so the game is retried.
+    if(!old || old->Hash != g.Hash)
+    {
+        if(QP_SongIndexAnalyze(idx,e,&g) || SDL_AtomicGet(&idx->Quit))
+        {
+            free(g.Song);
+            return;
+        }
+    }
+
+    SDL_LockMutex(idx->Lock);
+    if(old)
+    {
+        if(old->Hash == g.Hash)
+        {
+            g.SongCount = old->SongCount;
+            g.Song = old->Song;
+        }
+        else
+            free(old->Song);
+        *old = g;
+    }
+    else if((old = QP_SongIndexAdd(idx,e->Name)))
+        *old = g;
+    else
+        free(g.Song);
+    QP_SongIndexWrite(idx);
+    SDL_UnlockMutex(idx->Lock);
+}
+
+static int QP_SongIndexThread(void* data)
+{
+    QP_SongIndex* idx = data;
+    int i;
+    for(i=0;i<idx->QueueCount;i++)
+    {
+        if(SDL_AtomicGet(&idx->Quit))
+            break;
+        QP_SongIndexUpdateGame(idx,&idx->Queue[i]);
+        SDL_AtomicSet(&idx->Progress,i+1);
+    }
+    SDL_AtomicSet(&idx->Running,0);
+    return 0;
+}
+
+int QP_SongIndexStart(QP_SongIndex* idx,QP_Audit* audit,QP_Game* config)
+{
+    int i;
+
+    if(QP_SongIndexBusy(idx))
+        return -1;
+    QP_SongIndexStop(idx);
+
+    idx->Queue = malloc((audit->Count > 0 ? audit->Count : 1)*sizeof(QP_AuditEntry));
+    if(!idx->Queue)
+        return -1;
+    idx->QueueCount = 0;
+    SDL_AtomicSet(&idx->Progress,0);
+    for(i=0;i<audit->Count;i++)
+    {
+        if(audit->Entry[i].RomOk)
+            idx->Queue[idx->QueueCount++] = audit->Entry[i];
+    }
+    memcpy(&idx->Config,config,sizeof(QP_Game));
+
+    SDL_AtomicSet(&idx->Quit,0);
+    SDL_AtomicSet(&idx->Running,1);
+    idx->Thread = SDL_CreateThread(QP_SongIndexThread,"QP_SongIndex",idx);
+    if(!idx->Thread)
+    {
+        SDL_AtomicSet(&idx->Running,0);
+        free(idx->Queue);
+        idx->Queue = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the update. The current game is abandoned.
+void QP_SongIndexStop(QP_SongIndex* idx)
+{
+    if(idx->Thread)
+    {
+        SDL_AtomicSet(&idx->Quit,1);
+        SDL_WaitThread(idx->Thread,NULL);
+        idx->Thread = NULL;
+    }
+    free(idx->Queue);
+    idx->Queue = NULL;
+    idx->QueueCount = 0;
+}
+
+int QP_SongIndexBusy(QP_SongIndex* idx)
+{
+    return SDL_AtomicGet(&idx->Running);
+}
+
+int QP_SongIndexGetSong(QP_SongIndex* idx,const char* game,int id,QP_SongIndexSong* song)
+{
+    QP_SongIndexGame* g;
+    int val = -1;
+    if(!idx || !idx->Lock)
+        return -1;
+    SDL_LockMutex(idx->Lock);
+    g = QP_SongIndexFind(idx,game);
+    if(g && id >= 0 && id < g->SongCount && g->Song[id].Type != ANALYZE_INVALID)
+    {
+        *song = g->Song[id];
+        val = 0;
+    }
+    SDL_UnlockMutex(idx->Lock);
+    return val;
+}
+
+int QP_SongIndexGetGame(QP_SongIndex* idx,const char* game,int* count,double* length)
+{
+    QP_SongIndexGame* g;
+    int i;
+    if(!idx || !idx->Lock)
+        return -1;
+    SDL_LockMutex(idx->Lock);
+    g = QP_SongIndexFind(idx,game);
+    if(g)
+    {
+        *count = 0;
+        *length = 0;
+        for(i=0;i<g->SongCount;i++)
+        {
+            if(g->Song[i].Type == ANALYZE_INVALID || g->Song[i].Silent)
+                continue;
+            *count += 1;
+            *length += g->Song[i].Length;
+        }
+    }
+    SDL_UnlockMutex(idx->Lock);
+    return g ? 0 : -1;
+}
+
+double QP_SongIndexPlayTime(const QP_SongIndexSong* song,int loops)
+{
+    if(song->Type != ANALYZE_LOOP)
+        return song->Length;
+    return song->LoopStart + song->LoopLength*(loops > 0 ? loops : 1);
+}
+
+// Playlist entries without loops or time wait for two loops. If the song
+// index has measured the loop, the time from the index is used instead, so
+// that songs where loop detection does not work during playback still fade.
+void QP_SongIndexSetPlaylistWait(QP_SongIndex* idx,QP_Game* G)
+{
+    QP_PlaylistScript *S;
+    QP_SongIndexSong song;
+    int i,j;
+    for(i=0;i<G->SongCount;i++)
+    {
+        for(j=0;j<16;j++)
+        {
+            S = &G->Playlist[i].script[j];
+            if(S->wait_type != 3)
+                continue;
+            S->wait_type = 0;
+            // banked songs may not be the ones that were indexed
+            if(G->Playlist[i].Bank < 0 &&
+               !QP_SongIndexGetSong(idx,G->Name,G->Playlist[i].SongID&0x7ff,&song) &&
+               song.Type == ANALYZE_LOOP)
+            {
+                S->wait_type = 1;
+                S->wait_count = ceil(QP_SongIndexPlayTime(&song,S->wait_count));
+            }
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/*
+    Persistent song length index
+*/
+#ifndef SONGINDEX_H_INCLUDED
+#define SONGINDEX_H_INCLUDED
+
+#include <stdint.h>
+
+#include "SDL2/SDL_atomic.h"
+#include "SDL2/SDL_mutex.h"
+#include "SDL2/SDL_thread.h"
+
+#include "loader.h"
+#include "lib/audit.h"
+
+#define SONGINDEX_FILENAME "songindex.ini"
+#define SONGINDEX_MAX_FILES (AUDIT_MAX_ROMS+1) // ini + roms
+
+// A file the index entry depends on. The CRC is only recalculated when the
+// size or modification time changes.
+typedef struct {
+    int64_t Size;
+    int64_t Time;
+    uint32_t Crc;
+} QP_SongIndexFile;
+
+typedef struct {
+    uint8_t Type;   // ANALYZE_* constant
+    uint8_t Silent;
+    uint8_t Peak;   // highest voice volume (0-255)
+    float Length;   // seconds until the song stops, or intro + one loop
+    float LoopStart;
+    float LoopLength;
+} QP_SongIndexSong;
+
+typedef struct {
+    char Name[64];
+    uint32_t Hash; // CRC32 of the file CRCs
+    int FileCount;
+    QP_SongIndexFile File[SONGINDEX_MAX_FILES];
+    int SongCount;
+    QP_SongIndexSong* Song;
+} QP_SongIndexGame;
+
+typedef struct {
+    char Filename[256];
+    SDL_mutex* Lock; // held when accessing Game
+    int GameCount;
+    int GameAlloc;
+    QP_SongIndexGame* Game;
+
+    // Background update. The game list is copied from the audit when
+    // starting, Progress is the number of games checked so far.
+    SDL_Thread* Thread;
+    SDL_atomic_t Quit;
+    SDL_atomic_t Running;
+    int QueueCount;
+    QP_AuditEntry* Queue;
+    SDL_atomic_t Progress;
+    QP_Game Config; // global configuration used when loading games
+} QP_SongIndex;
+
+int  QP_SongIndexInit(QP_SongIndex* idx,const char* filename);
+void QP_SongIndexFree(QP_SongIndex* idx);
+int  QP_SongIndexSave(QP_SongIndex* idx);
+
+// Start updating the index for all games with good ROMs in the audit, in
+// the background. Returns nonzero if an update is already running.
+int  QP_SongIndexStart(QP_SongIndex* idx,QP_Audit* audit,QP_Game* config);
+void QP_SongIndexStop(QP_SongIndex* idx);
+int  QP_SongIndexBusy(QP_SongIndex* idx);
+
+// Look up a song, returns nonzero if the song is not indexed or not valid.
+int  QP_SongIndexGetSong(QP_SongIndex* idx,const char* game,int id,QP_SongIndexSong* song);
+// Get the number of valid songs and their total length (one loop each).
+// Returns nonzero if the game is not indexed.
+int  QP_SongIndexGetGame(QP_SongIndex* idx,const char* game,int* count,double* length);
+// Playing time of a song with the specified number of loops.
+double QP_SongIndexPlayTime(const QP_SongIndexSong* song,int loops);
+// Resolve default playlist waits of a loaded game (idx may be NULL).
+void QP_SongIndexSetPlaylistWait(QP_SongIndex* idx,QP_Game* G);
+
+#endif // SONGINDEX_H_INCLUDED
@@ -15,7 +15,7 @@ void ui_info_s2_track(int id,int ypos)
     int i, j, x, y;
     uint8_t note, oct;
 
-    S2X_State *S = DriverInterface->Driver;
+    S2X_State *S = Context->DriverInterface->Driver;
     S2X_Track *T = &S->Track[id];
 
     set_color(ypos,44,6,35,COLOR_D_BLUE,COLOR_L_GREY);
@@ -44,9 +44,9 @@ void ui_info_s2_track(int id,int ypos)
     double bpm = 0;
 
     if(S->DriverType == S2X_TYPE_SYSTEM86)
-        bpm = (double) ((T->BaseTempo*T->Tempo)/65536.0) * (DriverGetTickRate()*15);
+        bpm = (double) ((T->BaseTempo*T->Tempo)/65536.0) * (DriverGetTickRate(Context)*15);
     else if((T->BaseTempo*T->Tempo) > 0)
-        bpm = (double) (DriverGetTickRate()*15) / (T->BaseTempo*T->Tempo);
+        bpm = (double) (DriverGetTickRate(Context)*15) / (T->BaseTempo*T->Tempo);
 
     //                        .............
     SCRN(ypos,44,40,"Pos:   %06x  BPM:%7.2f  Vol:%3d",T->Position+T->PositionBase,bpm,T->TrackVolume);
@@ -95,7 +95,7 @@ void ui_info_s2_track(int id,int ypos)
     {
     case 0:
         //ui_pattern_disp(id);
-        QP_PatternGenerate(id,&pattern);
+        QP_PatternGenerate(Context,id,&pattern);
 
         if(!pattern.len)
             break;
@@ -179,7 +179,7 @@ void ui_info_s2_track(int id,int ypos)
                     oct = (S->DriverType==S2X_TYPE_NA) ? 8 : 16;
                     // grey out if the voice is not currently playing
                     oct = (T->Channel[i].Enabled) ? T->Channel[i].VoiceNo : oct+i;
-                    if(!S->SE[i].Type || S->SE[i].Track != id || (DriverGetVoiceStatus(oct)&0xf000) != 0xf000)
+                    if(!S->SE[i].Type || S->SE[i].Track != id || (DriverGetVoiceStatus(Context,oct)&0xf000) != 0xf000)
                         c2 = COLOR_L_GREY;
                 }
                 else if(!note)
@@ -365,7 +365,7 @@ void ui_info_s2_voice(int id,int ypos)
 {
     int tempypos;
 
-    S2X_State *S = DriverInterface->Driver;
+    S2X_State *S = Context->DriverInterface->Driver;
 
     int type = S->Voice[id].Type;
     int index = S->Voice[id].Index;
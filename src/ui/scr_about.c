@@ -31,13 +31,13 @@ void scr_about()
         set_color(y,1,h,FCOLUMNS-2,COLOR_D_BLUE,COLOR_L_GREY);
         SCRN(y+1,2,FCOLUMNS-3,"Sound driver settings");
         SCRN(y+3,3,FCOLUMNS-4,"%-20s%s",
-             "Driver", DriverInterface->Name);
+             "Driver", Context->DriverInterface->Name);
         SCRN(y+4,3,FCOLUMNS-4,"%-20s%s",
-             "Driver type",DriverGetDriverInfo());
+             "Driver type",DriverGetDriverInfo(Context));
         SCRN(y+5,3,FCOLUMNS-4,"%-20s%.0f Hz",
-             "Tick rate", DriverGetTickRate());
+             "Tick rate", DriverGetTickRate(Context));
         SCRN(y+6,3,FCOLUMNS-4,"%-20s%.0f Hz",
-             "Chip rate", DriverGetChipRate());
+             "Chip rate", DriverGetChipRate(Context));
 /*
         SCRN(y+4,3,FCOLUMNS-4,"%-20s%s",
              "Driver type", Q_McuNames[QDrv->McuType] );
@@ -14,7 +14,7 @@
 
 #include "../legacy.h" /* QDrv */
 
-#define DRV_QUATTRO (DriverInterface->Type == DRIVER_QUATTRO)
+#define DRV_QUATTRO (Context->DriverInterface->Type == DRIVER_QUATTRO)
 
     inputstate_t inpstate;
 
@@ -38,23 +38,23 @@ static void drawreg(int val,int y,int x)
 
     if(val < 0x20)
     {
-        if(DriverGetSlotCount()-1 < val)
+        if(DriverGetSlotCount(Context)-1 < val)
             unmapped=1;
         else
-            v = DriverGetSongId(val)|DriverGetSongStatus(val);
+            v = DriverGetSongId(Context,val)|DriverGetSongStatus(Context,val);
     }
     else if(val < 0x120)
     {
         a = val-0x20;
-        if(DriverGetParameterCount()-1 < a)
+        if(DriverGetParameterCount(Context)-1 < a)
             unmapped=1;
         else
-            v = DriverGetParameter(a);
+            v = DriverGetParameter(Context,a);
     }
-    else if(val < 0x140 && DriverGetVoiceCount()-1 >= a)
+    else if(val < 0x140 && DriverGetVoiceCount(Context)-1 >= a)
     {
-        uint32_t solomask = DriverGetSolo();
-        uint32_t mutemask = DriverGetMute();
+        uint32_t solomask = DriverGetSolo(Context);
+        uint32_t mutemask = DriverGetMute(Context);
 
         a = val-0x120;
         //v=0;
@@ -62,7 +62,7 @@ static void drawreg(int val,int y,int x)
         //    v = 0x8000|(QDrv->Voice[a].TrackNo-1)<<8|(QDrv->Voice[a].ChannelNo);
         //if(QDrv->Voice[a].Enabled)
         //    v |= 0x80;
-        v = DriverGetVoiceStatus(a);
+        v = DriverGetVoiceStatus(Context,a);
 
         if(solomask)
         {
@@ -136,7 +136,7 @@ static void ui_entry_setvalue(int flag, int type, int offset, int value)
     {
     case ENTRY_SONGREQ:
         Game->PlaylistControl = 0;
-        DriverResetLoopCount();
+        DriverResetLoopCount(Context);
         if(DRV_QUATTRO)
         {
             if(flag)
@@ -146,13 +146,13 @@ static void ui_entry_setvalue(int flag, int type, int offset, int value)
         else
         {
             if(flag)
-                DriverRequestSong(offset,value);
+                DriverRequestSong(Context,offset,value);
             else
-                DriverStopSong(offset);
+                DriverStopSong(Context,offset);
         }
         break;
     case ENTRY_REGISTER:
-        DriverSetParameter(offset,value);
+        DriverSetParameter(Context,offset,value);
         // QDrv->Register[offset&0xff] = value;
         break;
     default:
@@ -168,25 +168,25 @@ static void ui_convert_currval()
     if(curr_val < 0x20)
     {
         curr_val_offset = curr_val;
-        if(DriverGetSlotCount() < curr_val_offset)
+        if(DriverGetSlotCount(Context) < curr_val_offset)
             return;
         curr_val_type = ENTRY_SONGREQ;
         //curr_val_edit = QDrv->SongRequest[curr_val_offset] & 0x7ff;
-        curr_val_edit = DriverGetSongId(curr_val_offset);
+        curr_val_edit = DriverGetSongId(Context,curr_val_offset);
     }
     else if(curr_val < 0x120)
     {
         curr_val_offset = curr_val-0x20;
-        if(DriverGetParameterCount() < curr_val_offset)
+        if(DriverGetParameterCount(Context) < curr_val_offset)
             return;
         curr_val_type = ENTRY_REGISTER;
         //curr_val_edit = QDrv->Register[curr_val_offset];
-        curr_val_edit = DriverGetParameter(curr_val_offset);
+        curr_val_edit = DriverGetParameter(Context,curr_val_offset);
     }
     else if(curr_val < 0x140)
     {
         curr_val_offset = curr_val-0x120;
-        if(DriverGetVoiceCount() < curr_val_offset)
+        if(DriverGetVoiceCount(Context) < curr_val_offset)
             return;
         curr_val_type = ENTRY_VOICE;
     }
@@ -194,7 +194,7 @@ static void ui_convert_currval()
 
 static void ui_bounds_check()
 {
-    int song_max = DriverGetSongCount(curr_val_offset)-1;
+    int song_max = DriverGetSongCount(Context,curr_val_offset)-1;
 
     if(curr_val_edit < 0)
         curr_val_edit=0;
@@ -226,7 +226,7 @@ static void scr_main_input()
     case SDLK_7:
     case SDLK_8:
     case SDLK_9:
-        GameDoAction(Game,keycode-SDLK_0);
+        GameDoAction(Context,keycode-SDLK_0);
         break;
     case SDLK_ESCAPE:
         if(inpstate == STATE_SETVALUE)
@@ -275,17 +275,17 @@ static void scr_main_input()
             {
                 Game->PlaylistControl = 0;
                 //Q_LoopDetectionReset(QDrv);
-                DriverResetLoopCount();
+                DriverResetLoopCount(Context);
                 if(keycode==SDLK_f)
-                    DriverFadeOutSong(curr_val_offset);
+                    DriverFadeOutSong(Context,curr_val_offset);
                     //QDrv->SongRequest[curr_val_offset] |= Q_TRACK_STATUS_FADE;
                 if(keycode==SDLK_s)
-                    DriverStopSong(curr_val_offset);
+                    DriverStopSong(Context,curr_val_offset);
                     //QDrv->SongRequest[curr_val_offset] &= ~(Q_TRACK_STATUS_BUSY);
             }
             if(curr_val_type == ENTRY_VOICE)
             {
-                DriverSetSolo(DriverGetSolo() ^ 1<<curr_val_offset);
+                DriverSetSolo(Context,DriverGetSolo(Context) ^ 1<<curr_val_offset);
                 //QDrv->SoloMask ^= 1<<curr_val_offset;
                 //Q_UpdateMuteMask(QDrv);
             }
@@ -297,7 +297,7 @@ static void scr_main_input()
             ui_convert_currval();
             if(curr_val_type == ENTRY_VOICE)
             {
-                DriverSetMute(DriverGetMute() ^ 1<<curr_val_offset);
+                DriverSetMute(Context,DriverGetMute(Context) ^ 1<<curr_val_offset);
                 //QDrv->MuteMask ^= 1<<curr_val_offset;
                 //Q_UpdateMuteMask(QDrv);
             }
@@ -310,7 +310,7 @@ static void scr_main_input()
 
             if(curr_val_type == ENTRY_VOICE)
             {
-                DriverResetMute();
+                DriverResetMute(Context);
             }
             else
                 ui_entry_setvalue(1,curr_val_type,curr_val_offset,curr_val_edit);
@@ -382,7 +382,7 @@ static void scr_main_input()
 void scr_main()
 {
     /*
-    if(DriverInterface->Type != DRIVER_QUATTRO)
+    if(Context->DriverInterface->Type != DRIVER_QUATTRO)
     {
         return scr_main2();
         //screen_mode = SCR_MAIN2;
@@ -402,7 +402,7 @@ void scr_main()
 
     int i, j=0, x=0, y=0;
 
-    SCRN(1,1,FCOLUMNS-2,"%s",DriverGetSongMessage());
+    SCRN(1,1,FCOLUMNS-2,"%s",DriverGetSongMessage(Context));
 
     if(DRV_QUATTRO)
         SCRN(0,FCOLUMNS-4,5,"%04x",QDrv->FrameCnt);
@@ -436,18 +436,18 @@ void scr_main()
     if(curr_val < 0x20)
     {
         i=curr_val;
-        if(i<DriverGetSlotCount())
+        if(i<DriverGetSlotCount(Context))
         {
             ui_info_track(i,5);
             x += SCRN(49,1+x,48,", R: Restart, S: Stop, F: Fade");
-            j += SCRN(3,1,40,"Track %02x = %04x",i,DriverGetSongId(i));
+            j += SCRN(3,1,40,"Track %02x = %04x",i,DriverGetSongId(Context,i));
 
-            double timer = DriverGetPlayingTime(i);
+            double timer = DriverGetPlayingTime(Context,i);
             y += SCRN(3,44+y,40,"%s %2.0f:%02.0f",
-                     DriverGetSongStatus(i)&0x8000 ? "Playing" : "Stopped",
+                     DriverGetSongStatus(Context,i)&0x8000 ? "Playing" : "Stopped",
                      floor(timer/60),floor(fmod(timer,60)));
 
-            int8_t loopcount = DriverGetLoopCount(curr_val); //Q_LoopDetectionGetCount(QDrv,curr_val);
+            int8_t loopcount = DriverGetLoopCount(Context,curr_val); //Q_LoopDetectionGetCount(QDrv,curr_val);
             if(loopcount > 0)
                 y += SCRN(3,44+y,15,", Loop%3d",loopcount);
         }
@@ -456,10 +456,10 @@ void scr_main()
     {
         i = curr_val-0x20;
         static char tempstr[32];
-        if(i<DriverGetParameterCount())
+        if(i<DriverGetParameterCount(Context))
         {
-            DriverGetParameterName(i,tempstr,30);
-            j += SCRN(3,1,40,"%s = %04x",tempstr,DriverGetParameter(i));
+            DriverGetParameterName(Context,i,tempstr,30);
+            j += SCRN(3,1,40,"%s = %04x",tempstr,DriverGetParameter(Context,i));
         }
     }
     else if(curr_val < 0x140)
@@ -470,7 +470,7 @@ void scr_main()
         ui_info_voice(i,5);
         SCRN(3,1,40,"Voice %02x",i);
 
-        i = DriverGetVoiceStatus(i);
+        i = DriverGetVoiceStatus(Context,i);
         if(i&0x8000)
             SCRN(3,44,40,"Track %02x, Channel %02x",(i>>8)&0x1f,i&0x0f);
     }
@@ -61,8 +61,8 @@ static void generate_items()
     int item_max[ITEM_TYPE_COUNT] = {0};
     int item_type_max = 0;
 
-    item_max[ITEM_SONGREQ] = DriverGetSlotCount();
-    item_max[ITEM_PARAMETER] = DriverGetParameterCount();
+    item_max[ITEM_SONGREQ] = DriverGetSlotCount(Context);
+    item_max[ITEM_PARAMETER] = DriverGetParameterCount(Context);
     item_max[ITEM_VOICE] = 32;
 
     item_cnt=0;
@@ -96,7 +96,7 @@ static int item_check_overflow(struct main2_item *i,int value)
     switch(i->type)
     {
     case ITEM_SONGREQ:
-        return (value >= DriverGetSongCount(i->index));
+        return (value >= DriverGetSongCount(Context,i->index));
     case ITEM_PARAMETER:
         return (value > 0xffff); // temporary
     default:
@@ -110,7 +110,7 @@ static int item_set_overflow(struct main2_item *i,int value)
     {
     case ITEM_SONGREQ:
         if(value<0) value=0;
-        max = DriverGetSongCount(i->index);
+        max = DriverGetSongCount(Context,i->index);
         return (value >= max) ? max-1 : value;
     case ITEM_PARAMETER:
         return (value & 0xffff); // temporary
@@ -123,9 +123,9 @@ static int item_get_value(struct main2_item *i)
     switch(i->type)
     {
     case ITEM_SONGREQ:
-        return DriverGetSongId(i->index);
+        return DriverGetSongId(Context,i->index);
     case ITEM_PARAMETER:
-        return DriverGetParameter(i->index);
+        return DriverGetParameter(Context,i->index);
     default:
         return 0;
     }
@@ -138,10 +138,10 @@ static void item_set_value(struct main2_item *i,int value)
     {
     case ITEM_SONGREQ:
         Game->PlaylistControl = 0;
-        DriverResetLoopCount();
-        return DriverRequestSong(i->index,value);
+        DriverResetLoopCount(Context);
+        return DriverRequestSong(Context,i->index,value);
     case ITEM_PARAMETER:
-        return DriverSetParameter(i->index,value);
+        return DriverSetParameter(Context,i->index,value);
     default:
         break;
     }
@@ -152,7 +152,7 @@ static char* item_display_name(struct main2_item *i,char* buffer,int len)
     switch(i->type)
     {
     case ITEM_PARAMETER:
-        if(DriverGetParameterName(i->index,buffer,len))
+        if(DriverGetParameterName(Context,i->index,buffer,len))
             break;
     default:
         snprintf(buffer,len,"%s %02x",item_type_name[i->type],i->index);
@@ -169,9 +169,9 @@ static char* item_display_value(struct main2_item *i,char* buffer,int len)
     switch(i->type)
     {
     case ITEM_VOICE:
-        if(DriverGetSolo()>>i->index & 1)
+        if(DriverGetSolo(Context)>>i->index & 1)
             CATF(buffer,len," (Solo)");
-        if(DriverGetMute()>>i->index & 1)
+        if(DriverGetMute(Context)>>i->index & 1)
             CATF(buffer,len," (Mute)");
         break;
     default:
@@ -180,8 +180,8 @@ static char* item_display_value(struct main2_item *i,char* buffer,int len)
 
         if(i->type == ITEM_SONGREQ)
         {
-            int status = DriverGetSongStatus(i->index);
-            int loopcnt = DriverGetLoopCount(i->index);
+            int status = DriverGetSongStatus(Context,i->index);
+            int loopcnt = DriverGetLoopCount(Context,i->index);
 
             switch(status&(SONG_STATUS_STARTING|SONG_STATUS_PLAYING))
             {
@@ -189,7 +189,7 @@ static char* item_display_value(struct main2_item *i,char* buffer,int len)
             default:
                 break;
             case SONG_STATUS_PLAYING:
-                songtime = DriverGetPlayingTime(i->index);
+                songtime = DriverGetPlayingTime(Context,i->index);
                 if(status & SONG_STATUS_SUBSONG)
                     CATF(buffer,len," (Sub)");
                 else if(loopcnt>0)
@@ -266,11 +266,11 @@ static void check_input()
             {
             case ITEM_SONGREQ:
                 Game->PlaylistControl = 0;
-                DriverResetLoopCount();
-                DriverStopSong(item[select_pos].index);
+                DriverResetLoopCount(Context);
+                DriverStopSong(Context,item[select_pos].index);
                 break;
             case ITEM_VOICE:
-                DriverSetSolo(DriverGetSolo() ^ 1<<item[select_pos].index);
+                DriverSetSolo(Context,DriverGetSolo(Context) ^ 1<<item[select_pos].index);
                 break;
             }
 
@@ -295,7 +295,7 @@ void scr_main2()
     set_color(3,1,1,FCOLUMNS-2,COLOR_D_BLUE|CFLAG_YSHIFT_25,COLOR_L_GREY);
     set_color(5,1,FROWS-7,FCOLUMNS-2,COLOR_D_BLUE,COLOR_L_GREY);
     set_color(49,0,1,FCOLUMNS,COLOR_D_BLUE,COLOR_L_GREY);
-    SCRN(1,1,FCOLUMNS-2,"%s",DriverGetSongMessage());
+    SCRN(1,1,FCOLUMNS-2,"%s",DriverGetSongMessage(Context));
     SCRN(3,1,FCOLUMNS-2,"Sound driver interface");
 
     if(item_cnt == 0)
@@ -5,6 +5,7 @@
 #include "../legacy.h" /* for Q_State */
 
 #include "../qp.h"
+#include "../analyze.h"
 #include "ui.h"
 
 #define PLPAGE (FROWS-7)
@@ -56,7 +57,7 @@ void scr_playlist_input2()
 
 void scr_playlist_input()
 {
-    SDL_LockAudioDevice(Audio->dev);
+    QP_AudioLock(Audio);
 
     got_input=0;
 
@@ -83,9 +84,9 @@ void scr_playlist_input()
     case SDLK_KP_ENTER:
         // force skip the boot song if RETURN is pressed twice
         // while boot song still playing
-        if(Game->PlaylistControl==2 && DriverInterface->Type == DRIVER_QUATTRO)
+        if(Game->PlaylistControl==2 && Context->DriverInterface->Type == DRIVER_QUATTRO)
         {
-            Q_State *Q = DriverInterface->Driver;
+            Q_State *Q = Context->DriverInterface->Driver;
             if(Q->BootSong)
                 Q->Track[0].SkipTrack=1;
         }
@@ -99,9 +100,9 @@ void scr_playlist_input()
         Game->PlaylistControl = 0;
         int SongReq = Game->PlaylistSongID & 0x800 ? 8 : 0;
         if(keycode==SDLK_f)
-            DriverFadeOutSong(SongReq);
+            DriverFadeOutSong(Context,SongReq);
         if(keycode==SDLK_s)
-            DriverStopSong(SongReq);
+            DriverStopSong(Context,SongReq);
         break;
     case SDLK_n:
         select_pos = Game->PlaylistPosition+1;
@@ -119,7 +120,7 @@ void scr_playlist_input()
         got_input=1;
     }
 
-    SDL_UnlockAudioDevice(Audio->dev);
+    QP_AudioUnlock(Audio);
 }
 
 #define MAX_VOICES 32
@@ -130,7 +131,7 @@ void scr_playlist_kbd()
     int16_t pitch;
     int has_drums=0;
 
-    int cnt = DriverGetVoiceCount();
+    int cnt = DriverGetVoiceCount(Context);
     if(!cnt)
         return;
     if(cnt>MAX_VOICES) cnt=MAX_VOICES;
@@ -142,7 +143,7 @@ void scr_playlist_kbd()
     // Get voice info
     for(i=0;i<cnt;i++)
     {
-        if(!DriverGetVoiceInfo(i,&vi[id]))
+        if(!DriverGetVoiceInfo(Context,i,&vi[id]))
         {
             if((vi[id].VoiceType&0x0f) == VOICE_TYPE_PERCUSSION)
             {
@@ -265,8 +266,26 @@ void scr_playlist_kbd()
     free(vi);
 }
 
+// Expected playing time of a playlist entry, from the song index
+static int scr_playlist_length(QP_PlaylistEntry *E,double *length)
+{
+    QP_SongIndexSong song;
+    QP_PlaylistScript *S = &E->script[0];
+
+    // banked songs may not be the ones that were indexed
+    if(E->Bank >= 0 || QP_SongIndexGetSong(SongIndex,Game->Name,E->SongID&0x7ff,&song))
+        return -1;
+    if(song.Type == ANALYZE_LOOP && S->wait_type == 1)
+        *length = S->wait_count;
+    else
+        *length = QP_SongIndexPlayTime(&song,S->wait_type == 0 ? S->wait_count : 2);
+    return 0;
+}
+
 void scr_playlist_list(int ypos,int height)
 {
+    double length;
+    int sec;
     int y = 0;
     int i = select_pos;
     int offset = 0;
@@ -291,6 +310,15 @@ void scr_playlist_list(int ypos,int height)
         set_color(ypos+y,1,1,FCOLUMNS-2,bg,fg);
 
         SCRN(ypos+y,1,FCOLUMNS-2,"%02d %s",i+1,Game->Playlist[i].Title);
+        if(!scr_playlist_length(&Game->Playlist[i],&length))
+        {
+            sec = (int)length;
+            if(sec < 0)
+                sec = 0;
+            if(sec > 5999) // 99:59
+                sec = 5999;
+            SCRN(ypos+y,FCOLUMNS-8,7," %2d:%02d",sec/60,sec%60);
+        }
     }
 }
 
@@ -314,7 +342,7 @@ void scr_playlist()
     set_color(3,1,1,FCOLUMNS-2,COLOR_D_BLUE|CFLAG_YSHIFT_25,COLOR_L_GREY);
     set_color(5,1,FROWS-7,FCOLUMNS-2,COLOR_D_BLUE,COLOR_L_GREY);
     set_color(49,0,1,FCOLUMNS,COLOR_D_BLUE,COLOR_L_GREY);
-    SCRN(1,1,FCOLUMNS-2,"%s",DriverGetSongMessage());
+    SCRN(1,1,FCOLUMNS-2,"%s",DriverGetSongMessage(Context));
 
     int SongReq = Game->PlaylistSongID & 0x800 ? 8 : 0;
 
@@ -344,7 +372,7 @@ void scr_playlist()
 
         if(disp_timer)
         {
-            double songtime = DriverGetPlayingTime(SongReq);
+            double songtime = DriverGetPlayingTime(Context,SongReq);
             SCRN(3,FCOLUMNS-6,6,"%2.0f:%02.0f",
                 floor(songtime/60),floor(fmod(songtime,60)));
         }
@@ -5,6 +5,7 @@
 
 #define PLPAGE (FROWS-7)
     static int select_pos;
+    static int index_started;
 
 static void select_pos_check()
 {
@@ -40,7 +41,10 @@ static void scr_select_input()
         break;
     case SDLK_F3: // refresh rom defs
         if(!Audit->AuditFlag)
+        {
             Audit->Count = 0;
+            index_started = 0;
+        }
         break;
     default:
         break;
@@ -75,6 +79,14 @@ void scr_select()
             AuditRoms(Audit);
     }
 
+    // update the song index once the roms are checked
+    if(SongIndex && Game->BuildIndex && !index_started &&
+       !Audit->AuditFlag && Audit->Count > 0 && Audit->CheckCount == Audit->Count)
+    {
+        if(!QP_SongIndexStart(SongIndex,Audit,Game))
+            index_started = 1;
+    }
+
     set_color(1,1,1,FCOLUMNS-2,COLOR_D_BLUE|CFLAG_YSHIFT_50,COLOR_L_GREY);
     set_color(3,1,1,FCOLUMNS-2,COLOR_D_BLUE|CFLAG_YSHIFT_25,COLOR_L_GREY);
     set_color(5,1,FROWS-7,FCOLUMNS-2,COLOR_D_BLUE,COLOR_L_GREY);
@@ -96,12 +108,16 @@ void scr_select()
             SCRN(3,1,FCOLUMNS-2,"Checking ROMs... (%d of %d)",Audit->CheckCount,Audit->Count);
         else
             SCRN(3,1,FCOLUMNS-2,"Select a game (%d of %d available)",Audit->OkCount,Audit->Count);
+        if(SongIndex && QP_SongIndexBusy(SongIndex))
+            SCRN(3,FCOLUMNS-31,30,"Indexing songs... (%d of %d)",SDL_AtomicGet(&SongIndex->Progress),SongIndex->QueueCount);
 
         if(got_input)
             scr_select_input();
 
         int y = 0;
         int i = select_pos;
+        int songs, sec;
+        double length;
         int offset = 0;
         int max = PLPAGE;
         if(Audit->Count < max)
@@ -129,6 +145,17 @@ void scr_select()
 
             SCRN(5+y,1,FCOLUMNS-2,"%-14s %s",Audit->Entry[i].Name,Audit->Entry[i].DisplayName);
 
+            // song count and total length from the index
+            if(!QP_SongIndexGetGame(SongIndex,Audit->Entry[i].Name,&songs,&length) && songs > 0)
+            {
+                sec = (int)length;
+                if(sec < 0)
+                    sec = 0;
+                if(sec > 59999) // 999:59
+                    sec = 59999;
+                SCRN(5+y,FCOLUMNS-15,13," %3d %3d:%02d",songs > 999 ? 999 : songs,sec/60,sec%60);
+            }
+
             if(Audit->Entry[i].HasPlaylist == 2)
                 set_color(5+y,FCOLUMNS-2,1,1,bg,COLOR_D_GREY);
             if(Audit->Entry[i].HasPlaylist)
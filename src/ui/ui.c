@@ -87,7 +87,7 @@ void ui_handleinput(SDL_Keysym* ks)
     switch(keycode)
     {
     case SDLK_u:
-        DriverUpdateTick();
+        DriverUpdateTick(Context);
         break;
     case SDLK_q:
         if(screen_mode == SCR_MAIN || screen_mode == SCR_SELECT)
@@ -135,9 +135,9 @@ void ui_handleinput(SDL_Keysym* ks)
         if(gameloaded)
         {
             Game->PlaylistControl = 0;
-            SDL_LockAudioDevice(Audio->dev);
-            DriverReset(0);
-            SDL_UnlockAudioDevice(Audio->dev);
+            QP_AudioLock(Audio);
+            DriverReset(Context,0);
+            QP_AudioUnlock(Audio);
         }
         else
         {
@@ -150,7 +150,7 @@ void ui_handleinput(SDL_Keysym* ks)
     case SDLK_F6:
         if(gameloaded)
         {
-            DriverResetMute();
+            DriverResetMute(Context);
         }
         break;
     case SDLK_F7:
@@ -171,18 +171,18 @@ void ui_handleinput(SDL_Keysym* ks)
     case SDLK_F11:
         if(gameloaded)
         {
-            SDL_LockAudioDevice(Audio->dev);
+            QP_AudioLock(Audio);
             if(Audio->state.FileLogging == 0)
                 QP_AudioWavOpen(Audio,"qp_log.wav");
             else
                 QP_AudioWavClose(Audio);
-            SDL_UnlockAudioDevice(Audio->dev);
+            QP_AudioUnlock(Audio);
         }
         break;
     case SDLK_F12:
         if(kbd[SDL_SCANCODE_LSHIFT] || kbd[SDL_SCANCODE_RSHIFT])
         {
-            DriverDebugAction(DEBUG_ACTION_DISPLAY_INFO);
+            DriverDebugAction(Context,DEBUG_ACTION_DISPLAY_INFO);
         }
         else
         {
@@ -223,8 +223,8 @@ int ui_main(screen_mode_t sm)
     #ifdef DEBUG
     printf("Base gain is %.3f\n",Game->BaseGain);
     printf("Game gain is %.3f\n",Game->Gain);
-    if(DriverInterface)
-        printf("Chip rate is %.0f Hz\n",DriverGetChipRate());
+    if(Context->DriverInterface)
+        printf("Chip rate is %.0f Hz\n",DriverGetChipRate(Context));
     //if(QDrv)
     //    printf("Chip Rate is %d Hz\n",QDrv->Chip.rate);
     #endif